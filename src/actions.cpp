@@ -22,123 +22,289 @@
  */
 
 #include "actions.h"
+#include "affinity.h"
+#include "conversations.h"
+#include "flusher.h"
+#include "history.h"
+#include "metrics.h"
+#include "timeline.h"
 using namespace std;
 
-// Packet captured callback, using libpcap
+// Packet captured callback, using libpcap. Checks of protocols not in set
+// are removed by compiler
+template<int PROTOCOLS>
 void gotPacket(u_char *args, const struct pcap_pkthdr *header,
     const u_char *packet)
 {
-  // Get ethernet header
+  // Time spent on each packet is recorded
+  TRACE_SPAN("packet");
+  uint64_t start = Metrics::now();
+  metrics->add(COUNTER_PACKETS);
+
+  // Sniffer which captured packet. Its load is checked each second
+  Sniffer* engine = (Sniffer*)args;
+  engine->checkLoad(header->ts.tv_sec);
+
+  // Get ethernet header, and layer 3 header following it
   struct ethhdr *eth = (struct ethhdr *)packet;
+  const u_char* payload = packet + sizeof(struct ethhdr);
+  uint16_t type = ntohs(eth->h_proto);
 
-  // Process 802.1Q VLAN tagging to guess in which VLAN lives some device
-  if (ntohs(eth->h_proto) == ETHERTYPE_VLAN) {
-    sniffer->processVlan(packet);
+  // Strip 802.1Q VLAN tag, keeping its id to guess in which VLAN lives
+  // some device
+  int vlan = 0;
+  if ((PROTOCOLS & PROTOCOL_VLAN) and type == ETHERTYPE_VLAN) {
+    const uint16_t* tag = (const uint16_t*)payload;
+    vlan = ntohs(tag[0]) & 0x0fff;
+    type = ntohs(tag[1]);
+    payload += 2 * sizeof(uint16_t);
   }
 
   // Process ARP protocol to obtain MAC address relative to some IP
-  // ARP protocol has no ip payload, so exit after processing
-  if (ntohs(eth->h_proto) == ETHERTYPE_ARP) {
-    sniffer->processArp(packet);
+  // ARP protocol has no ip payload, so exit after processing. Without it,
+  // capture filter lets ip packets only
+  if ((PROTOCOLS & PROTOCOL_ARP) and type == ETHERTYPE_ARP) {
+    engine->processArp(payload, vlan);
+    metrics->since(HISTOGRAM_PACKET, start);
+    return;
+  }
+
+  // Tagged frames are not known to be ip until tag is stripped
+  if (type != ETHERTYPE_IP) {
+    metrics->since(HISTOGRAM_PACKET, start);
     return;
   }
 
   // Get ip header
-  struct iphdr *iph = (struct iphdr*)(packet + sizeof(struct ethhdr));
-
-  // Extract source and destination ip addresses
-  in_addr source, destination;
-  source.s_addr = iph->saddr;
-  destination.s_addr = iph->daddr;
-
-  // Store ip addresses as new devices, or discard if has been registered yet
-  string src = string(inet_ntoa(source));
-  string dst = string(inet_ntoa(destination));
-
-  // This is a dummy variable needed for ip validity checks
-  struct sockaddr_in sa;
-
-  // Check source ip address validity
-  if (inet_pton(AF_INET, src.c_str(), &(sa.sin_addr)) > 0) {
-    // Store source ip address if it's not saved yet, and it's private
-    if (sniffer->ipIsPrivate(src) && not monitor->checkDevice(src)) {
-      // Do not store own ip address
-      if (src != sniffer->getIp() and src != sniffer->getSpoofIp()) {
-        Device dev = Device(src);
-        monitor->addDevice(dev);
-      }
-    }
+  struct iphdr *iph = (struct iphdr*)payload;
+
+  // Extract source and destination ip addresses, without formatting them
+  Ipv4Addr src = Ipv4Addr::fromNetwork(iph->saddr);
+  Ipv4Addr dst = Ipv4Addr::fromNetwork(iph->daddr);
+
+  // Count traffic between private devices, even if packet is skipped later
+  if (src.isPrivate() and dst.isPrivate()) {
+    conversations->record(src, dst, header->len, header->ts.tv_sec);
   }
 
-  // Check destination ip address validity
-  if (inet_pton(AF_INET, dst.c_str(), &(sa.sin_addr)) > 0) {
-    // Store destination ip address if it's not saved yet, and it's private
-    if (sniffer->ipIsPrivate(dst) and not monitor->checkDevice(dst)) {
-      // Do not store own ip address, or spoofed
-      if (dst != sniffer->getIp() and dst != sniffer->getSpoofIp()) {
-        Device dev = Device(dst);
-        monitor->addDevice(dev);
-      }
-    }
+  // Under overload, skip packets between known hosts of flows not sampled.
+  // ICMP is always processed, as it tells reachability
+  if (iph->protocol != IPPROTO_ICMP and engine->skip(src, dst)) {
+    metrics->add(COUNTER_PACKETS_SKIPPED);
+    metrics->since(HISTOGRAM_PACKET, start);
+    return;
   }
 
   // Use spoofed ip as own ip address, if defined
-  string ip = sniffer->getIp();
-  if (not sniffer->getSpoofIp().empty()) {
-    ip = sniffer->getSpoofIp();
+  Ipv4Addr ip = engine->getIp();
+  Ipv4Addr spoof = engine->getSpoofIp();
+  if (not spoof.empty()) {
+    ip = spoof;
+  }
+
+  // Store source ip address if it's not saved yet, and it's private. Do not
+  // store own ip address
+  if (src.isPrivate() and not monitor->sightDevice(src)) {
+    if (src != engine->getIp() and src != spoof) {
+      Device dev = Device(src);
+      dev.setInterface(engine->getIndex());
+      monitor->addDevice(dev);
+    }
+  }
+
+  // Store destination ip address if it's not saved yet, and it's private. Do
+  // not store own ip address, or spoofed
+  if (dst.isPrivate() and not monitor->sightDevice(dst)) {
+    if (dst != engine->getIp() and dst != spoof) {
+      Device dev = Device(dst);
+      dev.setInterface(engine->getIndex());
+      monitor->addDevice(dev);
+    }
   }
 
+  // Hosts are known from now on, so their packets may be skipped
+  engine->remember(src);
+  engine->remember(dst);
+
   // Use ICMP packets to guess device reachability
   // As we want to know reachability from our device, only icmp packets with
   // our ip address as destination one are needed
-  if (iph->protocol == 1 && dst == ip) {
-    sniffer->processIcmp(packet, src);
+  if ((PROTOCOLS & PROTOCOL_ICMP) and iph->protocol == 1 && dst == ip) {
+    engine->processIcmp(payload, src);
   }
+
+  metrics->since(HISTOGRAM_PACKET, start);
+}
+
+// Packet callback of some set of protocols. All sets are built here
+pcap_handler getPacketHandler(int protocols) {
+  static const pcap_handler handlers[PROTOCOL_ALL + 1] = {
+    gotPacket<0>, gotPacket<1>, gotPacket<2>, gotPacket<3>,
+    gotPacket<4>, gotPacket<5>, gotPacket<6>, gotPacket<7>
+  };
+  return handlers[protocols & PROTOCOL_ALL];
 }
 
 // Capture action
-void capture(void) {
-  pcap_loop(sniffer->getHandler(), -1, gotPacket, NULL);
+void capture(Sniffer* engine) {
+  TRACE_THREAD("sniffer");
+
+  // Open capture session once placed on cpus close to interface, so its
+  // ring buffer is allocated on their memory
+  affinity->pin(ROLE_CAPTURE, engine->getInterface());
+  engine->open();
+
+  // Packet callback is chosen once, for protocols enabled on sniffer
+  pcap_handler callback = getPacketHandler(engine->getProtocols());
+  pcap_loop(engine->getHandler(), -1, callback, (u_char*)engine);
 }
 
 // Inject action
-void inject(void) {
-  Device dev;
-
-  // Race condition avoid: there must be, at least, one detected device
-  while (monitor->count() == 0) {
-    sleep(1);
-  }
+void inject(Injector* engine) {
+  vector<Device> devices;
+  Ipv4Addr from;
+  bool idle = true;
 
-  // Start on first device on monitor
-  monitor->reset();
+  affinity->pin(ROLE_INJECTOR, engine->getInterface());
 
-  // Iterate over monitor stored devices, and try to guess empty attributes
+  // Iterate over monitor stored devices, a few at a time, and try to guess
+  // empty attributes of those found on injector's interface
   while (1) {
-    dev = monitor->getCurrent();
+    size_t found = monitor->getDevices(from, devices, Injector::CHUNK_SIZE);
 
-    // If current device has not MAC address registered, launch ARP request
-    if (dev.getMac().empty()) {
-      injector->injectArpRequest(dev.getIp());
-    }
+    for (size_t i = 0; i < found; ++i) {
+      const Device& dev = devices[i];
+      if (dev.getInterface() != engine->getIndex()) {
+        continue;
+      }
+
+      // If current device has not MAC address registered, launch ARP
+      // request, and check reachability, if it has not been checked.
+      // Devices which do not answer are only probed again after a while
+      bool arp = dev.getMac().empty();
+      bool icmp = (dev.getReachable() == -1);
+      if ((arp or icmp) and not engine->probed(dev.getIp())) {
+        if (arp) {
+          engine->injectArpRequest(dev.getIp());
+        }
+
+        if (icmp and arp) {
+          engine->injectIcmp(dev.getIp(), MacAddr::BROADCAST);
+        }
+        else if (icmp) {
+          engine->injectIcmp(dev.getIp(), dev.getMac());
+        }
+        idle = false;
+      }
 
-    // Check reachability, if it has not been checked.
-    if (dev.getReachable() == -1) {
-      if (dev.getMac().empty()) {
-        injector->injectIcmp(dev.getIp(), "FF:FF:FF:FF:FF:FF");
+      // Guess hostname, if it has not been guessed
+      if (dev.getHostname().empty() and resolver->enqueue(dev.getIp())) {
+        idle = false;
       }
-      else {
-        injector->injectIcmp(dev.getIp(), dev.getMac());
+
+      // Guess name and description, if device has not been asked yet
+      if (dev.getDescription().empty() and poller->enqueue(dev.getIp())) {
+        idle = false;
+      }
+
+      // Guess hop distance, if it has not been guessed
+      if (dev.getHops() == -1 and tracer->enqueue(dev.getIp())) {
+        idle = false;
+      }
+
+      // If performing IP spoofing, poison current device
+      if (not dev.getMac().empty() and not engine->getSpoofIp().empty()) {
+        engine->injectArpSpoofResponse(dev.getIp(), dev.getMac());
       }
     }
 
-    // If performing IP spoofing, poison current device
-    if (not dev.getMac().empty() and not injector->getSpoofIp().empty()) {
-      injector->injectArpSpoofResponse(dev.getIp(), dev.getMac());
+    // Advance to devices after last one. Once all were visited, start
+    // again from first one, waiting a bit if none of them needed a new
+    // probe or query. Spoofing poisons devices again on each pass
+    if (found == Injector::CHUNK_SIZE) {
+      from = Ipv4Addr::fromHost(devices.back().getIp().toHost() + 1);
+      continue;
+    }
+    engine->expire();
+    if (idle) {
+      sleep(1);
     }
+    from = Ipv4Addr();
+    idle = true;
+  }
+}
+
+// Trace action
+void trace(void) {
+  affinity->pin(ROLE_RESOLVER);
+
+  // Every few milliseconds, send next probes and collect finished traces
+  while (1) {
+    tracer->sweep();
+    tracer->expire();
+    usleep(10000);
+  }
+}
+
+// Resolve action
+void resolve(void) {
+  affinity->pin(ROLE_RESOLVER);
+
+  // Send queued queries, and wait a few milliseconds for answers
+  while (1) {
+    resolver->send();
+    resolver->receive();
+    resolver->expire();
+  }
+}
+
+// Poll action
+void pollDevices(void) {
+  affinity->pin(ROLE_RESOLVER);
+
+  // Send queued requests, and wait a few milliseconds for answers
+  while (1) {
+    poller->send();
+    poller->receive();
+    poller->expire();
+  }
+}
+
+// Persist action
+void persist(void) {
+  TRACE_THREAD("flusher");
+  affinity->pin(ROLE_PERSISTENCE);
 
-    // Advance to next device inside monitor
-    monitor->next();
+  // Write queued changes every few seconds, or when too many are waiting
+  while (1) {
+    flusher->flush();
+  }
+}
+
+// History action
+void keepHistory(void) {
+  affinity->pin(ROLE_PERSISTENCE);
+
+  // Write sightings of each bucket once it ends
+  while (1) {
+    history->flush();
   }
 }
 
+// Conversations action
+void keepConversations(void) {
+  affinity->pin(ROLE_PERSISTENCE);
+
+  // Write counters of each interval once it ends
+  while (1) {
+    conversations->flush();
+  }
+}
+
+// Metrics action
+void serveMetrics(void) {
+  // Answer clients of metrics socket, and print stats lines when due
+  while (1) {
+    metrics->serve();
+  }
+}
@@ -32,29 +32,82 @@
   #include <string>
 
   #include "injector.h"
+  #include "poller.h"
+  #include "resolver.h"
   #include "sniffer.h"
+  #include "tracer.h"
 
-  // TODO Implement SNMP processing, to extract hostname. Maybe getnameinfo?
-  // TODO Implement traceroute to guess device distance in network hops
+  // Engines of each capture interface, which include this file too
+  class Injector;
+  class Sniffer;
 
   /**
-   * Callback to give response to a captured packet by libpcap
-   * @param args Custom arguments to pass to function
+   * Callback to give response to a captured packet by libpcap. There is a
+   * version for each set of protocols, so disabled protocols cost nothing
+   * on each packet. All of them are built on actions.cpp
+   * @param args Sniffer which captured packet
    * @param header Header of captured data, in libpcap format
    * @param packet Captured packet
    */
+  template<int PROTOCOLS>
   void gotPacket(u_char *args, const struct pcap_pkthdr *header,
       const u_char *packet);
 
+  /**
+   * Returns packet callback which processes some set of protocols
+   * @param protocols Set of protocols, as bits of PacketProtocol
+   * @return Version of packet callback built for that set
+   */
+  pcap_handler getPacketHandler(int protocols);
+
   /**
    * Inits libpcap live capture. Launch as thread.
+   * @param engine Sniffer of capture interface
    */
-  void capture(void);
+  void capture(Sniffer* engine);
 
   /**
    * Injects packets into wire, using libnet capabilities. Launch as thread.
+   * @param engine Injector of capture interface
+   */
+  void inject(Injector* engine);
+
+  /**
+   * Sends TTL limited probes to guess devices hop distance. Launch as thread.
+   */
+  void trace(void);
+
+  /**
+   * Sends reverse DNS queries to guess devices hostname. Launch as thread.
+   */
+  void resolve(void);
+
+  /**
+   * Sends SNMP requests to guess devices name and description. Launch as
+   * thread.
+   */
+  void pollDevices(void);
+
+  /**
+   * Writes queued device changes to database. Launch as thread.
+   */
+  void persist(void);
+
+  /**
+   * Writes sightings of devices as each time bucket ends. Launch as thread.
+   */
+  void keepHistory(void);
+
+  /**
+   * Writes conversations between devices as each interval ends. Launch as
+   * thread.
+   */
+  void keepConversations(void);
+
+  /**
+   * Serves runtime metrics, and prints stats lines. Launch as thread.
    */
-  void inject(void);
+  void serveMetrics(void);
 
 #endif
 
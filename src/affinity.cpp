@@ -0,0 +1,189 @@
+/**
+ * Copyright 2013 Ezequiel Vázquez De la calle
+ *
+ * This file is part of Swarm.
+ *
+ * Swarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Swarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file Implementation of class Affinity methods
+ */
+
+#include "affinity.h"
+using namespace std;
+
+Affinity* Affinity::_instance = 0;
+const int Affinity::MAX_NODES;
+
+// Constructor: no role is pinned
+Affinity::Affinity(void) {
+  for (int i = 0; i < NUM_ROLES; i++) {
+    CPU_ZERO(&_cpus[i]);
+    _pinned[i] = false;
+    _numa[i] = false;
+  }
+}
+
+// Destructor: does nothing
+Affinity::~Affinity(void) {
+}
+
+// Parses a list of cpus
+bool Affinity::parseCpus(const string& text, cpu_set_t& cpus) {
+  CPU_ZERO(&cpus);
+  if (text.empty()) {
+    return true;
+  }
+
+  // Each item is a cpu, or a range of them
+  stringstream items(text);
+  string item;
+  while (getline(items, item, ',')) {
+    char* end;
+    long first = strtol(item.c_str(), &end, 10);
+    long last = first;
+    if (end == item.c_str()) {
+      return true;
+    }
+    if (*end == '-') {
+      const char* start = end + 1;
+      last = strtol(start, &end, 10);
+      if (end == start) {
+        return true;
+      }
+    }
+    if (*end != '\0' and *end != '\n') {
+      return true;
+    }
+    if (first < 0 or last < first or last >= CPU_SETSIZE) {
+      return true;
+    }
+
+    for (long cpu = first; cpu <= last; cpu++) {
+      CPU_SET(cpu, &cpus);
+    }
+  }
+
+  return false;
+}
+
+// Sets cpus of some role
+bool Affinity::setCpus(ThreadRole role, const string& text) {
+  _pinned[role] = not text.empty();
+  _numa[role] = (text == "numa");
+  if (not _pinned[role] or _numa[role]) {
+    CPU_ZERO(&_cpus[role]);
+    return false;
+  }
+
+  return parseCpus(text, _cpus[role]);
+}
+
+// Sets interface whose NUMA node is used by roles not bound to one
+void Affinity::setInterface(const string& iface) {
+  _iface = iface;
+}
+
+// Places calling thread on cpus of its role
+bool Affinity::pin(ThreadRole role, const string& iface) {
+  if (not _pinned[role]) {
+    return false;
+  }
+
+  // Use cpus of interface's node. Virtual interfaces and machines with a
+  // single node have no node, so their threads run anywhere
+  cpu_set_t cpus = _cpus[role];
+  int node;
+  if (_numa[role]) {
+    node = getNode(iface.empty() ? _iface : iface);
+    if (node < 0 or getNodeCpus(node, cpus)) {
+      return false;
+    }
+  }
+  else {
+    node = findNode(cpus);
+  }
+
+  int error = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+  if (error != 0) {
+    cerr << "ERROR - Can't set cpus of thread: " << strerror(error) << endl;
+    return true;
+  }
+
+  // Memory is preferably taken from thread's node, and from other nodes
+  // once it's full
+  if (node >= 0) {
+    const int bits = 8 * sizeof(unsigned long);
+    unsigned long nodes[MAX_NODES / bits] = {0};
+    nodes[node / bits] = 1UL << (node % bits);
+    if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, nodes, MAX_NODES + 1)
+        == -1)
+    {
+      cerr << "ERROR - Can't set memory node of thread: ";
+      cerr << strerror(errno) << endl;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// NUMA node of some interface, as told by sysfs
+int Affinity::getNode(const string& iface) const {
+  int node = -1;
+
+  ifstream file(("/sys/class/net/" + iface + "/device/numa_node").c_str());
+  if (not (file >> node) or node >= MAX_NODES) {
+    return -1;
+  }
+  return node;
+}
+
+// Cpus of some NUMA node, as told by sysfs
+bool Affinity::getNodeCpus(int node, cpu_set_t& cpus) const {
+  stringstream path;
+  path << "/sys/devices/system/node/node" << node << "/cpulist";
+
+  string text;
+  ifstream file(path.str().c_str());
+  if (not getline(file, text)) {
+    return true;
+  }
+  return parseCpus(text, cpus);
+}
+
+// Only NUMA node of some cpus
+int Affinity::findNode(const cpu_set_t& cpus) const {
+  int found = -1;
+
+  // Node numbers may have gaps, so all of them are tried
+  for (int node = 0; node < MAX_NODES; node++) {
+    cpu_set_t node_cpus;
+    if (getNodeCpus(node, node_cpus)) {
+      continue;
+    }
+
+    CPU_AND(&node_cpus, &node_cpus, &cpus);
+    if (CPU_COUNT(&node_cpus) > 0) {
+      if (found >= 0) {
+        return -1;
+      }
+      found = node;
+    }
+  }
+
+  return found;
+}
@@ -0,0 +1,149 @@
+/**
+ * Copyright 2013 Ezequiel Vázquez De la calle
+ *
+ * This file is part of Swarm.
+ *
+ * Swarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Swarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file Class Affinity definition. Singleton pattern implementation
+ */
+
+#ifndef _AFFINITY_H_
+#define _AFFINITY_H_
+
+  #include <cstdlib>
+  #include <cstring>
+  #include <fstream>
+  #include <iostream>
+  #include <linux/mempolicy.h>
+  #include <pthread.h>
+  #include <sched.h>
+  #include <sstream>
+  #include <string>
+  #include <sys/syscall.h>
+  #include <unistd.h>
+
+  using namespace std;
+
+  /**
+   * Roles of threads, each one placed on its own set of cpus
+   */
+  enum ThreadRole {
+    ROLE_CAPTURE,
+    ROLE_INJECTOR,
+    ROLE_PERSISTENCE,
+    ROLE_RESOLVER,
+    NUM_ROLES
+  };
+
+  /**
+   * Singleton object which places each thread on cpus set for its role.
+   * Cpus are given as a list like "0-3,8", or as "numa" to use cpus of NUMA
+   * node where network interface is attached. Roles without cpus run
+   * anywhere.
+   *
+   * Once a thread is pinned to cpus of a single node, its memory is taken
+   * from that node too, so ring buffers and tables built by each thread
+   * stay close to it.
+   */
+  class Affinity {
+    public:
+
+      // Highest number of NUMA nodes looked up
+      static const int MAX_NODES = 64;
+
+      /**
+       * Implementation of Singleton pattern
+       * @return Pointer to singleton affinity object
+       */
+      static Affinity* getInstance(void) {
+        if (_instance == 0) {
+          _instance = new Affinity();
+        }
+        return _instance;
+      }
+
+      /**
+       * Destroyer for singleton affinity object
+       */
+      static void destroy(void) {
+        delete _instance;
+      }
+
+      /**
+       * Parses a list of cpus
+       * @param text Comma separated cpus or ranges of cpus, i.e. "0-3,8"
+       * @param cpus Parsed set of cpus
+       * @return True if text is not a valid list, false either
+       */
+      static bool parseCpus(const string& text, cpu_set_t& cpus);
+
+      /**
+       * Sets cpus of some role. Must be called before threads start
+       * @param role Role of threads
+       * @param text List of cpus, "numa", or empty to run anywhere
+       * @return True if text is not valid, false either
+       */
+      bool setCpus(ThreadRole role, const string& text);
+
+      /**
+       * Sets interface whose NUMA node is used by roles not bound to an
+       * interface. Must be called before threads start
+       * @param iface Name of network interface
+       */
+      void setInterface(const string& iface);
+
+      /**
+       * Places calling thread on cpus of its role, and takes its memory
+       * from their NUMA node, if they are on a single one
+       * @param role Role of calling thread
+       * @param iface Network interface used by thread, if any
+       * @return True if thread could not be placed, false either
+       */
+      bool pin(ThreadRole role, const string& iface = "");
+
+    protected:
+      // Constructor, destructor, copy constructor and assing operator
+      // are protected due to singleton pattern implementation
+      Affinity(void);
+      ~Affinity(void);
+      Affinity(const Affinity& affinity);
+      Affinity& operator=(const Affinity& affinity);
+
+    private:
+      // Private function which returns NUMA node of some interface, or -1
+      // if unknown
+      int getNode(const string& iface) const;
+
+      // Private function which reads cpus of some NUMA node
+      bool getNodeCpus(int node, cpu_set_t& cpus) const;
+
+      // Private function which returns the only NUMA node of some cpus, or
+      // -1 if they are on several nodes
+      int findNode(const cpu_set_t& cpus) const;
+
+      // Attributes
+      cpu_set_t _cpus[NUM_ROLES];
+      bool _pinned[NUM_ROLES];
+      bool _numa[NUM_ROLES];
+      string _iface;
+      static Affinity* _instance;
+  };
+
+  #define affinity Affinity::getInstance()
+
+#endif
@@ -0,0 +1,747 @@
+/**
+ * Copyright 2013 Ezequiel Vázquez De la calle
+ *
+ * This file is part of Swarm.
+ *
+ * Swarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Swarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file Microbenchmarks of Swarm hot paths
+ */
+
+#include "config.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <getopt.h>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+#include <sys/resource.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "actions.h"
+#include "device.h"
+#include "flusher.h"
+#include "ipv4addr.h"
+#include "macaddr.h"
+#include "metrics.h"
+#include "monitor.h"
+#include "sniffer.h"
+#include "storage.h"
+#include "worker.h"
+
+using namespace std;
+
+/**
+ * Storage backend which discards everything, so benchmarks measure Swarm
+ * code and not the database
+ */
+class BenchStorage : public Storage {
+  public:
+    bool getLastId(int& id) {
+      id = 0;
+      return false;
+    }
+
+    bool load(Devices& devices) {
+      return false;
+    }
+
+    bool scan(DeviceReader& reader) {
+      return false;
+    }
+
+    bool read(int id, Device& device) {
+      return true;
+    }
+
+    bool write(const vector<Device>& devices, int fields) {
+      return false;
+    }
+};
+
+/**
+ * Monitor which can be created and destroyed, so each repetition starts
+ * from the same state
+ */
+class BenchMonitor : public Monitor {
+  public:
+    BenchMonitor(void) {}
+    ~BenchMonitor(void) {}
+};
+
+/**
+ * Benchmark of some hot path. Each operation is identified by its index,
+ * and operations are split among threads when benchmark is threaded
+ */
+struct Benchmark {
+  const char* name;
+  void (*setup)(void);
+  void (*run)(size_t first, size_t count);
+  size_t iterations;
+  bool threaded;
+};
+
+/**
+ * Settings read from command line
+ */
+struct Options {
+  string capture;
+  string filter;
+  string interface;
+  int repetitions;
+  int threads;
+  double scale;
+};
+
+// Fraction of iterations run as warm-up, before measuring
+static const size_t WARMUP = 10;
+
+// Devices loaded into monitor before checking or updating them
+static const size_t PRELOAD = 65536;
+
+// Results are stored here, so compiler does not remove benchmarked code
+static volatile size_t sink = 0;
+
+// Heap allocations made by each thread, counted by operator new
+static thread_local uint64_t allocations = 0;
+
+// Canned frames given to packet callback, those carrying ip only, and
+// sniffer which got them
+static vector<vector<u_char> > frames;
+static vector<vector<u_char> > ip_frames;
+static Sniffer* capturer = NULL;
+
+// Monitor used by monitor benchmarks, created by their setup
+static BenchMonitor* target = NULL;
+
+// Worker used to forge probes, or NULL if it could not be opened
+static Worker* forger = NULL;
+
+// Read all needed options from command line
+void readOptions(Options& options, int argc, char **argv);
+
+// Build canned frames: traffic between private devices, traffic to public
+// addresses, ARP replies and ICMP echo replies
+void buildFrames(void);
+
+// Replay a capture through packet callback, and print discovery rate and
+// memory used
+bool replay(const string& file);
+
+// Packet callback used by replay, which counts packets
+void replayPacket(u_char *args, const struct pcap_pkthdr *header,
+    const u_char *packet);
+
+// Measure a benchmark with some number of threads, and print its results
+void measure(const Benchmark& bench, const Options& options, int threads);
+
+// Run operations of a benchmark split among threads, returning nanoseconds
+// elapsed since all threads were ready, and heap allocations they made
+uint64_t runThreads(const Benchmark& bench, size_t iterations, int threads,
+    uint64_t& allocs);
+
+// Setup functions
+void setupEmpty(void);
+void setupPreloaded(void);
+
+// Benchmarked operations
+void benchIpPrivate(size_t first, size_t count);
+void benchIpFormat(size_t first, size_t count);
+void benchIpToString(size_t first, size_t count);
+void benchIpParse(size_t first, size_t count);
+void benchMacFormat(size_t first, size_t count);
+void benchMacToString(size_t first, size_t count);
+void benchGotPacket(size_t first, size_t count);
+void benchGotPacketIpAll(size_t first, size_t count);
+void benchGotPacketIp(size_t first, size_t count);
+void benchGotPacketIpBare(size_t first, size_t count);
+void benchMonitorAdd(size_t first, size_t count);
+void benchMonitorCheck(size_t first, size_t count);
+void benchMonitorUpdate(size_t first, size_t count);
+void benchDeviceSave(size_t first, size_t count);
+void benchProbeForge(size_t first, size_t count);
+
+// All benchmarks, in run order
+static const Benchmark benchmarks[] = {
+  {"ip private", NULL, benchIpPrivate, 10000000, false},
+  {"ip format", NULL, benchIpFormat, 2000000, false},
+  {"ip tostring", NULL, benchIpToString, 2000000, false},
+  {"ip parse", NULL, benchIpParse, 2000000, false},
+  {"mac format", NULL, benchMacFormat, 2000000, false},
+  {"mac tostring", NULL, benchMacToString, 2000000, false},
+  {"gotpacket", NULL, benchGotPacket, 1000000, false},
+  {"gotpacket ip all", NULL, benchGotPacketIpAll, 1000000, false},
+  {"gotpacket ip", NULL, benchGotPacketIp, 1000000, false},
+  {"gotpacket bare", NULL, benchGotPacketIpBare, 1000000, false},
+  {"monitor add", setupEmpty, benchMonitorAdd, 200000, true},
+  {"monitor check", setupPreloaded, benchMonitorCheck, 1000000, true},
+  {"monitor update", setupPreloaded, benchMonitorUpdate, 200000, true},
+  {"device save", NULL, benchDeviceSave, 1000000, false},
+  {"probe forge", NULL, benchProbeForge, 1000000, false}
+};
+
+/**
+ * Main program function
+ */
+int main(int argc, char **argv) {
+  Options options;
+  readOptions(options, argc, argv);
+
+  // Devices are written to a backend which discards them, spilling to a
+  // temporary file if flusher falls behind
+  char spill[] = "/tmp/swarm_bench.XXXXXX";
+  int fd = mkstemp(spill);
+  if (fd < 0) {
+    cerr << "ERROR - Can't create spill file" << endl;
+    exit(EXIT_FAILURE);
+  }
+  close(fd);
+  Storage::setInstance(new BenchStorage());
+  if (flusher->start(spill)) {
+    unlink(spill);
+    exit(EXIT_FAILURE);
+  }
+
+  // Probes are forged on a libnet context, but never injected. Opening it
+  // usually needs privileges, so its benchmark is skipped if not possible
+  forger = new Worker();
+  if (forger->open(options.interface, Ipv4Addr())) {
+    cerr << "Skipping probe forge benchmark" << endl;
+    delete forger;
+    forger = NULL;
+  }
+
+  // Frames are given to packet callback as captured by a sniffer which is
+  // not started, so it has no own ip address
+  capturer = new Sniffer();
+
+  // Replay a capture instead of running benchmarks, if requested
+  if (not options.capture.empty()) {
+    bool error = replay(options.capture);
+    unlink(spill);
+    exit(error ? EXIT_FAILURE : EXIT_SUCCESS);
+  }
+
+  buildFrames();
+
+  cout << left << setw(16) << "benchmark" << right << setw(8) << "threads";
+  cout << setw(12) << "ns/op" << setw(10) << "spread" << setw(14);
+  cout << "ops/sec" << setw(12) << "allocs/op" << endl;
+
+  for (size_t i = 0; i < sizeof(benchmarks) / sizeof(Benchmark); i++) {
+    const Benchmark& bench = benchmarks[i];
+    if (string(bench.name).find(options.filter) == string::npos) {
+      continue;
+    }
+    if (bench.run == benchProbeForge and forger == NULL) {
+      continue;
+    }
+
+    // Threaded benchmarks are measured with 1, 2, 4... threads
+    for (int threads = 1; threads <= options.threads; threads *= 2) {
+      measure(bench, options, threads);
+      if (not bench.threaded) {
+        break;
+      }
+    }
+  }
+
+  unlink(spill);
+  exit(EXIT_SUCCESS);
+}
+
+// Read all needed options from command line
+void readOptions(Options& options, int argc, char **argv) {
+  // Define all accepted options
+  const struct option long_options[] {
+    {"capture", required_argument, 0, 'c'},
+    {"filter", required_argument, 0, 'f'},
+    {"help", no_argument, 0, 'h'},
+    {"interface", required_argument, 0, 'i'},
+    {"repetitions", required_argument, 0, 'r'},
+    {"scale", required_argument, 0, 's'},
+    {"threads", required_argument, 0, 't'},
+    {0, 0, 0, 0}
+  };
+
+  // By default, all benchmarks run five times, with up to as many threads
+  // as cores
+  options.interface = "lo";
+  options.repetitions = 5;
+  options.threads = max(thread::hardware_concurrency(), 1U);
+  options.scale = 1.0;
+
+  // Parse all command line options
+  int c;
+  while ((c = getopt_long(argc, argv, "c:f:hi:r:s:t:", long_options, NULL))
+      != -1)
+  {
+    switch (c) {
+      case 'c':
+        options.capture = optarg;
+        break;
+
+      case 'f':
+        options.filter = optarg;
+        break;
+
+      case 'h':
+        cout << "Usage: " << argv[0] << " [options]" << endl;
+        cout << "Options:" << endl;
+        cout << "  -h, --help        Show this help and exit" << endl;
+        cout << endl << "Arguments:" << endl;
+        cout << "  -c <file>, --capture" << endl;
+        cout << "                    Replay <file> through packet callback";
+        cout << endl;
+        cout << "  -f <text>, --filter" << endl;
+        cout << "                    Run benchmarks named with <text> only";
+        cout << endl;
+        cout << "  -i <iface>, --interface" << endl;
+        cout << "                    Forge probes for <iface> (lo)" << endl;
+        cout << "  -r <n>, --repetitions" << endl;
+        cout << "                    Measure each benchmark <n> times (5)";
+        cout << endl;
+        cout << "  -s <x>, --scale   Multiply iterations by <x> (1.0)";
+        cout << endl;
+        cout << "  -t <n>, --threads Use up to <n> threads (cores)" << endl;
+        exit(EXIT_SUCCESS);
+
+      case 'i':
+        options.interface = optarg;
+        break;
+
+      case 'r':
+        options.repetitions = atoi(optarg);
+        if (options.repetitions <= 0) {
+          cerr << "Invalid number of repetitions" << endl;
+          exit(EXIT_FAILURE);
+        }
+        break;
+
+      case 's':
+        options.scale = atof(optarg);
+        if (options.scale <= 0) {
+          cerr << "Invalid scale of iterations" << endl;
+          exit(EXIT_FAILURE);
+        }
+        break;
+
+      case 't':
+        options.threads = atoi(optarg);
+        if (options.threads <= 0) {
+          cerr << "Invalid number of threads" << endl;
+          exit(EXIT_FAILURE);
+        }
+        break;
+
+      default:
+        cerr << "Usage: " << argv[0] << " [options]" << endl;
+        exit(EXIT_FAILURE);
+    }
+  }
+}
+
+// Replay a capture through packet callback
+bool replay(const string& file) {
+  char errbuf[PCAP_ERRBUF_SIZE];
+  struct rusage usage;
+
+  pcap_t* handler = pcap_open_offline(file.c_str(), errbuf);
+  if (handler == NULL) {
+    cerr << "ERROR - Can't open capture " << file << ": " << errbuf << endl;
+    return true;
+  }
+  if (pcap_datalink(handler) != DLT_EN10MB) {
+    cerr << "ERROR - Capture " << file << " is not Ethernet" << endl;
+    pcap_close(handler);
+    return true;
+  }
+
+  // Memory is measured as growth of resident size, so it's the one taken
+  // by found devices and their queued changes
+  getrusage(RUSAGE_SELF, &usage);
+  long memory = usage.ru_maxrss;
+
+  size_t packets = 0;
+  uint64_t allocs = allocations;
+  uint64_t start = Metrics::now();
+  int result = pcap_loop(handler, -1, replayPacket, (u_char*)&packets);
+  double elapsed = (Metrics::now() - start) / 1e9;
+  allocs = allocations - allocs;
+  if (result == -1) {
+    cerr << "ERROR - Can't read capture " << file << ": ";
+    cerr << pcap_geterr(handler) << endl;
+  }
+  pcap_close(handler);
+
+  getrusage(RUSAGE_SELF, &usage);
+  memory = usage.ru_maxrss - memory;
+  int devices = monitor->count();
+
+  cout << fixed << setprecision(0);
+  cout << "packets       " << setw(14) << packets << endl;
+  cout << "devices       " << setw(14) << devices << endl;
+  cout << "seconds       " << setw(14) << setprecision(3) << elapsed << endl;
+  cout << setprecision(0);
+  cout << "packets/sec   " << setw(14) << packets / elapsed << endl;
+  cout << "devices/sec   " << setw(14) << devices / elapsed << endl;
+  cout << "memory kB     " << setw(14) << memory << endl;
+  cout << "bytes/device  " << setw(14);
+  cout << (devices > 0 ? 1024.0 * memory / devices : 0) << endl;
+  cout << "allocs/packet " << setw(14) << setprecision(3);
+  cout << (packets > 0 ? (double)allocs / packets : 0) << endl;
+
+  return result == -1;
+}
+
+// Packet callback used by replay
+void replayPacket(u_char *args, const struct pcap_pkthdr *header,
+    const u_char *packet)
+{
+  ++*(size_t*)args;
+  getPacketHandler(PROTOCOL_ALL)((u_char*)capturer, header, packet);
+}
+
+// Build canned frames
+void buildFrames(void) {
+  for (int host = 0; host < 256; host++) {
+    vector<u_char> frame(sizeof(struct ethhdr) + sizeof(struct iphdr) +
+        sizeof(struct icmphdr), 0);
+    struct ethhdr* eth = (struct ethhdr*)&frame[0];
+    struct iphdr* iph = (struct iphdr*)&frame[sizeof(struct ethhdr)];
+
+    // Each kind of frame every four frames
+    switch (host % 4) {
+      // ARP reply of a device, which sets its mac address
+      case 0: {
+        frame.resize(sizeof(struct ethhdr) + sizeof(struct ether_arp));
+        eth = (struct ethhdr*)&frame[0];
+        eth->h_proto = htons(ETHERTYPE_ARP);
+        struct ether_arp* arp = (struct ether_arp*)&frame[sizeof(*eth)];
+        arp->ea_hdr.ar_op = htons(ARPOP_REPLY);
+        uint8_t mac[6] = {0x02, 0, 0, 0, 0x02, (uint8_t)host};
+        memcpy(arp->arp_sha, mac, sizeof(mac));
+        uint8_t ip[4] = {192, 168, 2, (uint8_t)host};
+        memcpy(arp->arp_spa, ip, sizeof(ip));
+        break;
+      }
+
+      // Traffic between two private devices
+      case 1:
+        eth->h_proto = htons(ETHERTYPE_IP);
+        iph->protocol = IPPROTO_TCP;
+        iph->saddr = Ipv4Addr(192, 168, 1, host).toNetwork();
+        iph->daddr = Ipv4Addr(192, 168, 1, host + 1).toNetwork();
+        break;
+
+      // Traffic from a private device to a public one
+      case 2:
+        eth->h_proto = htons(ETHERTYPE_IP);
+        iph->protocol = IPPROTO_TCP;
+        iph->saddr = Ipv4Addr(192, 168, 1, host).toNetwork();
+        iph->daddr = Ipv4Addr(8, 8, 8, 8).toNetwork();
+        break;
+
+      // Echo reply to own address, which is empty as sniffer is not
+      // started
+      case 3: {
+        eth->h_proto = htons(ETHERTYPE_IP);
+        iph->ihl = 5;
+        iph->protocol = IPPROTO_ICMP;
+        iph->saddr = Ipv4Addr(192, 168, 1, host).toNetwork();
+        struct icmphdr* icmp = (struct icmphdr*)(iph + 1);
+        icmp->type = ICMP_ECHOREPLY;
+        break;
+      }
+    }
+    frames.push_back(frame);
+    if (eth->h_proto == htons(ETHERTYPE_IP)) {
+      ip_frames.push_back(frame);
+    }
+  }
+}
+
+// Measure a benchmark, and print median of repetitions
+void measure(const Benchmark& bench, const Options& options, int threads) {
+  size_t iterations = max((size_t)(bench.iterations * options.scale),
+      (size_t)threads);
+  vector<double> results;
+  uint64_t allocs = 0;
+
+  // Warm up caches, allocator and branch predictors
+  if (bench.setup != NULL) {
+    bench.setup();
+  }
+  runThreads(bench, max(iterations / WARMUP, (size_t)threads), threads,
+      allocs);
+
+  // Measure each repetition from the same state. Allocations of last one
+  // are reported, as pools are warm by then
+  for (int i = 0; i < options.repetitions; i++) {
+    if (bench.setup != NULL) {
+      bench.setup();
+    }
+    uint64_t elapsed = runThreads(bench, iterations, threads, allocs);
+    results.push_back((double)elapsed / iterations);
+  }
+
+  // Median is reported, as it's not moved by a single noisy repetition.
+  // Spread between fastest and slowest repetitions tells how stable it is
+  sort(results.begin(), results.end());
+  double median = results[results.size() / 2];
+  double spread = 100.0 * (results.back() - results.front()) / median;
+
+  cout << left << setw(16) << bench.name << right << setw(8) << threads;
+  cout << fixed << setprecision(1) << setw(12) << median;
+  cout << setw(9) << spread << "%";
+  cout << setprecision(0) << setw(14) << 1e9 / median;
+  cout << setprecision(2) << setw(12) << (double)allocs / iterations << endl;
+}
+
+// Run operations of a benchmark split among threads
+uint64_t runThreads(const Benchmark& bench, size_t iterations, int threads,
+    uint64_t& allocs)
+{
+  atomic<int> ready(0);
+  atomic<bool> go(false);
+  atomic<uint64_t> total(0);
+  vector<thread> pool;
+
+  // Each thread runs its own range of operations, once all are ready
+  size_t chunk = iterations / threads;
+  for (int i = 0; i < threads; i++) {
+    size_t first = i * chunk;
+    size_t count = (i == threads - 1) ? iterations - first : chunk;
+    pool.push_back(thread([&bench, &ready, &go, &total, first, count]() {
+      ++ready;
+      while (not go) {
+        this_thread::yield();
+      }
+      uint64_t before = allocations;
+      bench.run(first, count);
+      total += allocations - before;
+    }));
+  }
+
+  while (ready < threads) {
+    this_thread::yield();
+  }
+  uint64_t start = Metrics::now();
+  go = true;
+  for (size_t i = 0; i < pool.size(); i++) {
+    pool[i].join();
+  }
+  uint64_t elapsed = Metrics::now() - start;
+  allocs = total;
+  return elapsed;
+}
+
+// Creates an empty monitor
+void setupEmpty(void) {
+  delete target;
+  target = new BenchMonitor();
+}
+
+// Creates a monitor with some devices
+void setupPreloaded(void) {
+  setupEmpty();
+  for (size_t i = 0; i < PRELOAD; i++) {
+    Device dev(Ipv4Addr::fromHost(Ipv4Addr(10, 0, 0, 0).toHost() + i));
+    target->addDevice(dev);
+  }
+}
+
+// Check if some address is private
+void benchIpPrivate(size_t first, size_t count) {
+  size_t found = 0;
+  for (size_t i = first; i < first + count; i++) {
+    found += Ipv4Addr::fromHost(i * 2654435761U).isPrivate();
+  }
+  sink += found;
+}
+
+// Format an ip address on a buffer
+void benchIpFormat(size_t first, size_t count) {
+  char buf[16];
+  size_t len = 0;
+  for (size_t i = first; i < first + count; i++) {
+    len += Ipv4Addr::fromHost(i * 2654435761U).format(buf);
+  }
+  sink += len;
+}
+
+// Format an ip address as string
+void benchIpToString(size_t first, size_t count) {
+  size_t len = 0;
+  for (size_t i = first; i < first + count; i++) {
+    len += Ipv4Addr::fromHost(i * 2654435761U).toString().size();
+  }
+  sink += len;
+}
+
+// Parse an ip address from text
+void benchIpParse(size_t first, size_t count) {
+  char text[256][16];
+  for (int i = 0; i < 256; i++) {
+    Ipv4Addr(192, 168, i, 255 - i).format(text[i]);
+  }
+
+  Ipv4Addr ip;
+  size_t sum = 0;
+  for (size_t i = first; i < first + count; i++) {
+    Ipv4Addr::parse(text[i % 256], ip);
+    sum += ip.toHost();
+  }
+  sink += sum;
+}
+
+// Format a mac address on a buffer
+void benchMacFormat(size_t first, size_t count) {
+  char buf[18];
+  uint8_t octets[6] = {0x02, 0x00, 0x5e, 0x10, 0x00, 0x00};
+  size_t len = 0;
+  for (size_t i = first; i < first + count; i++) {
+    octets[5] = i;
+    len += MacAddr(octets).format(buf);
+  }
+  sink += len;
+}
+
+// Format a mac address as string
+void benchMacToString(size_t first, size_t count) {
+  uint8_t octets[6] = {0x02, 0x00, 0x5e, 0x10, 0x00, 0x00};
+  size_t len = 0;
+  for (size_t i = first; i < first + count; i++) {
+    octets[5] = i;
+    len += MacAddr(octets).toString().size();
+  }
+  sink += len;
+}
+
+// Process canned frames, as captured by libpcap, using callback of some
+// set of protocols
+static void runPackets(const vector<vector<u_char> >& list, int protocols,
+    size_t first, size_t count)
+{
+  struct pcap_pkthdr header;
+  memset(&header, 0, sizeof(header));
+  pcap_handler callback = getPacketHandler(protocols);
+
+  for (size_t i = first; i < first + count; i++) {
+    const vector<u_char>& frame = list[i % list.size()];
+    header.caplen = header.len = frame.size();
+    callback((u_char*)capturer, &header, &frame[0]);
+  }
+}
+
+// Process a canned frame of any kind, with all protocols enabled
+void benchGotPacket(size_t first, size_t count) {
+  runPackets(frames, PROTOCOL_ALL, first, count);
+}
+
+// Process an ip frame, with all protocols enabled
+void benchGotPacketIpAll(size_t first, size_t count) {
+  runPackets(ip_frames, PROTOCOL_ALL, first, count);
+}
+
+// Process an ip frame, with protocols enabled by default
+void benchGotPacketIp(size_t first, size_t count) {
+  runPackets(ip_frames, PROTOCOL_ICMP | PROTOCOL_VLAN, first, count);
+}
+
+// Process an ip frame, with no protocol but ip enabled
+void benchGotPacketIpBare(size_t first, size_t count) {
+  runPackets(ip_frames, 0, first, count);
+}
+
+// Add a new device to monitor
+void benchMonitorAdd(size_t first, size_t count) {
+  uint32_t base = Ipv4Addr(10, 0, 0, 0).toHost();
+  for (size_t i = first; i < first + count; i++) {
+    Device dev(Ipv4Addr::fromHost(base + i));
+    target->addDevice(dev);
+  }
+}
+
+// Check if a device is on monitor
+void benchMonitorCheck(size_t first, size_t count) {
+  uint32_t base = Ipv4Addr(10, 0, 0, 0).toHost();
+  size_t found = 0;
+  for (size_t i = first; i < first + count; i++) {
+    found += target->checkDevice(Ipv4Addr::fromHost(base + i % PRELOAD));
+  }
+  sink += found;
+}
+
+// Update reachability of a device on monitor
+void benchMonitorUpdate(size_t first, size_t count) {
+  uint32_t base = Ipv4Addr(10, 0, 0, 0).toHost();
+  for (size_t i = first; i < first + count; i++) {
+    Ipv4Addr ip = Ipv4Addr::fromHost(base + i % PRELOAD);
+    Device dev = target->getDevice(ip);
+    dev.setReachable((i / PRELOAD) % 2);
+    target->updateDevice(ip, dev);
+  }
+}
+
+// Save a device to storage
+void benchDeviceSave(size_t first, size_t count) {
+  Device dev(Ipv4Addr(192, 168, 1, 1));
+  dev.setId(1);
+  dev.setMac(MacAddr(string("02:00:5e:10:00:01")));
+  dev.setHostname("host.example.com");
+  dev.setDescription("Linux host 3.2.0 x86_64");
+
+  for (size_t i = first; i < first + count; i++) {
+    dev.setHops(i % 30);
+    dev.save();
+  }
+}
+
+// Forge a probe frame, without injecting it
+void benchProbeForge(size_t first, size_t count) {
+  Probe probe;
+  probe.mac = MacAddr(string("02:00:5e:10:00:01"));
+
+  for (size_t i = first; i < first + count; i++) {
+    probe.type = (i % 2) ? PROBE_ICMP_ECHO : PROBE_ARP_REQUEST;
+    probe.ip = Ipv4Addr(192, 168, 1, i);
+    forger->forge(probe);
+  }
+}
+
+// Replaced heap allocation, which counts allocations of calling thread
+void* operator new(size_t size) {
+  ++allocations;
+  void* block = malloc(size > 0 ? size : 1);
+  if (block == NULL) {
+    throw bad_alloc();
+  }
+  return block;
+}
+
+// Replaced heap release, matching replaced allocation
+void operator delete(void* block) noexcept {
+  free(block);
+}
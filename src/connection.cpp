@@ -0,0 +1,219 @@
+/**
+ * Copyright 2013 Ezequiel Vázquez De la calle
+ *
+ * This file is part of Swarm.
+ *
+ * Swarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Swarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file Implementation of Connection class methods
+ */
+
+#include "connection.h"
+using namespace std;
+
+const int Connection::IDLE;
+
+// Constructor: does nothing
+Connection::Connection(void) {
+  _con = 0;
+}
+
+// Destructor: close statements and connection, if any
+Connection::~Connection(void) {
+  close();
+}
+
+// Connect to database server
+bool Connection::connect(const string& host, const string& user,
+    const string& pass, const string& database)
+{
+  _host = host;
+  _user = user;
+  _pass = pass;
+  _database = database;
+
+  // Init MySQL library
+  MYSQL *con = mysql_init(NULL);
+
+  // Check library initialization
+  if (con == NULL) {
+    cerr << "ERROR - Can't connect to MySQL server" << endl;
+    return true;
+  }
+
+  // Connect to database, using received parameters
+  if (mysql_real_connect(con, host.c_str(), user.c_str(), pass.c_str(),
+      database.c_str(), 0, NULL, 0) == NULL)
+  {
+    cerr << "ERROR - " << mysql_error(con) << endl;
+    mysql_close(con);
+    return true;
+  }
+
+  _con = con;
+  _last_used = chrono::steady_clock::now();
+  return false;
+}
+
+// Check connection is alive, connecting again if needed
+bool Connection::check(void) {
+  chrono::steady_clock::time_point now = chrono::steady_clock::now();
+
+  if (_con != 0 and now - _last_used < chrono::seconds(IDLE)) {
+    return false;
+  }
+
+  if (_con != 0 and not mysql_ping(_con)) {
+    _last_used = now;
+    return false;
+  }
+
+  return reconnect();
+}
+
+// Performs a query to database
+bool Connection::query(const string& sql, Result& result) {
+  // Clean resultset
+  result.clear();
+
+  // Execute query. If server has gone away, try once again
+  if (mysql_query(_con, sql.c_str())) {
+    unsigned int error = mysql_errno(_con);
+    if ((error != CR_SERVER_GONE_ERROR and error != CR_SERVER_LOST) or
+        reconnect() or mysql_query(_con, sql.c_str()))
+    {
+      cerr << "ERROR - Can not execute query" << endl;
+      cerr << (_con != 0 ? mysql_error(_con) : "Not connected") << endl;
+      return true;
+    }
+  }
+  _last_used = chrono::steady_clock::now();
+
+  // Extract result after query execution
+  MYSQL_RES *res = mysql_store_result(_con);
+
+  // If query did not return any result, no need to process resultset
+  if (res == NULL) {
+    return false;
+  }
+
+  // Extract field info from resultset
+  MYSQL_FIELD* fields = mysql_fetch_fields(res);
+  int num_fields = mysql_num_fields(res);
+  MYSQL_ROW row;
+
+  // Process resultset and store each row on vector
+  while ((row = mysql_fetch_row(res))) {
+    map<string, string> result_row;
+    for (int i = 0; i < num_fields; i++) {
+      result_row.insert(pair<string, string>(fields[i].name, row[i]));
+    }
+    result.push_back(result_row);
+  }
+
+  // After processing result, free memory allocated
+  mysql_free_result(res);
+  return false;
+}
+
+// Executes a query, streaming its resultset through a cursor
+bool Connection::open(const string& sql, Cursor& cursor) {
+  // If server has gone away, try once again
+  if (cursor.open(_con, sql)) {
+    unsigned int error = mysql_errno(_con);
+    if ((error != CR_SERVER_GONE_ERROR and error != CR_SERVER_LOST) or
+        reconnect() or cursor.open(_con, sql))
+    {
+      cerr << "ERROR - Can not execute query" << endl;
+      cerr << (_con != 0 ? mysql_error(_con) : "Not connected") << endl;
+      return true;
+    }
+  }
+  _last_used = chrono::steady_clock::now();
+
+  return false;
+}
+
+// Returns a prepared statement, preparing it on first use
+Statement* Connection::prepare(const string& sql) {
+  map<string,Statement*>::iterator it = _statements.find(sql);
+  if (it != _statements.end()) {
+    _last_used = chrono::steady_clock::now();
+    return it->second;
+  }
+
+  Statement* stmt = new Statement(_con);
+  if (stmt->prepare(sql)) {
+    delete stmt;
+    return NULL;
+  }
+
+  _statements[sql] = stmt;
+  _last_used = chrono::steady_clock::now();
+  return stmt;
+}
+
+// Starts a transaction. Nothing was done yet, so it can be retried
+bool Connection::begin(void) {
+  Result result;
+  return query("START TRANSACTION", result);
+}
+
+// Commits current transaction
+bool Connection::commit(void) {
+  if (_con == 0 or mysql_commit(_con)) {
+    cerr << "ERROR - Can not commit transaction" << endl;
+    cerr << (_con != 0 ? mysql_error(_con) : "Not connected") << endl;
+    return true;
+  }
+  _last_used = chrono::steady_clock::now();
+  return false;
+}
+
+// Rolls back current transaction
+bool Connection::rollback(void) {
+  if (_con == 0 or mysql_rollback(_con)) {
+    cerr << "ERROR - Can not roll back transaction" << endl;
+    cerr << (_con != 0 ? mysql_error(_con) : "Not connected") << endl;
+    return true;
+  }
+  return false;
+}
+
+// Close statements and connection
+void Connection::close(void) {
+  map<string,Statement*>::iterator it;
+  for (it = _statements.begin(); it != _statements.end(); ++it) {
+    delete it->second;
+  }
+  _statements.clear();
+
+  if (_con != 0) {
+    mysql_close(_con);
+    _con = 0;
+  }
+}
+
+// Close connection and open it again. Statements belong to old connection,
+// so they are prepared again on next use
+bool Connection::reconnect(void) {
+  close();
+  if (connect(_host, _user, _pass, _database)) {
+    cerr << "ERROR - Can not reconnect to database" << endl;
+    return true;
+  }
+  return false;
+}
@@ -0,0 +1,151 @@
+/**
+ * Copyright 2013 Ezequiel Vázquez De la calle
+ *
+ * This file is part of Swarm.
+ *
+ * Swarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Swarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file Class Connection definition (mysql support only)
+ */
+
+#ifndef _CONNECTION_H_
+#define _CONNECTION_H_
+
+  #include <chrono>
+  #include <iostream>
+  #include <map>
+  #include <mysql/errmsg.h>
+  #include <mysql/mysql.h>
+  #include <string>
+  #include <vector>
+
+  #include "cursor.h"
+  #include "statement.h"
+  using namespace std;
+
+  // Define row and resultset types
+  typedef map<string,string> Row;
+  typedef vector<Row> Result;
+
+  /**
+   * Single database connection, and statements prepared on it. A
+   * connection must be used by only one thread at a time
+   */
+  class Connection {
+    public:
+
+      // Seconds a connection may stay idle before checking it is alive
+      static const int IDLE = 10;
+
+      /**
+       * Constructor
+       */
+      Connection(void);
+
+      /**
+       * Destructor, closes statements and connection
+       */
+      ~Connection(void);
+
+      /**
+       * Creates database connection using parameters
+       * @param host Network address of database server
+       * @param user Name of user to connect to db server
+       * @param pass Password of database user
+       * @param database Name of database to use
+       * @return True if connection was not successful, false either
+       */
+      bool connect(const string& host, const string& user,
+          const string& pass, const string& database);
+
+      /**
+       * Checks connection is still alive if it has been idle for a while,
+       * and connects again if it is not
+       * @return True if connection is not usable, false either
+       */
+      bool check(void);
+
+      /**
+       * Executes a query onto the database and returns the result as a vector.
+       * If server has gone away, connects again and retries once
+       * @param sql SQL sentence to execute
+       * @param result Vector of assciative maps, each one storing a result row
+       * @return True if query was not executed, false either
+       */
+      bool query(const string& sql, Result& result);
+
+      /**
+       * Executes a query, streaming its resultset through a cursor. Nothing
+       * else may be executed on this connection until cursor is closed
+       * @param sql SQL sentence to execute
+       * @param cursor Cursor where rows will be read from
+       * @return True if query was not executed, false either
+       */
+      bool open(const string& sql, Cursor& cursor);
+
+      /**
+       * Returns a prepared statement for some SQL sentence. Each sentence is
+       * prepared only once, and the same statement is returned on next calls
+       * @param sql SQL sentence, using ? as parameter placeholders
+       * @return Pointer to prepared statement, or NULL if it can't be prepared
+       */
+      Statement* prepare(const string& sql);
+
+      /**
+       * Starts a transaction, so next sentences are applied all together
+       * or not at all
+       * @return True if transaction could not be started, false either
+       */
+      bool begin(void);
+
+      /**
+       * Commits current transaction. It is never retried, as a lost
+       * connection has already discarded the transaction
+       * @return True if transaction was not committed, false either
+       */
+      bool commit(void);
+
+      /**
+       * Rolls back current transaction
+       * @return True if transaction could not be rolled back, false either
+       */
+      bool rollback(void);
+
+    private:
+      // Copy constructor and assign operator are private, as connection
+      // handler can not be shared
+      Connection(const Connection& connection);
+      Connection& operator=(const Connection& connection);
+
+      // Private function which closes statements and connection
+      void close(void);
+
+      // Private function which closes connection, and opens it again
+      bool reconnect(void);
+
+      // Attributes
+      MYSQL* _con;
+      string _host;
+      string _user;
+      string _pass;
+      string _database;
+      chrono::steady_clock::time_point _last_used;
+
+      // Statements already prepared, by SQL sentence
+      map<string,Statement*> _statements;
+  };
+
+#endif
@@ -0,0 +1,197 @@
+/**
+ * Copyright 2013 Ezequiel Vázquez De la calle
+ *
+ * This file is part of Swarm.
+ *
+ * Swarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Swarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file Class Conversations method definition
+ */
+
+#include "conversations.h"
+#include "actions.h"
+#include "monitor.h"
+#include "storage.h"
+using namespace std;
+
+Conversations* Conversations::_instance = 0;
+const int Conversations::INTERVAL;
+const int Conversations::RETENTION;
+const int Conversations::EXPIRE_INTERVAL;
+const size_t Conversations::STAGE_SIZE;
+const size_t Conversations::TABLE_SIZE;
+const size_t Conversations::MAX_FAILED;
+
+// Constructor
+Conversations::Conversations(void) : _table(TABLE_SIZE) {
+  _started = false;
+  _interval = INTERVAL;
+  _retention = RETENTION;
+  _last_expire = 0;
+  _used = 0;
+}
+
+// Destructor: free staging tables
+Conversations::~Conversations(void) {
+  for (size_t i = 0; i < _stages.size(); ++i) {
+    delete _stages[i];
+  }
+}
+
+// Set interval and retention, and launch as thread
+void Conversations::start(int interval, int retention) {
+  _mutex.lock();
+  _interval = max(interval, 1);
+  _retention = max(retention, 0);
+  _mutex.unlock();
+  _started = true;
+
+  // Launch thread
+  thread t1(keepConversations);
+  t1.detach();
+}
+
+// Wait until current interval ends, and write its conversations
+void Conversations::flush(void) {
+  // Wake up just after interval ends, so it is complete
+  time_t now = time(NULL);
+  this_thread::sleep_for(chrono::seconds(_interval - now % _interval));
+
+  // Counters still staged are merged first, as threads which captured
+  // nothing since last second would keep them until their next packet
+  _mutex.lock();
+  vector<Stage*> stages = _stages;
+  _mutex.unlock();
+
+  for (size_t i = 0; i < stages.size(); ++i) {
+    lock_guard<mutex> lock(stages[i]->lock);
+    merge(*stages[i], stages[i]->merged);
+  }
+
+  // Take shared table, leaving an empty one of the same size. It's built
+  // before taking lock, so capture threads do not wait for it
+  _mutex.lock();
+  size_t size = _table.size();
+  _mutex.unlock();
+
+  vector<Slot> table(size);
+  _mutex.lock();
+  now = time(NULL);
+  _table.swap(table);
+  _used = 0;
+  _mutex.unlock();
+
+  // Counters belong to interval which just ended. Pairs are written by
+  // their device ids, and those not stored as devices are discarded.
+  // Conversations which could not be written before go first, keeping
+  // their bucket
+  time_t bucket = now - now % _interval - _interval;
+  vector<Conversation> batch;
+  batch.swap(_failed);
+  for (size_t i = 0; i < table.size(); ++i) {
+    if (table[i].src == 0) {
+      continue;
+    }
+
+    try {
+      Conversation conversation = {bucket,
+          monitor->getDevice(Ipv4Addr::fromHost(table[i].src)).getId(),
+          monitor->getDevice(Ipv4Addr::fromHost(table[i].dst)).getId(),
+          table[i].packets, table[i].bytes};
+      batch.push_back(conversation);
+    }
+    catch (exception) {
+      continue;
+    }
+  }
+
+  // Conversations which could not be written are kept for next flush, but
+  // memory must not grow while storage keeps failing
+  if (not batch.empty() and storage->writeConversations(batch)) {
+    cerr << "ERROR - Can not write " << batch.size() << " conversations";
+    cerr << endl;
+    if (batch.size() > MAX_FAILED) {
+      cerr << "ERROR - Dropping " << batch.size() - MAX_FAILED;
+      cerr << " conversations" << endl;
+      batch.erase(batch.begin(), batch.end() - MAX_FAILED);
+    }
+    _failed.swap(batch);
+  }
+
+  // Remove expired conversations from time to time
+  if (_retention > 0 and now - _last_expire >= EXPIRE_INTERVAL) {
+    if (storage->expireConversations(now - _retention * 86400)) {
+      cerr << "ERROR - Can not remove expired conversations" << endl;
+    }
+    _last_expire = now;
+  }
+}
+
+// Returns number of pairs on shared table
+size_t Conversations::count(void) {
+  lock_guard<mutex> lock(_mutex);
+  return _used;
+}
+
+// Adds a staging table for a new thread
+Conversations::Stage* Conversations::addStage(void) {
+  Stage* stage = new Stage();
+
+  _mutex.lock();
+  _stages.push_back(stage);
+  _mutex.unlock();
+
+  return stage;
+}
+
+// Adds a staging table to shared table, and empties it
+void Conversations::merge(Stage& stage, time_t now) {
+  stage.merged = now;
+  if (stage.used == 0) {
+    return;
+  }
+
+  _mutex.lock();
+  for (size_t i = 0; i < STAGE_SIZE; ++i) {
+    Slot& slot = stage.slots[i];
+    if (slot.src == 0) {
+      continue;
+    }
+
+    if (add(&_table[0], _table.size() - 1, slot.src, slot.dst, slot.packets,
+        slot.bytes) and ++_used >= _table.size() / 2)
+    {
+      grow();
+    }
+    slot = Slot();
+  }
+  _mutex.unlock();
+
+  stage.used = 0;
+}
+
+// Doubles slots of shared table, placing pairs again
+void Conversations::grow(void) {
+  vector<Slot> table(_table.size() * 2);
+  for (size_t i = 0; i < _table.size(); ++i) {
+    if (_table[i].src != 0) {
+      add(&table[0], table.size() - 1, _table[i].src, _table[i].dst,
+          _table[i].packets, _table[i].bytes);
+    }
+  }
+  _table.swap(table);
+}
@@ -0,0 +1,240 @@
+/**
+ * Copyright 2013 Ezequiel Vázquez De la calle
+ *
+ * This file is part of Swarm.
+ *
+ * Swarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Swarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file Class Conversations definition
+ */
+
+#ifndef _CONVERSATIONS_H_
+#define _CONVERSATIONS_H_
+
+  #include <atomic>
+  #include <chrono>
+  #include <cstdint>
+  #include <ctime>
+  #include <iostream>
+  #include <mutex>
+  #include <thread>
+  #include <vector>
+
+  #include "ipv4addr.h"
+  using namespace std;
+
+  // Traffic from a device to another during a time bucket
+  struct Conversation {
+    time_t bucket;
+    int src;
+    int dst;
+    uint64_t packets;
+    uint64_t bytes;
+  };
+
+  /**
+   * Singleton object which counts packets and bytes sent from each device
+   * to each other one, building a graph of who talks to whom. Counters are
+   * kept on open addressing tables, where each slot is a pair of addresses
+   * and its counters, without allocations per packet.
+   *
+   * Each capture thread adds to its own small staging table, whose lock
+   * is only contended while it's drained, and merges it into shared table
+   * once each second of capture, or when it's half full. At the end of
+   * each interval, all staging tables are drained, so quiet threads keep
+   * nothing back, and shared table is appended to storage as a single
+   * batch, and emptied.
+   */
+  class Conversations {
+    public:
+
+      // Default seconds between two writes to storage
+      static const int INTERVAL = 60;
+
+      // Default days conversations are kept. Zero keeps them forever
+      static const int RETENTION = 30;
+
+      // Slots of each staging table, a power of two
+      static const size_t STAGE_SIZE = 1024;
+
+      // Seconds between two removals of expired conversations
+      static const int EXPIRE_INTERVAL = 3600;
+
+      // Initial slots of shared table, a power of two. It doubles when
+      // half full
+      static const size_t TABLE_SIZE = 4096;
+
+      // Conversations kept in memory while they can not be written. Oldest
+      // ones are dropped beyond it
+      static const size_t MAX_FAILED = 262144;
+
+      /**
+       * Implementation of Singleton pattern
+       * @return Pointer to singleton conversations object
+       */
+      static Conversations* getInstance(void) {
+        if (_instance == 0) {
+          _instance = new Conversations();
+        }
+        return _instance;
+      }
+
+      /**
+       * Destroyer for singleton conversations object
+       */
+      static void destroy(void) {
+        delete _instance;
+      }
+
+      /**
+       * Initialize conversations object, and launch as thread. Packets are
+       * not counted until started
+       * @param interval Seconds between two writes to storage
+       * @param retention Days conversations are kept, or zero to keep them
+       */
+      void start(int interval = INTERVAL, int retention = RETENTION);
+
+      /**
+       * Counts a packet sent between two devices, on staging table of
+       * calling thread
+       * @param src Source ip address of packet
+       * @param dst Destination ip address of packet
+       * @param bytes Length of packet
+       * @param now Timestamp of packet, in seconds
+       */
+      void record(const Ipv4Addr& src, const Ipv4Addr& dst, uint32_t bytes,
+          time_t now) {
+        if (not _started.load(memory_order_relaxed)) {
+          return;
+        }
+
+        Stage& stage = getStage();
+        lock_guard<mutex> lock(stage.lock);
+        if (now != stage.merged or stage.used >= STAGE_SIZE / 2) {
+          merge(stage, now);
+        }
+        if (add(stage.slots, STAGE_SIZE - 1, src.toHost(), dst.toHost(), 1,
+            bytes))
+        {
+          ++stage.used;
+        }
+      }
+
+      /**
+       * Wait until current interval ends, and write its conversations.
+       * Remove expired ones from time to time
+       */
+      void flush(void);
+
+      /**
+       * Returns number of pairs of devices counted, not written yet
+       * @return Number of pairs on shared table
+       */
+      size_t count(void);
+
+    protected:
+      // Constructor, destructor, copy constructor and assing operator
+      // are protected due to singleton pattern implementation
+      Conversations(void);
+      ~Conversations(void);
+      Conversations(const Conversations& conversations);
+      Conversations& operator=(const Conversations& conversations);
+
+    private:
+      // Counters of a pair of addresses. Empty slots have no source
+      struct Slot {
+        uint32_t src;
+        uint32_t dst;
+        uint64_t packets;
+        uint64_t bytes;
+      };
+
+      // Staging table of a capture thread, and when it was last merged.
+      // Owner thread holds its lock while counting, and conversations
+      // thread while draining it
+      struct Stage {
+        Slot slots[STAGE_SIZE];
+        size_t used;
+        time_t merged;
+        mutex lock;
+      };
+
+      // Private function which returns staging table of calling thread,
+      // adding a new one on first use
+      Stage& getStage(void) {
+        static thread_local Stage* stage = 0;
+        if (stage == 0) {
+          stage = addStage();
+        }
+        return *stage;
+      }
+
+      // Private function which adds a staging table for a new thread
+      Stage* addStage(void);
+
+      // Private function which adds to counters of a pair, using linear
+      // probing. Table must have some empty slot. Returns true if pair took
+      // a new slot
+      static bool add(Slot* slots, size_t mask, uint32_t src, uint32_t dst,
+          uint64_t packets, uint64_t bytes) {
+        uint64_t key = ((uint64_t)src << 32) | dst;
+        size_t i = ((key * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+        while (slots[i].src != 0 and
+            (slots[i].src != src or slots[i].dst != dst))
+        {
+          i = (i + 1) & mask;
+        }
+
+        bool added = (slots[i].src == 0);
+        slots[i].src = src;
+        slots[i].dst = dst;
+        slots[i].packets += packets;
+        slots[i].bytes += bytes;
+        return added;
+      }
+
+      // Private function which adds a staging table to shared table, and
+      // empties it. Lock of staging table must be held
+      void merge(Stage& stage, time_t now);
+
+      // Private function which doubles slots of shared table. Lock must be
+      // held
+      void grow(void);
+
+      // Attributes
+      atomic<bool> _started;
+      int _interval;
+      int _retention;
+      time_t _last_expire;
+      mutex _mutex;
+      static Conversations* _instance;
+
+      // Shared table, and slots in use
+      vector<Slot> _table;
+      size_t _used;
+
+      // Staging tables of all capture threads
+      vector<Stage*> _stages;
+
+      // Conversations which could not be written, only used by
+      // conversations thread
+      vector<Conversation> _failed;
+  };
+
+  #define conversations Conversations::getInstance()
+
+#endif
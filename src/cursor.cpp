@@ -0,0 +1,125 @@
+/**
+ * Copyright 2013 Ezequiel Vázquez De la calle
+ *
+ * This file is part of Swarm.
+ *
+ * Swarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Swarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file Implementation of Cursor class methods
+ */
+
+#include "cursor.h"
+using namespace std;
+
+// Constructor
+Cursor::Cursor(void) {
+  _con = NULL;
+  _res = NULL;
+  _row = NULL;
+  _lengths = NULL;
+  _columns = 0;
+  _failed = false;
+}
+
+// Destructor: close resultset, if any
+Cursor::~Cursor(void) {
+  close();
+}
+
+// Execute query, and start streaming its resultset
+bool Cursor::open(MYSQL* con, const string& sql) {
+  close();
+  _con = con;
+  _failed = false;
+
+  if (mysql_real_query(con, sql.c_str(), sql.size())) {
+    return true;
+  }
+
+  // Rows stay on server until they are read
+  _res = mysql_use_result(con);
+  if (_res == NULL) {
+    return true;
+  }
+  _columns = mysql_num_fields(_res);
+
+  return false;
+}
+
+// Read next row from server
+bool Cursor::next(void) {
+  if (_res == NULL) {
+    return false;
+  }
+
+  // No row is returned both at end of resultset and on errors
+  _row = mysql_fetch_row(_res);
+  if (_row == NULL) {
+    _failed = (mysql_errno(_con) != 0);
+    return false;
+  }
+  _lengths = mysql_fetch_lengths(_res);
+
+  return true;
+}
+
+// Check if rows could not be read
+bool Cursor::failed(void) const {
+  return _failed;
+}
+
+// Discard remaining rows, and free resultset
+void Cursor::close(void) {
+  if (_res == NULL) {
+    return;
+  }
+
+  // Unread rows must be fetched before connection can be used again
+  while (mysql_fetch_row(_res) != NULL) {
+    continue;
+  }
+  mysql_free_result(_res);
+
+  _res = NULL;
+  _row = NULL;
+  _lengths = NULL;
+  _columns = 0;
+}
+
+// Number of columns of resultset
+size_t Cursor::getColumns(void) const {
+  return _columns;
+}
+
+// Check if a column of current row is null
+bool Cursor::isNull(size_t index) const {
+  return (_row[index] == NULL);
+}
+
+// Get a column of current row as text, without copying it
+const char* Cursor::getText(size_t index) const {
+  return (_row[index] != NULL ? _row[index] : "");
+}
+
+// Get length of a column of current row
+size_t Cursor::getLength(size_t index) const {
+  return (_row[index] != NULL ? _lengths[index] : 0);
+}
+
+// Get a column of current row as integer, parsing it in place
+int Cursor::getInt(size_t index) const {
+  return (_row[index] != NULL ? strtol(_row[index], NULL, 10) : 0);
+}
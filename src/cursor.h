@@ -0,0 +1,130 @@
+/**
+ * Copyright 2013 Ezequiel Vázquez De la calle
+ *
+ * This file is part of Swarm.
+ *
+ * Swarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Swarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file Class Cursor definition (mysql support only)
+ */
+
+#ifndef _CURSOR_H_
+#define _CURSOR_H_
+
+  #include <cstdlib>
+  #include <mysql/mysql.h>
+  #include <string>
+  using namespace std;
+
+  /**
+   * Streamed resultset of a query. Rows are read from server one at a time,
+   * so memory used does not depend on resultset size, and columns are
+   * accessed by position straight from row buffer, without copying them.
+   * Connection which opened cursor can't run anything else until cursor is
+   * closed
+   */
+  class Cursor {
+    public:
+      /**
+       * Constructor
+       */
+      Cursor(void);
+
+      /**
+       * Destructor, closes cursor if still open
+       */
+      ~Cursor(void);
+
+      /**
+       * Starts streaming resultset of a query. Any previous resultset is
+       * closed before
+       * @param con Connection on which query is executed
+       * @param sql SQL sentence to execute
+       * @return True if query was not executed, false either
+       */
+      bool open(MYSQL* con, const string& sql);
+
+      /**
+       * Reads next row from server. Values of previous row are no longer
+       * valid after this call
+       * @return True if a row was read, false if there are no more rows or
+       * they could not be read
+       */
+      bool next(void);
+
+      /**
+       * Checks if reading rows stopped because of an error, as a connection
+       * lost while streaming, instead of reaching end of resultset
+       * @return True if rows could not be read, false either
+       */
+      bool failed(void) const;
+
+      /**
+       * Discards remaining rows and frees resultset
+       */
+      void close(void);
+
+      /**
+       * Returns number of columns of resultset
+       * @return Number of columns
+       */
+      size_t getColumns(void) const;
+
+      /**
+       * Checks if a column of current row is null
+       * @param index Position of column, starting at zero
+       * @return True if value is null, false either
+       */
+      bool isNull(size_t index) const;
+
+      /**
+       * Returns a column of current row as text, valid until next row is
+       * read. Null values are returned as empty text
+       * @param index Position of column, starting at zero
+       * @return Pointer to null terminated value of column
+       */
+      const char* getText(size_t index) const;
+
+      /**
+       * Returns length of a column of current row
+       * @param index Position of column, starting at zero
+       * @return Length of value in bytes
+       */
+      size_t getLength(size_t index) const;
+
+      /**
+       * Returns a column of current row as integer
+       * @param index Position of column, starting at zero
+       * @return Value of column, zero if it is null
+       */
+      int getInt(size_t index) const;
+
+    private:
+      // Copy constructor and assign operator are private, as resultset
+      // can not be shared
+      Cursor(const Cursor& cursor);
+      Cursor& operator=(const Cursor& cursor);
+
+      // Attributes
+      MYSQL* _con;
+      MYSQL_RES* _res;
+      MYSQL_ROW _row;
+      unsigned long* _lengths;
+      size_t _columns;
+      bool _failed;
+  };
+
+#endif
@@ -22,105 +22,247 @@
  */
 
 #include "db.h"
+#include "metrics.h"
 using namespace std;
 
 Db* Db::_instance = 0;
+const size_t Db::CONNECTIONS;
+const int Db::SCHEMA_VERSION;
 
 // Constructor: does nothing
 Db::Db(void) {
-  _con = 0;
 }
 
-// Destructor: close connection, if any
+// Destructor: close connections, if any
 Db::~Db(void) {
-  if (_con != 0) {
-    mysql_close(_con);
-    _con = 0;
+  for (size_t i = 0; i < _connections.size(); ++i) {
+    delete _connections[i];
   }
+  _connections.clear();
+  _free.clear();
 }
 
 // Initialization function
-bool Db::init(string host, string user, string pass, string database) {
-  // Init MySQL library
-  MYSQL *con = mysql_init(NULL);
-
-  // Check library initialization
-  if (con == NULL) {
-    cerr << "ERROR - Can't connect to MySQL server" << endl;
+bool Db::init(string host, string user, string pass, string database,
+    size_t size)
+{
+  // Init MySQL library before any thread uses it
+  if (mysql_library_init(0, NULL, NULL)) {
+    cerr << "ERROR - Can't initialize MySQL library" << endl;
     return true;
   }
 
-  // Connect to database, using received parameters
-  if (mysql_real_connect(con, host.c_str(), user.c_str(), pass.c_str(),
-      database.c_str(), 0, NULL, 0) == NULL)
-  {
-    cerr << "ERROR - " << mysql_error(con) << endl;
-    mysql_close(con);
-    return true;
+  // Open all connections of pool, using received parameters
+  for (size_t i = 0; i < max(size, (size_t)1); ++i) {
+    Connection* con = new Connection();
+    if (con->connect(host, user, pass, database)) {
+      delete con;
+      return true;
+    }
+    _connections.push_back(con);
+    _free.push_back(con);
   }
 
   // Check schema is installed, try to install if it's not deployed yet
-  _con = con;
   if (installSchema()) {
     cerr << "ERROR - Schema not installed, and can not install" << endl;
-    mysql_close(con);
     return true;
   }
 
   return false;
 }
 
-// Performs a query to database
+// Performs a query to database, using any free connection
 bool Db::query(string sql, Result& result) {
-  // Clean resultset
-  result.clear();
-
-  // Execute query
-  if (mysql_query(_con, sql.c_str())) {
-    cerr << "ERROR - Can not execute query" << endl;
-    cerr << mysql_error(_con) << endl;
+  Connection* con = acquire();
+  if (con == NULL) {
     return true;
   }
 
-  // Extract result after query execution
-  MYSQL_RES *res = mysql_store_result(_con);
+  uint64_t start = Metrics::now();
+  bool error = con->query(sql, result);
+  metrics->since(HISTOGRAM_QUERY, start);
+  metrics->add(error ? COUNTER_QUERY_ERRORS : COUNTER_QUERIES);
 
-  // If query did not return any result, no need to process resultset
-  if (res == NULL) {
-    return false;
+  release(con);
+  return error;
+}
+
+// Client library keeps some state for each thread using it. It's set up on
+// first use, and released when thread ends
+struct ClientThread {
+  ClientThread(void) {
+    mysql_thread_init();
+  }
+  ~ClientThread(void) {
+    mysql_thread_end();
   }
+};
 
-  // Extract field info from resultset
-  MYSQL_FIELD* fields = mysql_fetch_fields(res);
-  int num_fields = mysql_num_fields(res);
-  MYSQL_ROW row;
+// Take a free connection from pool
+Connection* Db::acquire(void) {
+  static thread_local ClientThread client;
 
-  // Process resultset and store each row on vector
-  while ((row = mysql_fetch_row(res))) {
-    map<string, string> result_row;
-    for (int i = 0; i < num_fields; i++) {
-      result_row.insert(pair<string, string>(fields[i].name, row[i]));
-    }
-    result.push_back(result_row);
+  unique_lock<mutex> lock(_mutex);
+  while (_free.empty()) {
+    _released.wait(lock);
   }
+  Connection* con = _free.back();
+  _free.pop_back();
+  lock.unlock();
 
-  // After processing result, free memory allocated
-  mysql_free_result(res);
-  return false;
+  // Connection which could not be recovered goes back to pool, so it is
+  // tried again later
+  if (con->check()) {
+    release(con);
+    return NULL;
+  }
+
+  return con;
 }
 
-// Returns auto-increment value generated by last statement executed
-int Db::getLastId(void) const {
-  return mysql_insert_id(_con);
+// Return a connection to pool
+void Db::release(Connection* con) {
+  _mutex.lock();
+  _free.push_back(con);
+  _released.notify_one();
+  _mutex.unlock();
 }
 
-// Checks if database schemas are installed and install them if needed
+// Counts devices table ip columns still stored as text, as before version 2
+#define IP_AS_TEXT "SELECT COUNT(*) AS count FROM information_schema.columns " \
+    "WHERE table_schema = DATABASE() AND table_name = 'devices' " \
+    "AND column_name = 'ip' AND data_type = 'varchar'"
+
+// Schema changes, in order. Each version may need several statements, and
+// a failed upgrade runs again all statements of its version, so each one
+// must be safe to run twice, or run only if its pending query counts
+// something
+static const struct {
+  int version;
+  const char* sql;
+  const char* pending;
+} MIGRATIONS[] = {
+  // Remove duplicated devices, keeping newest one
+  {2, "DELETE d1 FROM devices d1 JOIN devices d2 "
+      "ON d1.ip = d2.ip AND d1.id < d2.id", IP_AS_TEXT},
+
+  // Addresses are stored as binary: ip and subnet as 32 bits integers, and
+  // mac as 6 bytes
+  {2, "ALTER TABLE devices MODIFY mac varbinary(17) default ''", IP_AS_TEXT},
+
+  // Values already converted are kept: addresses as digits only, and macs
+  // shorter than text ones
+  {2, "UPDATE devices SET "
+      "ip = IF(ip REGEXP '^[0-9]+$', ip, INET_ATON(ip)), "
+      "subnet = IF(subnet REGEXP '^[0-9]+$', subnet, INET_ATON(subnet)), "
+      "mac = IF(LENGTH(mac) = 17, UNHEX(REPLACE(mac, ':', '')), mac)",
+      IP_AS_TEXT},
+  {2, "ALTER TABLE devices MODIFY ip int unsigned, "
+      "MODIFY subnet int unsigned, MODIFY mac varbinary(6) default '', "
+      "ADD UNIQUE KEY ip (ip), ADD KEY mac (mac)", IP_AS_TEXT},
+
+  // History of devices. Rows are clustered by bucket, so appends go to the
+  // end of table, and expired rows are a range at its start
+  {3, "CREATE TABLE IF NOT EXISTS sightings ( "
+      "bucket datetime NOT NULL, "
+      "device_id int(11) NOT NULL, "
+      "event tinyint NOT NULL, "
+      "old_value varchar(255) default '', "
+      "new_value varchar(255) default '', "
+      "count int(11) default 1, "
+      "PRIMARY KEY (bucket, device_id, event), "
+      "KEY device (device_id, bucket))"},
+
+  // Traffic between devices, clustered by bucket as history is
+  {4, "CREATE TABLE IF NOT EXISTS conversations ( "
+      "bucket datetime NOT NULL, "
+      "src_id int(11) NOT NULL, "
+      "dst_id int(11) NOT NULL, "
+      "packets bigint unsigned default 0, "
+      "bytes bigint unsigned default 0, "
+      "PRIMARY KEY (bucket, src_id, dst_id), "
+      "KEY src (src_id, bucket))"}
+};
+
+// Checks schema version, and applies pending migrations
 // Returns false if no error happened, true either
 bool Db::installSchema(void) {
+  stringstream sql;
+  Result result;
+
+  sql << "CREATE TABLE IF NOT EXISTS schema_version ( ";
+  sql << "version int(11) NOT NULL, ";
+  sql << "applied timestamp DEFAULT CURRENT_TIMESTAMP, ";
+  sql << "PRIMARY KEY (version)) ";
+
+  if (query(sql.str(), result) or query("SELECT COALESCE(MAX(version), 0) "
+      "AS version FROM schema_version", result) or result.empty())
+  {
+    return true;
+  }
+
+  int version = atoi(result.at(0)["version"].c_str());
+  if (version > SCHEMA_VERSION) {
+    cerr << "ERROR - Schema version " << version << " is newer than ";
+    cerr << "supported version " << SCHEMA_VERSION << endl;
+    return true;
+  }
+
+  if (version == SCHEMA_VERSION) {
+    return false;
+  }
+
+  // Progress goes to error output, as devices may be exported to standard
+  // output
+  cerr << "Schema version " << version << ", upgrading ... ";
+
+  // First version is schema as deployed before versions were recorded
+  if (version < 1 and (installDevices() or setVersion(1))) {
+    return true;
+  }
+
+  for (size_t i = 0; i < sizeof(MIGRATIONS) / sizeof(MIGRATIONS[0]); ++i) {
+    if (MIGRATIONS[i].version <= version) {
+      continue;
+    }
+
+    // Skip statements already applied by a previous, failed upgrade
+    bool pending = true;
+    if (MIGRATIONS[i].pending != NULL) {
+      if (query(MIGRATIONS[i].pending, result) or result.empty()) {
+        cerr << "ERROR - Can not check database schema" << endl;
+        return true;
+      }
+      pending = atoi(result.at(0)["count"].c_str());
+    }
+
+    if (pending and query(MIGRATIONS[i].sql, result)) {
+      cerr << "ERROR - Can not upgrade database schema to version ";
+      cerr << MIGRATIONS[i].version << endl;
+      return true;
+    }
+
+    // Version is recorded after its last statement
+    if ((i + 1 == sizeof(MIGRATIONS) / sizeof(MIGRATIONS[0]) or
+        MIGRATIONS[i + 1].version != MIGRATIONS[i].version) and
+        setVersion(MIGRATIONS[i].version))
+    {
+      return true;
+    }
+  }
+
+  cerr << "Ok!" << endl;
+  return false;
+}
+
+// Creates devices table, or adds columns lacking on tables created by older
+// versions. Returns false if no error happened, true either
+bool Db::installDevices(void) {
   stringstream sql;
   sql << "SELECT COUNT(*) AS count ";
   sql << "FROM information_schema.tables ";
-  sql << "WHERE table_schema = 'swarm' ";
+  sql << "WHERE table_schema = DATABASE() ";
   sql << "AND table_name = 'devices' ";
 
   // Perform query
@@ -131,16 +273,16 @@ bool Db::installSchema(void) {
 
   // Check result; if count equals zero, must install schema
   if (not atoi(result.at(0)["count"].c_str())) {
-    cout << "Schema not installed, installing ... ";
-
     sql.str(string());
     sql << "CREATE TABLE devices ( ";
     sql << "id int(11) NOT NULL AUTO_INCREMENT, ";
     sql << "hostname varchar(255) default '', ";
+    sql << "description varchar(255) default '', ";
     sql << "mac varchar(17) default '', ";
     sql << "ip varchar(15) default '', ";
     sql << "subnet varchar(15) default '', ";
     sql << "hops int(11) default -1, ";
+    sql << "path varchar(511) default '', ";
     sql << "vlan int(11) default -1, ";
     sql << "reachable int(1) default -1, ";
     sql << "PRIMARY KEY (id)) ";
@@ -151,9 +293,47 @@ bool Db::installSchema(void) {
       return true;
     }
 
-    cout << "Ok!" << endl;
+    return false;
+  }
+
+  // Schemas installed by older versions lack some columns, so add them
+  const char* columns[][2] = {
+    {"path", "varchar(511) default '' AFTER hops"},
+    {"description", "varchar(255) default '' AFTER hostname"}
+  };
+
+  for (size_t i = 0; i < sizeof(columns) / sizeof(columns[0]); ++i) {
+    sql.str(string());
+    sql << "SELECT COUNT(*) AS count ";
+    sql << "FROM information_schema.columns ";
+    sql << "WHERE table_schema = DATABASE() ";
+    sql << "AND table_name = 'devices' ";
+    sql << "AND column_name = '" << columns[i][0] << "' ";
+
+    if (query(sql.str(), result)) {
+      return true;
+    }
+
+    if (not atoi(result.at(0)["count"].c_str())) {
+      sql.str(string());
+      sql << "ALTER TABLE devices ";
+      sql << "ADD COLUMN " << columns[i][0] << " " << columns[i][1] << " ";
+
+      if (query(sql.str(), result)) {
+        cerr << "ERROR - Can not upgrade database schema" << endl;
+        return true;
+      }
+    }
   }
 
   return false;
 }
 
+// Records a schema version as applied
+bool Db::setVersion(int version) {
+  stringstream sql;
+  Result result;
+
+  sql << "INSERT INTO schema_version(version) VALUES(" << version << ")";
+  return query(sql.str(), result);
+}
@@ -25,26 +25,32 @@
 #define _DB_H_
 
   #include <algorithm>
+  #include <condition_variable>
   #include <iostream>
-  #include <map>
-  #include <mysql/mysql.h>
+  #include <mutex>
   #include <sstream>
   #include <string>
   #include <vector>
-  using namespace std;
 
-  // Define row and resultset types
-  typedef map<string,string> Row;
-  typedef vector<Row> Result;
+  #include "connection.h"
+  using namespace std;
 
-  // TODO Implement support for sqlite, postgresql and mongodb
+  // TODO Implement support for postgresql and mongodb
 
   /**
-   * Singleton class which implements database connection
+   * Singleton class which implements a pool of database connections. Each
+   * thread takes a connection for itself while using it, so queries and
+   * statements of different threads never share a connection
    */
   class Db {
     public:
 
+      // Default number of connections on pool
+      static const size_t CONNECTIONS = 4;
+
+      // Schema version used by this program
+      static const int SCHEMA_VERSION = 4;
+
       /**
        * Implementation of Singleton pattern
        * @return Pointer to singleton database object
@@ -64,17 +70,20 @@
       }
 
       /**
-       * Creates dabatase connection using parameters
+       * Creates dabatase connections using parameters
        * @param host Network address of database server
        * @param user Name of user to connect to db server
        * @param pass Password of database user
        * @param database Name of database to use
+       * @param size Number of connections on pool
        * @return True if connection was not successful, false either
        */
-      bool init(string host, string user, string pass, string database);
+      bool init(string host, string user, string pass, string database,
+          size_t size = CONNECTIONS);
 
       /**
-       * Executes a query onto the database and returns the result as a vector
+       * Executes a query onto the database and returns the result as a vector,
+       * using any free connection
        * @param sql SQL sentence to execute
        * @param result Vector of assciative maps, each one storing a result row
        * @return True if query was not executed, false either
@@ -82,10 +91,17 @@
       bool query(string sql, Result& result);
 
       /**
-       * Returns the value for an auto-increment column by previous statement
-       * @returns Value of last inserted or updated auto-increment id
+       * Takes a free connection from pool, waiting until some is returned if
+       * all are in use. Connection is checked to be alive before
+       * @return Pointer to connection, or NULL if it is not usable
+       */
+      Connection* acquire(void);
+
+      /**
+       * Returns a connection to pool, so other threads may use it
+       * @param con Connection previously taken using acquire
        */
-       int getLastId(void) const;
+      void release(Connection* con);
 
     protected:
       // Constructor, destructor, copy constructor and assing operator
@@ -96,12 +112,25 @@
       Db& operator=(const Db& db);
 
     private:
-      // Private function which installs database schema
+      // Private function which installs database schema, applying
+      // migrations not recorded on schema_version table yet
       bool installSchema(void);
 
+      // Private function which installs devices table as deployed before
+      // schema versions were recorded
+      bool installDevices(void);
+
+      // Private function which records a schema version as applied
+      bool setVersion(int version);
+
       // Attributes
       static Db* _instance;
-      MYSQL *_con;
+      mutex _mutex;
+      condition_variable _released;
+
+      // All connections, and those not taken by any thread
+      vector<Connection*> _connections;
+      vector<Connection*> _free;
   };
 
   #define db Db::getInstance()
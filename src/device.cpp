@@ -22,92 +22,44 @@
  */
 
 #include "device.h"
+#include "flusher.h"
+#include "storage.h"
 using namespace std;
 
 // Constructor
-Device::Device(const string& ip) {
+Device::Device(const Ipv4Addr& ip) {
   _id = 0;
-  _hostname = "";
-  _mac = "";
   _ip = ip;
   _hops = -1;
   _vlan = -1;
   _reachable = -1;
+  _interface = 0;
+  _dirty = FIELD_ALL;
 }
 
-// Loads a device from db using its id
+// Loads a device from storage using its id
 bool Device::load(const int id) {
-  stringstream sql;
-  Result result;
-
-  // Prepare select query
-  sql << "SELECT hostname, mac, ip, subnet, hops, vlan, reachable ";
-  sql << "FROM devices WHERE id = " << id;
-
-  // Execute query
-  if (db->query(sql.str(), result)) {
-    cerr << "ERROR - Can not load a device object by id" << endl;
+  if (storage->read(id, *this)) {
+    cerr << "ERROR - Can not load a device object by id " << id << endl;
     return true;
   }
 
-  // If resultset is empty, give a warning
-  if (result.empty()) {
-    cerr << "ERROR - No device found with id " << id << endl;
-    return true;
-  }
-
-  // Store values found into object attributes
-  _id = id;
-  _hostname = result.at(0)["hostname"];
-  _mac = result.at(0)["mac"];
-  _ip = result.at(0)["ip"];
-  _subnet = result.at(0)["subnet"];
-  _hops = atoi(result.at(0)["hops"].c_str());
-  _vlan = atoi(result.at(0)["vlan"].c_str());
-  _reachable = atoi(result.at(0)["reachable"].c_str());
-
   return false;
 }
 
-// Inserts or updates device info into database
+// Inserts or updates device info into storage
 bool Device::save(void) {
-  stringstream sql;
-  Result result;
-
-  // No _id, so must insert a new record
+  // New devices get an id never used before
   if (_id == 0) {
-    // Prepare sql insert sentence
-    sql << "INSERT INTO devices(";
-    sql << "hostname, mac, ip, subnet, hops, vlan, reachable) ";
-    sql << "VALUES('" << _hostname << "', '" << _mac << "', ";
-    sql << "'" << _ip << "', '" << _subnet << "', "<< _hops << ", ";
-    sql << _vlan << ", " << _reachable << ") ";
-
-    // Execute insert statement, and check errors
-    if (db->query(sql.str(), result)) {
-      cerr << "ERROR - Can not insert new device into database" << endl;
-      return true;
-    }
-
-    // Get id inserted, and save to object attribute
-    _id = db->getLastId();
-  }
-  // Attribute _id has some value, so must update
-  else {
-    // Prepare update query
-    sql << "UPDATE devices SET hostname = '" << _hostname << "', ";
-    sql << "mac = '" << _mac << "', ip = '" << _ip << "', subnet = '";
-    sql << _subnet << "', hops = " << _hops << ", vlan = " << _vlan << ", ";
-    sql << "reachable = " << _reachable << " ";
-    sql << "WHERE id = " << _id;
-
-    // Execute statement, and check for errors
-    if (db->query(sql.str(), result)) {
-      cerr << "ERROR - Can not update device with id " << _id;
-      cerr << " into database" << endl;
-      return true;
-    }
+    _id = flusher->nextId();
+  }
+
+  if (storage->write(vector<Device>(1, *this), FIELD_ALL)) {
+    cerr << "ERROR - Can not save device with id " << _id << endl;
+    return true;
   }
+
+  _dirty = 0;
   return false;
 }
 
@@ -123,42 +75,67 @@ void Device::setId(const int id) {
 
 // Attribute hostname getter
 const string& Device::getHostname(void) const{
-  return _hostname;
+  return _hostname.str();
 }
 
 // Attribute hostname setter
 void Device::setHostname(const string& hostname) {
-  _hostname = hostname;
+  if (_hostname.str() != hostname) {
+    _hostname = Symbol(hostname);
+    _dirty |= FIELD_HOSTNAME;
+  }
+}
+
+// Attribute description getter
+const string& Device::getDescription(void) const {
+  return _description.str();
+}
+
+// Attribute description setter
+void Device::setDescription(const string& description) {
+  if (_description.str() != description) {
+    _description = Symbol(description);
+    _dirty |= FIELD_DESCRIPTION;
+  }
 }
 
 // Attribute mac getter
-const string& Device::getMac(void) const {
+MacAddr Device::getMac(void) const {
   return _mac;
 }
 
 // Attribute mac setter
-void Device::setMac(const string& mac) {
-  _mac = mac;
+void Device::setMac(const MacAddr& mac) {
+  if (_mac != mac) {
+    _mac = mac;
+    _dirty |= FIELD_MAC;
+  }
 }
 
 // Attribute ip getter
-const string& Device::getIp(void) const {
+Ipv4Addr Device::getIp(void) const {
   return _ip;
 }
 
 // Attribute ip setter
-void Device::setIp(const string& ip) {
-  _ip = ip;
+void Device::setIp(const Ipv4Addr& ip) {
+  if (_ip != ip) {
+    _ip = ip;
+    _dirty |= FIELD_IP;
+  }
 }
 
 // Attribute subnet getter
-const string& Device::getSubnetMask(void) const {
+Ipv4Addr Device::getSubnetMask(void) const {
   return _subnet;
 }
 
 // Attribute subnet setter
-void Device::setSubnetMask(const string& subnet) {
-  _subnet = subnet;
+void Device::setSubnetMask(const Ipv4Addr& subnet) {
+  if (_subnet != subnet) {
+    _subnet = subnet;
+    _dirty |= FIELD_SUBNET;
+  }
 }
 
 // Attribute hops getter
@@ -168,7 +145,23 @@ int Device::getHops(void) const {
 
 // Attribute hops setter
 void Device::setHops(const int hops) {
-  _hops = hops;
+  if (_hops != hops) {
+    _hops = hops;
+    _dirty |= FIELD_HOPS;
+  }
+}
+
+// Attribute path getter
+const string& Device::getPath(void) const {
+  return _path.str();
+}
+
+// Attribute path setter
+void Device::setPath(const string& path) {
+  if (_path.str() != path) {
+    _path = Symbol(path);
+    _dirty |= FIELD_PATH;
+  }
 }
 
 // Attribute vlan getter
@@ -178,7 +171,10 @@ int Device::getVlan(void) const {
 
 // Attribute vlan setter
 void Device::setVlan(const int vlan) {
-  _vlan = vlan;
+  if (_vlan != vlan) {
+    _vlan = vlan;
+    _dirty |= FIELD_VLAN;
+  }
 }
 
 // Attribute reachable getter
@@ -188,7 +184,61 @@ int Device::getReachable(void) const {
 
 // Attribute reachable setter
 void Device::setReachable(const int reachable) {
-  _reachable = reachable;
+  if (_reachable != reachable) {
+    _reachable = reachable;
+    _dirty |= FIELD_REACHABLE;
+  }
+}
+
+// Attribute interface getter
+int Device::getInterface(void) const {
+  return _interface;
+}
+
+// Attribute interface setter
+void Device::setInterface(const int iface) {
+  _interface = iface;
+}
+
+// Attributes changed since last clear
+int Device::getDirty(void) const {
+  return _dirty;
+}
+
+// Mark all attributes as persisted
+void Device::clearDirty(void) {
+  _dirty = 0;
+}
+
+// Copy some attributes of another device
+void Device::merge(const Device& device, int fields) {
+  if (fields & FIELD_HOSTNAME) {
+    setHostname(device.getHostname());
+  }
+  if (fields & FIELD_DESCRIPTION) {
+    setDescription(device.getDescription());
+  }
+  if (fields & FIELD_MAC) {
+    setMac(device.getMac());
+  }
+  if (fields & FIELD_IP) {
+    setIp(device.getIp());
+  }
+  if (fields & FIELD_SUBNET) {
+    setSubnetMask(device.getSubnetMask());
+  }
+  if (fields & FIELD_HOPS) {
+    setHops(device.getHops());
+  }
+  if (fields & FIELD_PATH) {
+    setPath(device.getPath());
+  }
+  if (fields & FIELD_VLAN) {
+    setVlan(device.getVlan());
+  }
+  if (fields & FIELD_REACHABLE) {
+    setReachable(device.getReachable());
+  }
 }
 
 // Operator << overload
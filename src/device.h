@@ -24,31 +24,53 @@
 #ifndef _DEVICE_H_
 #define _DEVICE_H_
 
+  #include <iostream>
   #include <sstream>
   #include <string>
 
-  #include "db.h"
+  #include "ipv4addr.h"
+  #include "macaddr.h"
+  #include "symbol.h"
   using namespace std;
 
   /**
-   * Represents a detected network device
+   * Persisted device attributes, as bits of a mask. Setters mark changed
+   * attributes, so only those need to be written to database
+   */
+  enum DeviceField {
+    FIELD_HOSTNAME = 1 << 0,
+    FIELD_DESCRIPTION = 1 << 1,
+    FIELD_MAC = 1 << 2,
+    FIELD_IP = 1 << 3,
+    FIELD_SUBNET = 1 << 4,
+    FIELD_HOPS = 1 << 5,
+    FIELD_PATH = 1 << 6,
+    FIELD_VLAN = 1 << 7,
+    FIELD_REACHABLE = 1 << 8,
+    FIELD_ALL = (1 << 9) - 1
+  };
+
+  /**
+   * Represents a detected network device. Text attributes are interned, so
+   * devices are copied without allocations
    */
   class Device {
     public:
       /**
        * Constructor
        */
-      Device(const string& ip = string());
+      Device(const Ipv4Addr& ip = Ipv4Addr());
 
       /**
-       * Loads a device from db using its id
+       * Loads a device from storage using its id
        * @param id Identifier of device to load
        * @return True if there was an error, false either
        */
       bool load(const int id);
 
       /**
-       * Inserts or updates device info into database
+       * Inserts or updates device info into storage, without waiting for
+       * flusher
        * @returns True if there was an error, false either
        */
       bool save(void);
@@ -77,41 +99,53 @@
        */
       void setHostname(const string& hostname);
 
+      /**
+       * Attribute description getter
+       * @return Value of description
+       */
+      const string& getDescription(void) const;
+
+      /**
+       * Attribute description setter
+       * @param description New value for description
+       */
+      void setDescription(const string& description);
+
       /**
        * Attribute mac getter
        * @return Value of mac
        */
-      const string& getMac(void) const;
+      MacAddr getMac(void) const;
 
       /**
        * Attribute mac setter
        * @param mac New value for mac
        */
-      void setMac(const string& mac);
+      void setMac(const MacAddr& mac);
 
       /**
        * Attribute ip getter
        * @return Value of ip
        */
-      const string& getIp(void) const;
+      Ipv4Addr getIp(void) const;
 
       /**
        * Attribute ip setter
        * @param ip New value for ip
        */
-      void setIp(const string& ip);
+      void setIp(const Ipv4Addr& ip);
 
       /**
        * Attribute subnet getter
        * @return Value of subnet
        */
-      const string& getSubnetMask(void) const;
+      Ipv4Addr getSubnetMask(void) const;
 
       /**
        * Attribute subnet setter
        * @param subnet New value for subnet
        */
-      void setSubnetMask(const string& subnet);
+      void setSubnetMask(const Ipv4Addr& subnet);
 
       /**
        * Attribute hops getter
@@ -125,6 +159,18 @@
        */
       void setHops(const int hops);
 
+      /**
+       * Attribute path getter
+       * @return Comma separated ip addresses of hops between us and device
+       */
+      const string& getPath(void) const;
+
+      /**
+       * Attribute path setter
+       * @param path New value for path
+       */
+      void setPath(const string& path);
+
       /**
        * Attribute vlan getter
        * @return Value of vlan
@@ -149,15 +195,51 @@
        */
       void setReachable(const int reachable);
 
+      /**
+       * Attribute interface getter. Interface is not persisted, so loaded
+       * devices belong to first one
+       * @return Index of capture interface where device was found
+       */
+      int getInterface(void) const;
+
+      /**
+       * Attribute interface setter
+       * @param iface New value for interface
+       */
+      void setInterface(const int iface);
+
+      /**
+       * Returns attributes changed since last time they were cleared
+       * @return Mask of DeviceField values
+       */
+      int getDirty(void) const;
+
+      /**
+       * Mark all attributes as persisted
+       */
+      void clearDirty(void);
+
+      /**
+       * Copies some attributes of another device. Copied attributes are
+       * marked as changed only if their value differs
+       * @param device Device whose attributes are copied
+       * @param fields Mask of DeviceField values to copy
+       */
+      void merge(const Device& device, int fields);
+
     private:
       int _id;
-      string _hostname;
-      string _mac;
-      string _ip;
-      string _subnet;
+      Symbol _hostname;
+      Symbol _description;
+      MacAddr _mac;
+      Ipv4Addr _ip;
+      Ipv4Addr _subnet;
       int _hops;
+      Symbol _path;
       int _vlan;
       int _reachable;
+      int _interface;
+      int _dirty;
   };
 
   /**
@@ -0,0 +1,352 @@
+/**
+ * Copyright 2013 Ezequiel Vázquez De la calle
+ *
+ * This file is part of Swarm.
+ *
+ * Swarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Swarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file Class Exporter method definition
+ */
+
+#include "exporter.h"
+using namespace std;
+
+const size_t Exporter::BUFFER_SIZE;
+const size_t Exporter::CHUNK_SIZE;
+
+// Header line of CSV output, same columns and order as JSON keys
+static const char CSV_HEADER[] = "id,ip,mac,subnet,hostname,description,"
+    "hops,path,vlan,reachable\n";
+
+// Constructor
+Exporter::Exporter(void) {
+  _fd = -1;
+  _format = EXPORT_JSON;
+  _count = 0;
+}
+
+// Destructor: discard output if it was not closed
+Exporter::~Exporter(void) {
+  if (_fd >= 0 and not _file.empty()) {
+    ::close(_fd);
+    unlink((_file + ".tmp").c_str());
+  }
+}
+
+// Parses name of an export format
+bool Exporter::parseFormat(const string& name, ExportFormat& format) {
+  if (name == "json") {
+    format = EXPORT_JSON;
+  }
+  else if (name == "csv") {
+    format = EXPORT_CSV;
+  }
+  else if (name == "binary") {
+    format = EXPORT_BINARY;
+  }
+  else {
+    return true;
+  }
+  return false;
+}
+
+// Opens output file, or standard output
+bool Exporter::open(const string& file, ExportFormat format) {
+  if (file == "-") {
+    _file.clear();
+    _fd = STDOUT_FILENO;
+  }
+  else {
+    _file = file;
+    _fd = ::open((file + ".tmp").c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+        0644);
+    if (_fd < 0) {
+      cerr << "ERROR - Can't open export file " << file << ": ";
+      cerr << strerror(errno) << endl;
+      return true;
+    }
+  }
+
+  // Room for a whole buffer plus the record which fills it up, so
+  // formatting never reallocates
+  _buffer.clear();
+  _buffer.reserve(BUFFER_SIZE + 64 * 1024);
+  _format = format;
+  _count = 0;
+
+  if (_format == EXPORT_CSV) {
+    _buffer.append(CSV_HEADER, sizeof(CSV_HEADER) - 1);
+  }
+  return false;
+}
+
+// Formats a device into output buffer
+bool Exporter::write(const Device& device) {
+  switch (_format) {
+    case EXPORT_JSON:
+      writeJson(device);
+      break;
+
+    case EXPORT_CSV:
+      writeCsv(device);
+      break;
+
+    case EXPORT_BINARY:
+      writeBinary(device);
+      break;
+  }
+  ++_count;
+
+  if (_buffer.size() >= BUFFER_SIZE) {
+    return flush();
+  }
+  return false;
+}
+
+// Exports all devices found by monitor
+bool Exporter::exportMonitor(void) {
+  vector<Device> devices;
+  Ipv4Addr from;
+
+  // Copy a chunk of devices at a time, resuming after last ip address
+  // copied, so capture is never blocked for long
+  while (monitor->getDevices(from, devices, CHUNK_SIZE) > 0) {
+    for (size_t i = 0; i < devices.size(); ++i) {
+      if (write(devices[i])) {
+        return true;
+      }
+    }
+
+    uint32_t last = devices.back().getIp().toHost();
+    if (last == UINT32_MAX) {
+      break;
+    }
+    from = Ipv4Addr::fromHost(last + 1);
+  }
+
+  return false;
+}
+
+// Exports all devices stored on storage backend, as they are read
+bool Exporter::exportStorage(void) {
+  if (storage->scan(*this)) {
+    cerr << "ERROR - Can not export stored devices" << endl;
+    return true;
+  }
+
+  return false;
+}
+
+// Exports a device read from storage
+bool Exporter::readDevice(const Device& device) {
+  return write(device);
+}
+
+// Writes pending output and closes it
+bool Exporter::close(void) {
+  if (_fd < 0) {
+    return true;
+  }
+
+  bool error = flush();
+
+  // Standard output is kept open, files replace previous export
+  if (not _file.empty()) {
+    string tmp = _file + ".tmp";
+    if (::close(_fd) or error or rename(tmp.c_str(), _file.c_str())) {
+      cerr << "ERROR - Can't write export file " << _file << endl;
+      unlink(tmp.c_str());
+      error = true;
+    }
+  }
+  _fd = -1;
+
+  return error;
+}
+
+// Returns number of devices exported
+size_t Exporter::getCount(void) const {
+  return _count;
+}
+
+// Formats a device as a JSON object on a single line
+void Exporter::writeJson(const Device& device) {
+  char addr[18];
+
+  _buffer.append("{\"id\":");
+  appendInt(device.getId());
+  _buffer.append(",\"ip\":\"");
+  _buffer.append(addr, device.getIp().format(addr));
+  _buffer.append("\",\"mac\":\"");
+  _buffer.append(addr, device.getMac().format(addr));
+  _buffer.append("\",\"subnet\":\"");
+  _buffer.append(addr, device.getSubnetMask().format(addr));
+  _buffer.append("\",\"hostname\":");
+  appendJsonString(device.getHostname());
+  _buffer.append(",\"description\":");
+  appendJsonString(device.getDescription());
+  _buffer.append(",\"hops\":");
+  appendInt(device.getHops());
+  _buffer.append(",\"path\":");
+  appendJsonString(device.getPath());
+  _buffer.append(",\"vlan\":");
+  appendInt(device.getVlan());
+  _buffer.append(",\"reachable\":");
+  appendInt(device.getReachable());
+  _buffer.append("}\n");
+}
+
+// Formats a device as a CSV line
+void Exporter::writeCsv(const Device& device) {
+  char addr[18];
+
+  appendInt(device.getId());
+  _buffer.push_back(',');
+  _buffer.append(addr, device.getIp().format(addr));
+  _buffer.push_back(',');
+  _buffer.append(addr, device.getMac().format(addr));
+  _buffer.push_back(',');
+  _buffer.append(addr, device.getSubnetMask().format(addr));
+  _buffer.push_back(',');
+  appendCsvString(device.getHostname());
+  _buffer.push_back(',');
+  appendCsvString(device.getDescription());
+  _buffer.push_back(',');
+  appendInt(device.getHops());
+  _buffer.push_back(',');
+  appendCsvString(device.getPath());
+  _buffer.push_back(',');
+  appendInt(device.getVlan());
+  _buffer.push_back(',');
+  appendInt(device.getReachable());
+  _buffer.push_back('\n');
+}
+
+// Formats a device as a length prefixed binary record
+void Exporter::writeBinary(const Device& device) {
+  // Reserve room for length, filled once record is complete
+  size_t start = _buffer.size();
+  appendNetInt(0);
+
+  appendNetInt(device.getId());
+  appendNetInt(device.getIp().toHost());
+  appendNetInt(device.getSubnetMask().toHost());
+  _buffer.append((const char*)device.getMac().getOctets(), 6);
+  appendNetInt(device.getHops());
+  appendNetInt(device.getVlan());
+  appendNetInt(device.getReachable());
+  appendBinaryString(device.getHostname());
+  appendBinaryString(device.getDescription());
+  appendBinaryString(device.getPath());
+
+  uint32_t len = htonl(_buffer.size() - start - sizeof(uint32_t));
+  memcpy(&_buffer[start], &len, sizeof(len));
+}
+
+// Appends an integer as decimal text
+void Exporter::appendInt(int value) {
+  char buf[12];
+  char* end = buf + sizeof(buf);
+  char* pos = end;
+
+  // Digits are written backwards, from least significant one
+  uint32_t abs = (value < 0) ? -(uint32_t)value : value;
+  do {
+    *--pos = '0' + abs % 10;
+    abs /= 10;
+  } while (abs);
+
+  if (value < 0) {
+    *--pos = '-';
+  }
+  _buffer.append(pos, end - pos);
+}
+
+// Appends a quoted JSON string, escaping quotes and control characters
+void Exporter::appendJsonString(const string& value) {
+  static const char HEX_DIGITS[] = "0123456789abcdef";
+
+  _buffer.push_back('"');
+  for (size_t i = 0; i < value.size(); ++i) {
+    unsigned char c = value[i];
+    if (c == '"' or c == '\\') {
+      _buffer.push_back('\\');
+      _buffer.push_back(c);
+    }
+    else if (c < 0x20) {
+      _buffer.append("\\u00");
+      _buffer.push_back(HEX_DIGITS[c >> 4]);
+      _buffer.push_back(HEX_DIGITS[c & 0x0F]);
+    }
+    else {
+      _buffer.push_back(c);
+    }
+  }
+  _buffer.push_back('"');
+}
+
+// Appends a CSV field, quoted only if it holds separators or quotes
+void Exporter::appendCsvString(const string& value) {
+  if (value.find_first_of(",\"\r\n") == string::npos) {
+    _buffer.append(value);
+    return;
+  }
+
+  _buffer.push_back('"');
+  for (size_t i = 0; i < value.size(); ++i) {
+    if (value[i] == '"') {
+      _buffer.push_back('"');
+    }
+    _buffer.push_back(value[i]);
+  }
+  _buffer.push_back('"');
+}
+
+// Appends a 32 bits integer on network byte order
+void Exporter::appendNetInt(uint32_t value) {
+  value = htonl(value);
+  _buffer.append((const char*)&value, sizeof(value));
+}
+
+// Appends a string with its 16 bits length. Longer strings are truncated
+void Exporter::appendBinaryString(const string& value) {
+  uint16_t len = min(value.size(), (size_t)UINT16_MAX);
+  uint16_t net_len = htons(len);
+  _buffer.append((const char*)&net_len, sizeof(net_len));
+  _buffer.append(value.data(), len);
+}
+
+// Writes output buffer to file
+bool Exporter::flush(void) {
+  size_t done = 0;
+
+  while (done < _buffer.size()) {
+    ssize_t bytes = ::write(_fd, _buffer.data() + done, _buffer.size() - done);
+    if (bytes < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      cerr << "ERROR - Can't write exported devices: " << strerror(errno);
+      cerr << endl;
+      return true;
+    }
+    done += bytes;
+  }
+
+  _buffer.clear();
+  return false;
+}
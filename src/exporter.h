@@ -0,0 +1,171 @@
+/**
+ * Copyright 2013 Ezequiel Vázquez De la calle
+ *
+ * This file is part of Swarm.
+ *
+ * Swarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Swarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file Class Exporter definition
+ */
+
+#ifndef _EXPORTER_H_
+#define _EXPORTER_H_
+
+  #include <algorithm>
+  #include <arpa/inet.h>
+  #include <cerrno>
+  #include <cstdint>
+  #include <cstdio>
+  #include <cstring>
+  #include <fcntl.h>
+  #include <iostream>
+  #include <string>
+  #include <unistd.h>
+  #include <vector>
+
+  #include "monitor.h"
+  #include "storage.h"
+  using namespace std;
+
+  /**
+   * Formats in which devices may be exported
+   */
+  enum ExportFormat {
+    EXPORT_JSON,
+    EXPORT_CSV,
+    EXPORT_BINARY
+  };
+
+  /**
+   * Streams devices to a file, or to standard output, as JSON Lines, CSV
+   * or compact binary records. Records are formatted straight into a
+   * single output buffer, which is written once it fills up, so exporting
+   * needs no allocations per device.
+   *
+   * Binary records start with their length, not counting itself, followed
+   * by id, ip address, subnet mask, mac address, hops, vlan and
+   * reachability, and then hostname, description and path. Integers and
+   * ip addresses take 32 bits on network byte order, mac address takes 6
+   * bytes, and strings take a 16 bits length followed by their bytes.
+   */
+  class Exporter : public DeviceReader {
+    public:
+
+      // Size of output buffer, in bytes
+      static const size_t BUFFER_SIZE = 1024 * 1024;
+
+      // Number of devices copied from monitor at once
+      static const size_t CHUNK_SIZE = 1024;
+
+      /**
+       * Constructor
+       */
+      Exporter(void);
+
+      /**
+       * Destructor, closes output if still open, discarding it
+       */
+      ~Exporter(void);
+
+      /**
+       * Parses name of an export format
+       * @param name Format name: json, csv or binary
+       * @param format Parsed format
+       * @return True if name is unknown, false either
+       */
+      static bool parseFormat(const string& name, ExportFormat& format);
+
+      /**
+       * Opens output. Files are written under a temporary name, and only
+       * replace previous file when closed, so readers never see half an
+       * export
+       * @param file Path of output file, or "-" for standard output
+       * @param format Format of records
+       * @return True if there was an error, false either
+       */
+      bool open(const string& file, ExportFormat format);
+
+      /**
+       * Formats a device into output buffer, writing buffer if it's full
+       * @param device Device to export
+       * @return True if there was an error, false either
+       */
+      bool write(const Device& device);
+
+      /**
+       * Exports all devices found by monitor, in ip address order. Monitor
+       * is only locked while copying a few devices at a time
+       * @return True if there was an error, false either
+       */
+      bool exportMonitor(void);
+
+      /**
+       * Exports all devices stored on storage backend, streaming them
+       * straight into output, by id order
+       * @return True if there was an error, false either
+       */
+      bool exportStorage(void);
+
+      /**
+       * Receives a device read from storage, and exports it
+       * @param device Device read
+       * @return True if there was an error, false either
+       */
+      bool readDevice(const Device& device);
+
+      /**
+       * Writes pending output and closes it
+       * @return True if there was an error, false either
+       */
+      bool close(void);
+
+      /**
+       * Returns number of devices exported since output was opened
+       * @return Number of devices
+       */
+      size_t getCount(void) const;
+
+    private:
+      // Copy constructor and assign operator are private, as output file
+      // can not be shared
+      Exporter(const Exporter& exporter);
+      Exporter& operator=(const Exporter& exporter);
+
+      // Private functions which format a device on each format
+      void writeJson(const Device& device);
+      void writeCsv(const Device& device);
+      void writeBinary(const Device& device);
+
+      // Private functions which append values to output buffer
+      void appendInt(int value);
+      void appendJsonString(const string& value);
+      void appendCsvString(const string& value);
+      void appendNetInt(uint32_t value);
+      void appendBinaryString(const string& value);
+
+      // Private function which writes output buffer to file
+      bool flush(void);
+
+      // Attributes
+      string _buffer;
+      string _file;
+      int _fd;
+      ExportFormat _format;
+      size_t _count;
+  };
+
+#endif
@@ -0,0 +1,432 @@
+/**
+ * Copyright 2013 Ezequiel Vázquez De la calle
+ *
+ * This file is part of Swarm.
+ *
+ * Swarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Swarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file Class Flusher method definition
+ */
+
+#include "flusher.h"
+#include "actions.h"
+#include "journalstorage.h"
+#include "timeline.h"
+using namespace std;
+
+Flusher* Flusher::_instance = 0;
+const int Flusher::INTERVAL;
+const size_t Flusher::MAX_PENDING;
+const size_t Flusher::MAX_QUEUED;
+const size_t Flusher::SPILL_BUFFER;
+
+// Constructor
+Flusher::Flusher(void) {
+  _next_id = 0;
+  _failed = false;
+  _spill_fd = -1;
+  _spill_size = 0;
+  _spill_replayed = 0;
+  _spilling = false;
+  _spilled = 0;
+  _replayed = 0;
+  _failures = 0;
+}
+
+// Destructor: close spill file
+Flusher::~Flusher(void) {
+  if (_spill_fd >= 0) {
+    close(_spill_fd);
+    _spill_fd = -1;
+  }
+}
+
+// Reader which keeps id of each stored device, by its ip address
+class IdReader : public DeviceReader {
+  public:
+    IdReader(unordered_map<Ipv4Addr,int>& ids) : _ids(ids) {}
+
+    bool readDevice(const Device& device) {
+      _ids[device.getIp()] = device.getId();
+      return false;
+    }
+
+  private:
+    unordered_map<Ipv4Addr,int>& _ids;
+};
+
+// Read last id used, open spill file and launch as thread
+bool Flusher::start(const string& spill, bool adopt) {
+  if (storage->getLastId(_next_id)) {
+    cerr << "ERROR - Can not read last device id" << endl;
+    return true;
+  }
+
+  // Devices found again keep their stored id, so their row is updated and
+  // history and conversations still refer to them
+  IdReader reader(_stored_ids);
+  if (adopt and storage->scan(reader)) {
+    cerr << "ERROR - Can not read stored device ids" << endl;
+    return true;
+  }
+
+  _spill_file = spill;
+  _spill_fd = open(_spill_file.c_str(), O_RDWR | O_APPEND | O_CREAT, 0644);
+  if (_spill_fd < 0) {
+    cerr << "ERROR - Can't open spill file " << _spill_file << endl;
+    return true;
+  }
+
+  // Changes left by a previous run are written before new ones. Their
+  // devices got ids which may not be on storage, so they are not reused
+  struct stat info;
+  if (fstat(_spill_fd, &info) == 0 and info.st_size > 0) {
+    _spill_size = info.st_size;
+    _spilling = true;
+    _next_id = max(_next_id, lastSpilledId());
+  }
+
+  // Launch thread
+  thread t1(persist);
+  t1.detach();
+  return false;
+}
+
+// Returns an id for a new device
+int Flusher::nextId(void) {
+  _mutex.lock();
+  int id = ++_next_id;
+  _mutex.unlock();
+
+  return id;
+}
+
+// Returns stored id of a device found on some ip, or a new one
+int Flusher::nextId(const Ipv4Addr& ip) {
+  _mutex.lock();
+  int id;
+  unordered_map<Ipv4Addr,int>::iterator it = _stored_ids.find(ip);
+  if (it != _stored_ids.end()) {
+    id = it->second;
+    _stored_ids.erase(it);
+  }
+  else {
+    id = ++_next_id;
+  }
+  _mutex.unlock();
+
+  return id;
+}
+
+// Queue changed attributes of some device
+void Flusher::enqueue(const Device& device, int fields) {
+  _mutex.lock();
+
+  // Queue is full, or older changes are spilled: append to spill file, so
+  // changes are written in order
+  Changes::iterator it = _pending.find(device.getId());
+  if (_spilling or (it == _pending.end() and
+      _pending.size() >= MAX_QUEUED))
+  {
+    JournalStorage::encode(_spill_buffer, device, fields);
+    _spilling = true;
+    ++_spilled;
+  }
+
+  // Merge with changes of the same device still waiting
+  else if (it == _pending.end()) {
+    Change change = {device, fields};
+    _pending.insert(pair<int,Change>(device.getId(), change));
+  }
+  else {
+    it->second.device = device;
+    it->second.fields |= fields;
+  }
+
+  // Too many devices or spilled changes waiting, so do not wait until
+  // interval ends. Spill file is only written by flusher thread, so
+  // callers never wait for disk
+  if (_pending.size() >= MAX_PENDING or
+      _spill_buffer.size() >= SPILL_BUFFER)
+  {
+    _wakeup.notify_one();
+  }
+
+  _mutex.unlock();
+}
+
+// Wait until it's time to flush, and write all queued changes
+void Flusher::flush(void) {
+  Changes pending;
+  chrono::steady_clock::time_point deadline = chrono::steady_clock::now() +
+      chrono::seconds(INTERVAL);
+
+  // Take all queued changes, so devices may be queued again while writing.
+  // After a failure, whole interval is waited so storage may recover
+  unique_lock<mutex> lock(_mutex);
+  while (_failed or (_pending.size() < MAX_PENDING and
+      _spill_buffer.size() < SPILL_BUFFER))
+  {
+    if (_wakeup.wait_until(lock, deadline) == cv_status::timeout) {
+      break;
+    }
+  }
+  pending.swap(_pending);
+  lock.unlock();
+
+  // Spilled changes kept in memory go to spill file even if storage is
+  // down, so they don't pile up in memory
+  appendSpill();
+
+  // Queued changes are older than spilled ones, so they go first
+  bool error = write(pending);
+  if (error) {
+    requeue(pending);
+  }
+  else {
+    error = replay();
+  }
+
+  lock.lock();
+  _failed = error;
+}
+
+// Returns number of devices queued in memory
+size_t Flusher::getQueued(void) {
+  lock_guard<mutex> lock(_mutex);
+  return _pending.size();
+}
+
+// Returns bytes of spilled changes not written yet
+size_t Flusher::getSpillBacklog(void) {
+  lock_guard<mutex> lock(_mutex);
+  return _spill_size - _spill_replayed + _spill_buffer.size();
+}
+
+// Returns number of spilled changes
+unsigned long Flusher::getSpilled(void) {
+  lock_guard<mutex> lock(_mutex);
+  return _spilled;
+}
+
+// Returns number of spilled changes written
+unsigned long Flusher::getReplayed(void) {
+  lock_guard<mutex> lock(_mutex);
+  return _replayed;
+}
+
+// Returns number of failed writes
+unsigned long Flusher::getFailures(void) {
+  lock_guard<mutex> lock(_mutex);
+  return _failures;
+}
+
+// Writes changes grouped by changed attributes, leaving failed ones
+bool Flusher::write(Changes& changes) {
+  TRACE_SPAN("storage write");
+
+  // Group devices by changed attributes, as rows of a multi-row statement
+  // must have the same columns
+  map<int,vector<Device> > groups;
+  Changes::iterator it;
+  for (it = changes.begin(); it != changes.end(); ++it) {
+    groups[it->second.fields].push_back(it->second.device);
+  }
+
+  // Write each group, letting backend decide how to batch rows
+  map<int,bool> failed;
+  map<int,vector<Device> >::const_iterator group;
+  for (group = groups.begin(); group != groups.end(); ++group) {
+    if (storage->write(group->second, group->first)) {
+      cerr << "ERROR - Can not write " << group->second.size();
+      cerr << " devices" << endl;
+      failed[group->first] = true;
+    }
+  }
+
+  if (failed.empty()) {
+    changes.clear();
+    return false;
+  }
+
+  _mutex.lock();
+  _failures += failed.size();
+  _mutex.unlock();
+
+  for (it = changes.begin(); it != changes.end(); ) {
+    if (failed.count(it->second.fields)) {
+      ++it;
+    }
+    else {
+      changes.erase(it++);
+    }
+  }
+
+  return true;
+}
+
+// Queues again changes which could not be written
+void Flusher::requeue(Changes& failed) {
+  lock_guard<mutex> lock(_mutex);
+
+  // Changes queued meanwhile are newer, so they are applied over failed
+  Changes::const_iterator it;
+  for (it = _pending.begin(); it != _pending.end(); ++it) {
+    Changes::iterator old = failed.find(it->first);
+    if (old == failed.end()) {
+      failed.insert(*it);
+    }
+    else {
+      JournalStorage::apply(old->second.device, it->second.device,
+          it->second.fields);
+      old->second.fields |= it->second.fields;
+    }
+  }
+
+  _pending.swap(failed);
+}
+
+// Appends spilled changes kept in memory to spill file. Only flusher
+// thread appends, so lock is held just to take changes and account them
+bool Flusher::appendSpill(void) {
+  string buffer;
+  size_t done = 0;
+
+  _mutex.lock();
+  buffer.swap(_spill_buffer);
+  _mutex.unlock();
+
+  while (done < buffer.size()) {
+    ssize_t bytes = ::write(_spill_fd, buffer.data() + done,
+        buffer.size() - done);
+    if (bytes < 0) {
+      cerr << "ERROR - Can't write spill file " << _spill_file << endl;
+      break;
+    }
+    done += bytes;
+  }
+
+  // Changes not appended are kept before those spilled meanwhile
+  _mutex.lock();
+  _spill_size += done;
+  _spill_buffer.insert(0, buffer, done, string::npos);
+  _mutex.unlock();
+
+  return (done < buffer.size());
+}
+
+// Reads highest device id of spilled changes
+int Flusher::lastSpilledId(void) {
+  vector<char> chunk(SPILL_BUFFER);
+  off_t offset = 0;
+  int last = 0;
+
+  while (offset < _spill_size) {
+    size_t len = min((off_t)chunk.size(), _spill_size - offset);
+    ssize_t bytes = pread(_spill_fd, &chunk[0], len, offset);
+    if (bytes <= 0) {
+      break;
+    }
+
+    size_t pos = 0;
+    Device delta;
+    int fields;
+    while (not JournalStorage::decode(&chunk[0], bytes, pos, delta,
+        fields))
+    {
+      last = max(last, delta.getId());
+    }
+
+    // Records after one which can't be read are discarded on replay
+    if (pos == 0) {
+      break;
+    }
+    offset += pos;
+  }
+
+  return last;
+}
+
+// Writes spilled changes in order, until spill file is empty
+bool Flusher::replay(void) {
+  vector<char> chunk(SPILL_BUFFER);
+
+  while (1) {
+    // Spilled changes still in memory are appended first, so all of them
+    // are read from file
+    if (appendSpill()) {
+      return true;
+    }
+
+    // Everything written, so new changes can be queued again. Changes
+    // spilled meanwhile must be appended before
+    _mutex.lock();
+    if (_spill_replayed == _spill_size) {
+      if (not _spill_buffer.empty()) {
+        _mutex.unlock();
+        continue;
+      }
+      if (_spilling and ftruncate(_spill_fd, 0) == 0) {
+        _spill_size = 0;
+        _spill_replayed = 0;
+        _spilling = false;
+      }
+      _mutex.unlock();
+      return false;
+    }
+
+    off_t offset = _spill_replayed;
+    size_t len = min((off_t)chunk.size(), _spill_size - offset);
+    _mutex.unlock();
+
+    ssize_t bytes = pread(_spill_fd, &chunk[0], len, offset);
+    if (bytes <= 0) {
+      cerr << "ERROR - Can't read spill file " << _spill_file << endl;
+      return true;
+    }
+
+    // Merge changes of each device, keeping their order
+    Changes changes;
+    unsigned long count = 0;
+    size_t pos = 0;
+    Device delta;
+    int fields;
+    while (not JournalStorage::decode(&chunk[0], bytes, pos, delta,
+        fields))
+    {
+      Change& change = changes[delta.getId()];
+      JournalStorage::apply(change.device, delta, fields);
+      change.fields |= fields;
+      ++count;
+    }
+
+    // A record which can't be read is left by a crash, or corrupt
+    if (pos == 0) {
+      cerr << "ERROR - Discarding unreadable records of spill file ";
+      cerr << _spill_file << endl;
+      pos = _spill_size - offset;
+    }
+
+    if (write(changes)) {
+      return true;
+    }
+
+    _mutex.lock();
+    _spill_replayed += pos;
+    _replayed += count;
+    _mutex.unlock();
+  }
+}
@@ -0,0 +1,231 @@
+/**
+ * Copyright 2013 Ezequiel Vázquez De la calle
+ *
+ * This file is part of Swarm.
+ *
+ * Swarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Swarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file Class Flusher definition. Singleton pattern implementation
+ */
+
+#ifndef _FLUSHER_H_
+#define _FLUSHER_H_
+
+  #include <chrono>
+  #include <condition_variable>
+  #include <fcntl.h>
+  #include <iostream>
+  #include <map>
+  #include <mutex>
+  #include <sstream>
+  #include <string>
+  #include <sys/stat.h>
+  #include <thread>
+  #include <unistd.h>
+  #include <unordered_map>
+  #include <vector>
+
+  #include "device.h"
+  #include "pool.h"
+  #include "storage.h"
+  using namespace std;
+
+  /**
+   * Singleton object which persists devices in background. Changes are
+   * queued by device, merging changed attributes of repeated updates, and
+   * written every few seconds, or when too many are waiting, as multi-row
+   * writes which only touch changed columns. Device ids are assigned here
+   * instead of by database, so new devices can be batched too.
+   *
+   * Queue is bounded, so a slow or unreachable storage never blocks
+   * capture. Once full, changes are appended to a local spill file using
+   * journal record format, and so are all changes after them, to keep
+   * their order. Changes which could not be written are queued again, and
+   * spill file is replayed in order once storage recovers.
+   */
+  class Flusher {
+    public:
+
+      // Seconds between two flushes
+      static const int INTERVAL = 1;
+
+      // Number of queued devices which triggers a flush before time
+      static const size_t MAX_PENDING = 1024;
+
+      // Number of queued devices which makes changes go to spill file
+      static const size_t MAX_QUEUED = 65536;
+
+      // Bytes of spilled changes kept in memory before appending them to
+      // spill file, and bytes of spill file replayed at once
+      static const size_t SPILL_BUFFER = 1024 * 1024;
+
+      /**
+       * Implementation of Singleton pattern
+       * @return Pointer to singleton flusher object
+       */
+      static Flusher* getInstance(void) {
+        if (_instance == 0) {
+          _instance = new Flusher();
+        }
+        return _instance;
+      }
+
+      /**
+       * Destroyer for singleton flusher object
+       */
+      static void destroy(void) {
+        delete _instance;
+      }
+
+      /**
+       * Initialize flusher object, reading last id used by database or
+       * spill file, and launch as thread. Changes left on spill file by a
+       * previous run are written first
+       * @param spill Path of spill file, created if it does not exist
+       * @param adopt Read ids of stored devices, so devices found again
+       * take their stored id. Needed when stored devices are not loaded
+       * @return True if there was an error, false either
+       */
+      bool start(const string& spill = "swarm.spill", bool adopt = false);
+
+      /**
+       * Returns an id for a new device
+       * @return Identifier never used before
+       */
+      int nextId(void);
+
+      /**
+       * Returns an id for a device found on some ip address. Id of device
+       * stored with that address is taken, if ids were read on start
+       * @param ip Ip address of device
+       * @return Stored identifier, or one never used before
+       */
+      int nextId(const Ipv4Addr& ip);
+
+      /**
+       * Queue changed attributes of some device to be written. Never waits
+       * for storage or disk
+       * @param device Device with an id, whose attributes must be written
+       * @param fields Mask of DeviceField values to write
+       */
+      void enqueue(const Device& device, int fields);
+
+      /**
+       * Wait until it's time to flush, and write all queued changes
+       */
+      void flush(void);
+
+      /**
+       * Returns number of devices whose changes are queued in memory
+       * @return Queue depth
+       */
+      size_t getQueued(void);
+
+      /**
+       * Returns bytes of spilled changes not written to storage yet
+       * @return Spill backlog, in bytes
+       */
+      size_t getSpillBacklog(void);
+
+      /**
+       * Returns number of changes sent to spill file since start
+       * @return Total spilled changes
+       */
+      unsigned long getSpilled(void);
+
+      /**
+       * Returns number of spilled changes written to storage since start
+       * @return Total replayed changes
+       */
+      unsigned long getReplayed(void);
+
+      /**
+       * Returns number of failed writes to storage since start
+       * @return Total failed writes
+       */
+      unsigned long getFailures(void);
+
+    protected:
+      // Constructor, destructor, copy constructor and assing operator
+      // are protected due to singleton pattern implementation
+      Flusher(void);
+      ~Flusher(void);
+      Flusher(const Flusher& flusher);
+      Flusher& operator=(const Flusher& flusher);
+
+    private:
+      // Changes of a device waiting to be written
+      struct Change {
+        Device device;
+        int fields;
+      };
+
+      // Changes by device id. Nodes come from a pool, as devices are
+      // queued and written all the time
+      typedef map<int,Change,less<int>,
+          PoolAllocator<pair<const int,Change> > > Changes;
+
+      // Private function which writes changes grouped by changed
+      // attributes. Written changes are removed, so failed ones are left
+      bool write(Changes& changes);
+
+      // Private function which queues again changes which could not be
+      // written, below newer changes of the same devices
+      void requeue(Changes& failed);
+
+      // Private function which appends spilled changes kept in memory to
+      // spill file. Only called by flusher thread, without lock held
+      bool appendSpill(void);
+
+      // Private function which reads highest device id of changes on
+      // spill file
+      int lastSpilledId(void);
+
+      // Private function which writes spilled changes in order, until
+      // spill file is empty. Returns true if some write failed
+      bool replay(void);
+
+      // Attributes
+      int _next_id;
+      unordered_map<Ipv4Addr,int> _stored_ids;
+      mutex _mutex;
+      condition_variable _wakeup;
+      static Flusher* _instance;
+
+      // Queued changes, by device id
+      Changes _pending;
+
+      // Last write failed, so next one waits a whole interval
+      bool _failed;
+
+      // Spill file, with changes not appended yet, bytes appended and bytes
+      // already replayed. Changes are spilled while some are left
+      string _spill_file;
+      int _spill_fd;
+      string _spill_buffer;
+      off_t _spill_size;
+      off_t _spill_replayed;
+      bool _spilling;
+
+      // Metrics
+      unsigned long _spilled;
+      unsigned long _replayed;
+      unsigned long _failures;
+  };
+
+  #define flusher Flusher::getInstance()
+
+#endif
@@ -0,0 +1,394 @@
+/**
+ * Copyright 2013 Ezequiel Vázquez De la calle
+ *
+ * This file is part of Swarm.
+ *
+ * Swarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Swarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file Class Generator method definition
+ */
+
+#include "generator.h"
+using namespace std;
+
+const int Generator::PUBLIC_SHARE;
+const time_t Generator::START;
+const size_t Generator::MIN_FRAME;
+
+// Constructor
+Generator::Generator(const TrafficProfile& profile) :
+    _profile(profile), _random(profile.seed)
+{
+  _pcap = NULL;
+  _dumper = NULL;
+  _written = 0;
+  _joined = 0;
+
+  // Sniffing host takes first address of first prefix, and a mac address
+  // below every other host
+  uint8_t octets[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x00};
+  _own_ip = Ipv4Addr::fromHost(_profile.prefixes[0].network.toHost() + 1);
+  _own_mac = MacAddr(octets);
+}
+
+// Destructor
+Generator::~Generator(void) {
+  close();
+}
+
+// Parses a prefix
+bool Generator::parsePrefix(const string& text, Prefix& prefix) {
+  size_t slash = text.find('/');
+  if (slash == string::npos) {
+    return true;
+  }
+
+  // Length must leave room for network, sniffing host, some other host
+  // and broadcast addresses
+  char* end;
+  long length = strtol(text.c_str() + slash + 1, &end, 10);
+  if (*end != '\0' or end == text.c_str() + slash + 1 or length < 1 or
+      length > 30)
+  {
+    return true;
+  }
+
+  Ipv4Addr network;
+  if (Ipv4Addr::parse(text.substr(0, slash).c_str(), network)) {
+    return true;
+  }
+
+  // Host bits of address are ignored
+  uint32_t mask = 0xFFFFFFFFU << (32 - length);
+  prefix.network = Ipv4Addr::fromHost(network.toHost() & mask);
+  prefix.size = ~mask + 1;
+  return false;
+}
+
+// Opens output file
+bool Generator::open(const string& file) {
+  _pcap = pcap_open_dead(DLT_EN10MB, 65535);
+  if (_pcap == NULL) {
+    cerr << "ERROR - Can't create capture" << endl;
+    return true;
+  }
+
+  _dumper = pcap_dump_open(_pcap, file.c_str());
+  if (_dumper == NULL) {
+    cerr << "ERROR - Can't open capture file " << file << ": ";
+    cerr << pcap_geterr(_pcap) << endl;
+    pcap_close(_pcap);
+    _pcap = NULL;
+    return true;
+  }
+
+  return false;
+}
+
+// Writes some packets
+bool Generator::write(size_t count) {
+  struct pcap_pkthdr header;
+
+  for (size_t i = 0; i < count; i++, _written++) {
+    // Packets are evenly spaced, at given rate
+    double offset = _written / _profile.rate;
+    header.ts.tv_sec = START + (time_t)offset;
+    header.ts.tv_usec = (offset - (time_t)offset) * 1000000;
+
+    // Active window of hosts moves forward at churn rate
+    _joined = _profile.hosts + (size_t)(offset * _profile.churn);
+
+    // Choose kind of packet
+    size_t host = pickHost();
+    size_t len;
+    uint32_t kind = _random() % 100;
+    if (kind < (uint32_t)_profile.arp) {
+      len = forgeArp(host, pickHost(), kind % 2);
+    }
+    else if (kind < (uint32_t)(_profile.arp + _profile.icmp)) {
+      // Unreachable messages are about hosts which already left, if any
+      switch (_random() % 5) {
+        case 0:
+          len = forgeUnreachable(host, _random() % (_joined -
+              _profile.hosts + 1));
+          break;
+
+        case 1:
+        case 2:
+          len = forgeEcho(host, false);
+          break;
+
+        default:
+          len = forgeEcho(host, true);
+          break;
+      }
+    }
+    else {
+      len = forgeIp(host);
+    }
+
+    // Short frames are padded, as on the wire
+    if (len < MIN_FRAME) {
+      memset(_frame + len, 0, MIN_FRAME - len);
+      len = MIN_FRAME;
+    }
+    header.caplen = header.len = len;
+    pcap_dump((u_char*)_dumper, &header, _frame);
+  }
+
+  if (pcap_dump_flush(_dumper) == -1) {
+    cerr << "ERROR - Can't write capture file" << endl;
+    return true;
+  }
+
+  return false;
+}
+
+// Closes output file
+bool Generator::close(void) {
+  bool error = false;
+
+  if (_dumper != NULL) {
+    error = (pcap_dump_flush(_dumper) == -1);
+    pcap_dump_close(_dumper);
+    _dumper = NULL;
+  }
+  if (_pcap != NULL) {
+    pcap_close(_pcap);
+    _pcap = NULL;
+  }
+
+  if (error) {
+    cerr << "ERROR - Can't write capture file" << endl;
+  }
+  return error;
+}
+
+// Returns number of hosts which joined network
+size_t Generator::getHosts(void) const {
+  return _joined;
+}
+
+// Ip address of some host. Hosts are spread round robin among prefixes,
+// skipping network, sniffing host and broadcast addresses. Addresses are
+// reused by newer hosts once prefix is full
+Ipv4Addr Generator::getIp(size_t host) const {
+  size_t count = _profile.prefixes.size();
+  const Prefix& prefix = _profile.prefixes[host % count];
+  return Ipv4Addr::fromHost(prefix.network.toHost() + 2 +
+      (host / count) % (prefix.size - 3));
+}
+
+// Mac address of some host, locally administered and unique
+MacAddr Generator::getMac(size_t host) const {
+  uint64_t value = (uint64_t)host + 1;
+  uint8_t octets[6] = {0x02, (uint8_t)(value >> 32), (uint8_t)(value >> 24),
+      (uint8_t)(value >> 16), (uint8_t)(value >> 8), (uint8_t)value};
+  return MacAddr(octets);
+}
+
+// VLAN of some host, or zero if frames are not tagged
+int Generator::getVlan(size_t host) const {
+  if (_profile.vlans.empty()) {
+    return 0;
+  }
+  return _profile.vlans[host % _profile.vlans.size()];
+}
+
+// Picks a random host of active window
+size_t Generator::pickHost(void) {
+  return _joined - _profile.hosts + _random() % _profile.hosts;
+}
+
+// Forge ARP request of some host asking for target, or reply of target
+size_t Generator::forgeArp(size_t host, size_t target, bool reply) {
+  MacAddr sender = getMac(reply ? target : host);
+  MacAddr dst = reply ? getMac(host) : MacAddr::BROADCAST;
+  size_t len = forgeEthernet(_frame, dst, sender, ETHERTYPE_ARP,
+      getVlan(host));
+
+  struct ether_arp* arp = (struct ether_arp*)(_frame + len);
+  arp->ea_hdr.ar_hrd = htons(ARPHRD_ETHER);
+  arp->ea_hdr.ar_pro = htons(ETHERTYPE_IP);
+  arp->ea_hdr.ar_hln = 6;
+  arp->ea_hdr.ar_pln = 4;
+  arp->ea_hdr.ar_op = htons(reply ? ARPOP_REPLY : ARPOP_REQUEST);
+
+  uint32_t spa = getIp(reply ? target : host).toNetwork();
+  uint32_t tpa = getIp(reply ? host : target).toNetwork();
+  memcpy(arp->arp_sha, sender.getOctets(), 6);
+  memcpy(arp->arp_spa, &spa, 4);
+  if (reply) {
+    memcpy(arp->arp_tha, dst.getOctets(), 6);
+  }
+  else {
+    memset(arp->arp_tha, 0, 6);
+  }
+  memcpy(arp->arp_tpa, &tpa, 4);
+
+  return len + sizeof(struct ether_arp);
+}
+
+// Forge ICMP echo request from sniffing host, or reply to it
+size_t Generator::forgeEcho(size_t host, bool reply) {
+  MacAddr dst = reply ? _own_mac : getMac(host);
+  MacAddr src = reply ? getMac(host) : _own_mac;
+  size_t len = forgeEthernet(_frame, dst, src, ETHERTYPE_IP,
+      getVlan(host));
+  len += forgeIpv4(_frame + len, reply ? getIp(host) : _own_ip,
+      reply ? _own_ip : getIp(host), IPPROTO_ICMP, ICMP_MINLEN);
+
+  struct icmphdr* icmp = (struct icmphdr*)(_frame + len);
+  icmp->type = reply ? ICMP_ECHOREPLY : ICMP_ECHO;
+  icmp->code = 0;
+  icmp->un.echo.id = htons(host);
+  icmp->un.echo.sequence = htons(1);
+  icmp->checksum = 0;
+  icmp->checksum = checksum(_frame + len, ICMP_MINLEN);
+
+  return len + ICMP_MINLEN;
+}
+
+// Forge ICMP host unreachable sent by some host to sniffing host, about an
+// echo request to target
+size_t Generator::forgeUnreachable(size_t host, size_t target) {
+  size_t len = forgeEthernet(_frame, _own_mac, getMac(host), ETHERTYPE_IP,
+      getVlan(host));
+  size_t payload = ICMP_MINLEN + sizeof(struct iphdr) + ICMP_MINLEN;
+  len += forgeIpv4(_frame + len, getIp(host), _own_ip, IPPROTO_ICMP,
+      payload);
+
+  // Original packet follows ICMP header
+  u_char* icmp = _frame + len;
+  struct icmphdr* header = (struct icmphdr*)icmp;
+  header->type = ICMP_DEST_UNREACH;
+  header->code = ICMP_HOST_UNREACH;
+  header->un.gateway = 0;
+  header->checksum = 0;
+
+  u_char* orig = icmp + ICMP_MINLEN;
+  size_t orig_len = forgeIpv4(orig, _own_ip, getIp(target), IPPROTO_ICMP,
+      ICMP_MINLEN);
+  struct icmphdr* probe = (struct icmphdr*)(orig + orig_len);
+  probe->type = ICMP_ECHO;
+  probe->code = 0;
+  probe->un.echo.id = htons(target);
+  probe->un.echo.sequence = htons(1);
+  probe->checksum = 0;
+  probe->checksum = checksum((u_char*)probe, ICMP_MINLEN);
+
+  header->checksum = checksum(icmp, payload);
+  return len + payload;
+}
+
+// Forge a TCP or UDP packet from some host, to another one or to a public
+// address
+size_t Generator::forgeIp(size_t host) {
+  size_t target = pickHost();
+  bool outside = (_random() % 100) < (uint32_t)PUBLIC_SHARE;
+  bool tcp = _random() % 10 < 7;
+
+  // Public addresses go through sniffing host, acting as gateway
+  Ipv4Addr dst = getIp(target);
+  MacAddr dst_mac = getMac(target);
+  if (outside) {
+    dst = Ipv4Addr::fromHost(0x08000000U + _random() % 0x01000000U);
+    dst_mac = _own_mac;
+  }
+
+  size_t len = forgeEthernet(_frame, dst_mac, getMac(host), ETHERTYPE_IP,
+      getVlan(host));
+  size_t payload = tcp ? sizeof(struct tcphdr) : sizeof(struct udphdr);
+  len += forgeIpv4(_frame + len, getIp(host), dst,
+      tcp ? IPPROTO_TCP : IPPROTO_UDP, payload);
+
+  // Ports and sequence numbers are random, checksums are left empty as
+  // swarm does not look at them
+  memset(_frame + len, 0, payload);
+  if (tcp) {
+    struct tcphdr* header = (struct tcphdr*)(_frame + len);
+    header->source = htons(1024 + _random() % 64512);
+    header->dest = htons(_random() % 2 ? 443 : 80);
+    header->seq = htonl(_random());
+    header->doff = 5;
+    header->ack = 1;
+  }
+  else {
+    struct udphdr* header = (struct udphdr*)(_frame + len);
+    header->source = htons(1024 + _random() % 64512);
+    header->dest = htons(_random() % 2 ? 53 : 123);
+    header->len = htons(payload);
+  }
+
+  return len + payload;
+}
+
+// Forge ethernet header, tagged if some VLAN is given
+size_t Generator::forgeEthernet(u_char* buf, const MacAddr& dst,
+    const MacAddr& src, uint16_t type, int vlan)
+{
+  size_t len = 0;
+  memcpy(buf, dst.getOctets(), 6);
+  memcpy(buf + 6, src.getOctets(), 6);
+  len = 12;
+
+  if (vlan != 0) {
+    uint16_t tag[2] = {htons(ETHERTYPE_VLAN), htons(vlan)};
+    memcpy(buf + len, tag, sizeof(tag));
+    len += sizeof(tag);
+  }
+
+  type = htons(type);
+  memcpy(buf + len, &type, sizeof(type));
+  return len + sizeof(type);
+}
+
+// Forge IPv4 header, without options
+size_t Generator::forgeIpv4(u_char* buf, const Ipv4Addr& src,
+    const Ipv4Addr& dst, uint8_t protocol, size_t payload)
+{
+  struct iphdr* iph = (struct iphdr*)buf;
+  iph->version = 4;
+  iph->ihl = 5;
+  iph->tos = 0;
+  iph->tot_len = htons(sizeof(struct iphdr) + payload);
+  iph->id = htons(_written);
+  iph->frag_off = htons(IP_DF);
+  iph->ttl = 64;
+  iph->protocol = protocol;
+  iph->saddr = src.toNetwork();
+  iph->daddr = dst.toNetwork();
+  iph->check = 0;
+  iph->check = checksum(buf, sizeof(struct iphdr));
+
+  return sizeof(struct iphdr);
+}
+
+// Computes internet checksum of some bytes
+uint16_t Generator::checksum(const u_char* buf, size_t len) {
+  uint32_t sum = 0;
+  for (size_t i = 0; i + 1 < len; i += 2) {
+    sum += (buf[i] << 8) | buf[i + 1];
+  }
+  if (len % 2) {
+    sum += buf[len - 1] << 8;
+  }
+  while (sum >> 16) {
+    sum = (sum & 0xFFFF) + (sum >> 16);
+  }
+  return htons(~sum);
+}
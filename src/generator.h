@@ -0,0 +1,192 @@
+/**
+ * Copyright 2013 Ezequiel Vázquez De la calle
+ *
+ * This file is part of Swarm.
+ *
+ * Swarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Swarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file Class Generator definition
+ */
+
+#ifndef _GENERATOR_H_
+#define _GENERATOR_H_
+
+  #include <cstdint>
+  #include <cstdlib>
+  #include <cstring>
+  #include <iostream>
+  #include <netinet/ether.h>
+  #include <netinet/ip.h>
+  #include <netinet/ip_icmp.h>
+  #include <netinet/tcp.h>
+  #include <netinet/udp.h>
+  #include <pcap.h>
+  #include <random>
+  #include <string>
+  #include <vector>
+
+  #include "ipv4addr.h"
+  #include "macaddr.h"
+  using namespace std;
+
+  /**
+   * Network prefix where simulated hosts live
+   */
+  struct Prefix {
+    Ipv4Addr network;
+    uint32_t size;
+  };
+
+  /**
+   * Settings of simulated traffic
+   */
+  struct TrafficProfile {
+    // Prefixes and VLANs where hosts are spread, round robin
+    vector<Prefix> prefixes;
+    vector<int> vlans;
+
+    // Hosts active at the same time
+    size_t hosts;
+
+    // Packets per second, and hosts replaced by new ones per second
+    double rate;
+    double churn;
+
+    // Percentage of ARP and ICMP packets. Remaining ones are TCP and UDP
+    int arp;
+    int icmp;
+
+    // Seed of random numbers. Same seed and settings give same capture
+    uint32_t seed;
+  };
+
+  /**
+   * Writes pcap files with synthetic traffic of a large network, so swarm
+   * can be load tested offline. Hosts are identified by an index, from
+   * which their ip address, mac address and VLAN are derived, and only a
+   * window of them is active at any time: window moves forward at churn
+   * rate, so old hosts leave and new ones join.
+   *
+   * Sniffing host has the first address of first prefix. It sends echo
+   * requests, and receives echo replies and unreachable messages; the
+   * rest of traffic are ARP requests and replies between hosts, and TCP
+   * and UDP packets between hosts or towards public addresses. Random
+   * numbers come from a Mersenne Twister, used without distributions, so
+   * captures are the same on every platform.
+   */
+  class Generator {
+    public:
+
+      // Percentage of ip packets sent to public addresses
+      static const int PUBLIC_SHARE = 10;
+
+      // Seconds since epoch of first packet, fixed so captures do not
+      // depend on time
+      static const time_t START = 1500000000;
+
+      // Bytes of shortest ethernet frame, without checksum
+      static const size_t MIN_FRAME = 60;
+
+      /**
+       * Constructor
+       * @param profile Settings of simulated traffic
+       */
+      Generator(const TrafficProfile& profile);
+
+      /**
+       * Destructor, closes output if still open
+       */
+      ~Generator(void);
+
+      /**
+       * Parses a prefix. Prefixes must leave room for two hosts, at least
+       * @param text Prefix as address and length, i.e. 10.0.0.0/8
+       * @param prefix Parsed prefix
+       * @return True if text is not a valid prefix, false either
+       */
+      static bool parsePrefix(const string& text, Prefix& prefix);
+
+      /**
+       * Opens output file
+       * @param file Path of pcap file, or "-" for standard output
+       * @return True if there was an error, false either
+       */
+      bool open(const string& file);
+
+      /**
+       * Writes some packets, following previous ones
+       * @param count Number of packets
+       * @return True if there was an error, false either
+       */
+      bool write(size_t count);
+
+      /**
+       * Closes output file
+       * @return True if there was an error, false either
+       */
+      bool close(void);
+
+      /**
+       * Returns number of hosts which joined network, until last packet
+       * @return Number of hosts
+       */
+      size_t getHosts(void) const;
+
+    private:
+      // Copy constructor and assign operator are private, as output file
+      // can not be shared
+      Generator(const Generator& generator);
+      Generator& operator=(const Generator& generator);
+
+      // Private functions which derive addresses of some host
+      Ipv4Addr getIp(size_t host) const;
+      MacAddr getMac(size_t host) const;
+      int getVlan(size_t host) const;
+
+      // Private function which picks a random host of active window
+      size_t pickHost(void);
+
+      // Private functions which forge each kind of packet on frame buffer,
+      // returning its length
+      size_t forgeArp(size_t host, size_t target, bool reply);
+      size_t forgeEcho(size_t host, bool reply);
+      size_t forgeUnreachable(size_t host, size_t target);
+      size_t forgeIp(size_t host);
+
+      // Private functions which forge headers on frame buffer, returning
+      // their length
+      size_t forgeEthernet(u_char* buf, const MacAddr& dst,
+          const MacAddr& src, uint16_t type, int vlan);
+      size_t forgeIpv4(u_char* buf, const Ipv4Addr& src,
+          const Ipv4Addr& dst, uint8_t protocol, size_t payload);
+
+      // Private function which computes internet checksum of some bytes
+      static uint16_t checksum(const u_char* buf, size_t len);
+
+      // Attributes
+      TrafficProfile _profile;
+      mt19937 _random;
+      pcap_t* _pcap;
+      pcap_dumper_t* _dumper;
+      u_char _frame[128];
+      size_t _written;
+      size_t _joined;
+      Ipv4Addr _own_ip;
+      MacAddr _own_mac;
+  };
+
+#endif
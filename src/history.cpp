@@ -0,0 +1,151 @@
+/**
+ * Copyright 2013 Ezequiel Vázquez De la calle
+ *
+ * This file is part of Swarm.
+ *
+ * Swarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Swarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file Class History method definition
+ */
+
+#include "history.h"
+#include "actions.h"
+#include "storage.h"
+using namespace std;
+
+History* History::_instance = 0;
+const int History::BUCKET;
+const int History::RETENTION;
+const int History::EXPIRE_INTERVAL;
+const size_t History::MAX_SIGHTINGS;
+
+// Constructor
+History::History(void) {
+  _started = false;
+  _bucket = BUCKET;
+  _retention = RETENTION;
+  _last_expire = 0;
+}
+
+// Destructor: does nothing
+History::~History(void) {
+}
+
+// Set bucket length and retention, and launch as thread
+void History::start(int bucket, int retention) {
+  _mutex.lock();
+  _bucket = max(bucket, 1);
+  _retention = max(retention, 0);
+  _started = true;
+  _mutex.unlock();
+
+  // Launch thread
+  thread t1(keepHistory);
+  t1.detach();
+}
+
+// Records a device was seen
+void History::seen(int id) {
+  record(id, SIGHTING_SEEN, string(), string());
+}
+
+// Records an event of some device
+void History::record(int id, int event, const string& old_value,
+    const string& new_value)
+{
+  time_t now = time(NULL);
+
+  lock_guard<mutex> lock(_mutex);
+  if (not _started) {
+    return;
+  }
+
+  Key key(now - now % _bucket, id, event);
+  Sightings::iterator it = _sightings.find(key);
+  if (it == _sightings.end()) {
+    Sighting sighting = {id, get<0>(key), event, old_value, new_value, 1};
+    _sightings.insert(pair<Key,Sighting>(key, sighting));
+  }
+  else {
+    it->second.new_value = new_value;
+    ++it->second.count;
+  }
+}
+
+// Wait until current bucket ends, and write its sightings
+void History::flush(void) {
+  Sightings sightings;
+
+  // Wake up just after bucket ends, so it is complete
+  time_t now = time(NULL);
+  this_thread::sleep_for(chrono::seconds(_bucket - now % _bucket));
+
+  // Take sightings of ended buckets only
+  _mutex.lock();
+  now = time(NULL);
+  Sightings::iterator end;
+  end = _sightings.lower_bound(Key(now - now % _bucket, 0, 0));
+  sightings.insert(_sightings.begin(), end);
+  _sightings.erase(_sightings.begin(), end);
+  _mutex.unlock();
+
+  // Sightings are sorted by bucket, so they are appended in time order
+  vector<Sighting> batch;
+  batch.reserve(sightings.size());
+  Sightings::const_iterator it;
+  for (it = sightings.begin(); it != sightings.end(); ++it) {
+    batch.push_back(it->second);
+  }
+
+  // Sightings which could not be written are kept for next flush
+  if (not batch.empty() and storage->writeSightings(batch)) {
+    cerr << "ERROR - Can not write " << batch.size() << " sightings" << endl;
+    requeue(sightings);
+  }
+
+  // Remove expired sightings from time to time
+  if (_retention > 0 and now - _last_expire >= EXPIRE_INTERVAL) {
+    if (storage->expireSightings(now - _retention * 86400)) {
+      cerr << "ERROR - Can not remove expired sightings" << endl;
+    }
+    _last_expire = now;
+  }
+}
+
+// Queues again sightings which could not be written
+void History::requeue(Sightings& failed) {
+  lock_guard<mutex> lock(_mutex);
+
+  // Memory must not grow while storage keeps failing, so oldest sightings
+  // are dropped if there are too many
+  Sightings::const_iterator it = failed.begin();
+  size_t room = MAX_SIGHTINGS - min(_sightings.size(), MAX_SIGHTINGS);
+  if (failed.size() > room) {
+    cerr << "ERROR - Dropping " << failed.size() - room << " sightings" <<
+        endl;
+    advance(it, failed.size() - room);
+  }
+
+  // Sightings recorded meanwhile for the same key are newer, so they keep
+  // their last value
+  for (; it != failed.end(); ++it) {
+    pair<Sightings::iterator,bool> result = _sightings.insert(*it);
+    if (not result.second) {
+      result.first->second.old_value = it->second.old_value;
+      result.first->second.count += it->second.count;
+    }
+  }
+}
@@ -0,0 +1,165 @@
+/**
+ * Copyright 2013 Ezequiel Vázquez De la calle
+ *
+ * This file is part of Swarm.
+ *
+ * Swarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Swarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file Class History definition
+ */
+
+#ifndef _HISTORY_H_
+#define _HISTORY_H_
+
+  #include <chrono>
+  #include <condition_variable>
+  #include <ctime>
+  #include <iostream>
+  #include <map>
+  #include <mutex>
+  #include <string>
+  #include <thread>
+  #include <tuple>
+  #include <vector>
+
+  #include "pool.h"
+  using namespace std;
+
+  // Kinds of sightings
+  enum SightingEvent {
+    SIGHTING_NEW = 0,
+    SIGHTING_SEEN = 1,
+    SIGHTING_MAC = 2,
+    SIGHTING_REACHABLE = 3
+  };
+
+  // Events of a device during a time bucket. Repeated events are counted,
+  // keeping first old value and last new value
+  struct Sighting {
+    int device;
+    time_t bucket;
+    int event;
+    string old_value;
+    string new_value;
+    int count;
+  };
+
+  /**
+   * Singleton object which keeps history of devices: when they were seen,
+   * and when their attributes changed. Events are aggregated by device and
+   * time bucket in memory, so there is no write per packet, and each
+   * bucket is appended to storage as a single batch once it ends
+   */
+  class History {
+    public:
+
+      // Default seconds covered by each bucket
+      static const int BUCKET = 60;
+
+      // Default days sightings are kept. Zero keeps them forever
+      static const int RETENTION = 30;
+
+      // Seconds between two removals of expired sightings
+      static const int EXPIRE_INTERVAL = 3600;
+
+      // Sightings kept in memory while they can not be written. Oldest
+      // ones are dropped beyond it
+      static const size_t MAX_SIGHTINGS = 262144;
+
+      /**
+       * Implementation of Singleton pattern
+       * @return Pointer to singleton history object
+       */
+      static History* getInstance(void) {
+        if (_instance == 0) {
+          _instance = new History();
+        }
+        return _instance;
+      }
+
+      /**
+       * Destroyer for singleton history object
+       */
+      static void destroy(void) {
+        delete _instance;
+      }
+
+      /**
+       * Initialize history object, and launch as thread. Events are not
+       * recorded until started
+       * @param bucket Seconds covered by each bucket
+       * @param retention Days sightings are kept, or zero to keep them
+       */
+      void start(int bucket = BUCKET, int retention = RETENTION);
+
+      /**
+       * Records a device was seen on some packet
+       * @param id Identifier of device
+       */
+      void seen(int id);
+
+      /**
+       * Records an event of some device
+       * @param id Identifier of device
+       * @param event Kind of event, as SightingEvent value
+       * @param old_value Value before event
+       * @param new_value Value after event
+       */
+      void record(int id, int event, const string& old_value,
+          const string& new_value);
+
+      /**
+       * Wait until current bucket ends, write its sightings, and remove
+       * expired ones from time to time
+       */
+      void flush(void);
+
+    protected:
+      // Constructor, destructor, copy constructor and assing operator
+      // are protected due to singleton pattern implementation
+      History(void);
+      ~History(void);
+      History(const History& history);
+      History& operator=(const History& history);
+
+    private:
+      // Sightings are aggregated by bucket, device and event
+      typedef tuple<time_t,int,int> Key;
+
+      // Sightings by key. Nodes come from a pool, as they are added while
+      // capturing and removed once their bucket is written
+      typedef map<Key,Sighting,less<Key>,
+          PoolAllocator<pair<const Key,Sighting> > > Sightings;
+
+      // Private function which queues again sightings which could not be
+      // written, merging them with those recorded meanwhile
+      void requeue(Sightings& failed);
+
+      // Attributes
+      bool _started;
+      int _bucket;
+      int _retention;
+      time_t _last_expire;
+      mutex _mutex;
+      static History* _instance;
+
+      // Sightings of buckets not written yet
+      Sightings _sightings;
+  };
+
+  #define history History::getInstance()
+
+#endif
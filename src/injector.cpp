@@ -24,325 +24,156 @@
 #include "injector.h"
 using namespace std;
 
-Injector* Injector::_instance = 0;
+const size_t Injector::CHUNK_SIZE;
+const int Injector::RETRY;
 
 // Constructor
-Injector::Injector(void) {
-  _handler = NULL;
+Injector::Injector(int index) {
   _initialized = false;
-  _eth_arp_tag = LIBNET_PTAG_INITIALIZER;
-  _arp_tag = LIBNET_PTAG_INITIALIZER;
-  _eth_ip_tag = LIBNET_PTAG_INITIALIZER;
-  _ip_tag = LIBNET_PTAG_INITIALIZER;
-  _icmp_tag = LIBNET_PTAG_INITIALIZER;
+  _index = index;
 }
 
 // Destructor
 Injector::~Injector(void) {
-  libnet_destroy(_handler);
+  for (size_t i = 0; i < _workers.size(); ++i) {
+    delete _workers[i];
+  }
 }
 
-// Initialize injector object, and launch as thread
-void Injector::start(string& iface, string spoof) {
-  string errbuf;
-
+// Initialize injector object and its workers, and launch as thread
+void Injector::start(string& iface, Ipv4Addr spoof, int workers) {
   // Do not initialize twice
   if (_initialized) {
     return;
   }
 
-  // Initialize libnet handler
-  _handler = libnet_init(LIBNET_LINK, (char*)iface.c_str(),
-      (char*)errbuf.c_str());
-  if (_handler == NULL) {
-    cerr << "ERROR - Libnet couldn't be initialized" << endl;
-    cerr << errbuf << endl;
-    exit(EXIT_FAILURE);
+  // Save interface, and spoof ip address if received
+  _iface = iface;
+  _spoof_ip = spoof;
+
+  // By default, launch one worker per core
+  if (workers <= 0) {
+    workers = max(1U, thread::hardware_concurrency());
   }
 
-  // If spoof ip address received, save it
-  if (not spoof.empty()) {
-    _spoof_ip = spoof;
+  // Launch workers, each one with its own libnet context
+  for (int i = 0; i < workers; ++i) {
+    Worker* worker = new Worker();
+    if (worker->start(iface, _spoof_ip)) {
+      cerr << "ERROR - Can't launch injection worker for interface ";
+      cerr << iface << endl;
+      exit(EXIT_FAILURE);
+    }
+    _workers.push_back(worker);
   }
 
-  // Get own ip address from libnet handler
-  u_int32_t ip_addr = libnet_get_ipaddr4(_handler);
-  if (ip_addr < 0) {
+  // Get own ip address from libnet handler of first worker
+  libnet_t* handler = _workers.front()->getHandler();
+  u_int32_t ip_addr = libnet_get_ipaddr4(handler);
+  if (ip_addr == (u_int32_t)-1) {
     cerr << "ERROR - libnet can not determine ip address for interface ";
-    cerr << iface << endl << libnet_geterror(_handler) << endl;
+    cerr << iface << endl << libnet_geterror(handler) << endl;
     exit(EXIT_FAILURE);
   }
 
   // Save own ip address to private attribute
-  _ip = libnet_addr2name4(ip_addr, LIBNET_DONT_RESOLVE);
+  _ip = Ipv4Addr::fromNetwork(ip_addr);
 
   // Get own mac address from libnet handler
-  struct libnet_ether_addr* mac_addr = libnet_get_hwaddr(_handler);
+  struct libnet_ether_addr* mac_addr = libnet_get_hwaddr(handler);
   if (mac_addr == NULL) {
     cerr << "ERROR - libnet can not determine mac address for interface ";
-    cerr << iface << endl << libnet_geterror(_handler) << endl;
+    cerr << iface << endl << libnet_geterror(handler) << endl;
     exit(EXIT_FAILURE);
   }
 
   // Save own mac address to private attribute
-  stringstream ss;
-  for (int i = 0; i < 5; ++i) {
-    ss << setfill('0') << setw(2) << uppercase << hex;
-    ss << (int)mac_addr->ether_addr_octet[i] << ":";
-  }
-  ss << setfill('0') << setw(2) << uppercase << hex;
-  ss << (int)mac_addr->ether_addr_octet[5];
-  _mac = ss.str();
+  _mac = MacAddr(mac_addr->ether_addr_octet);
 
   // Launch thread
   _initialized = true;
-  thread t1(inject);
+  thread t1(inject, this);
   t1.detach();
 }
 
 // Inject ARP request to find MAC address
-void Injector::injectArpRequest(const string& target) {
-  u_int32_t src_ip_addr;
-  u_int32_t dst_ip_addr;
-  u_int8_t broadcast[6] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
-  u_int8_t mac_zero_addr[6] = {0x0, 0x0, 0x0, 0x0, 0x0, 0x0};
-  struct libnet_ether_addr *src_mac_addr;
-
-  // Use spoofed ip address, if defined
-  string src_ip = _ip;
-  if (not _spoof_ip.empty()) {
-    src_ip = _spoof_ip;
-  }
-
-  // Get source IP address
-  src_ip_addr = libnet_name2addr4(_handler, (char*)src_ip.c_str(),
-      LIBNET_DONT_RESOLVE);
-  if (src_ip_addr < 0) {
-    cerr << "ERROR - Can not determine source ip address for ARP request ";
-    cerr << endl << libnet_geterror(_handler) << endl;
-    return;
-  }
-
-  // Get destination IP address
-  dst_ip_addr = libnet_name2addr4(_handler, (char*)target.c_str(),
-      LIBNET_DONT_RESOLVE);
-  if (dst_ip_addr < 0) {
-    cerr << "ERROR - Can not determine target ip address for ARP request ";
-    cerr << endl << libnet_geterror(_handler) << endl;
-    return;
-  }
-
-  // Get source MAC address
-  src_mac_addr = libnet_get_hwaddr(_handler);
-  if (src_mac_addr == NULL) {
-    cerr << "ERROR - Can not determine source mac address for ARP request ";
-    cerr << endl << libnet_geterror(_handler) << endl;
-    return;
-  }
-
-  // Build ARP request header
-  _arp_tag = libnet_build_arp(ARPHRD_ETHER, ETHERTYPE_IP, 6, 4, ARPOP_REQUEST,
-      src_mac_addr->ether_addr_octet, (u_int8_t*)(&src_ip_addr), mac_zero_addr,
-      (u_int8_t*)(&dst_ip_addr), NULL, 0, _handler, _arp_tag);
-  if (_arp_tag == -1) {
-    cerr << "ERROR - Can't build ARP header for target ip " << target << endl;
-    cerr << libnet_geterror(_handler) << endl;
-    return;
-  }
-
-  // Build ethernet header
-  _eth_arp_tag = libnet_build_ethernet(broadcast, src_mac_addr->ether_addr_octet,
-      ETHERTYPE_ARP, NULL, 0, _handler, _eth_arp_tag);
-  if (_eth_arp_tag == -1) {
-    cerr << "ERROR - Can't build eth header for target ip " << target << endl;
-    cerr << libnet_geterror(_handler) << endl;
-    return;
-  }
-
-  // Writing packet to interface
-  if (libnet_write(_handler) == -1) {
-    cerr << "ERROR - Can't write packet to interface" << endl;
-    cerr << libnet_geterror(_handler) << endl;
-  }
+void Injector::injectArpRequest(const Ipv4Addr& target) {
+  Probe probe = {PROBE_ARP_REQUEST, target, MacAddr()};
+  dispatch(probe);
 }
 
 // Inject ARP response to perform IP spoofing
-void Injector::injectArpSpoofResponse(const string& ip, const string& mac) {
-  u_int32_t src_ip_addr;
-  u_int32_t dst_ip_addr;
-  struct libnet_ether_addr *src_mac_addr;
-  struct libnet_ether_addr *dst_mac_addr;
-
-  // Use spoofed ip address, if defined
-  string src_ip = _ip;
-  if (not _spoof_ip.empty()) {
-    src_ip = _spoof_ip;
-  }
-
-  // Get source IP address
-  src_ip_addr = libnet_name2addr4(_handler, (char*)src_ip.c_str(),
-      LIBNET_DONT_RESOLVE);
-  if (src_ip_addr < 0) {
-    cerr << "ERROR - Can not determine source ip address for ARP response";
-    cerr << endl << libnet_geterror(_handler) << endl;
-    return;
-  }
-
-  // Get destination IP address
-  dst_ip_addr = libnet_name2addr4(_handler, (char*)ip.c_str(),
-      LIBNET_DONT_RESOLVE);
-  if (dst_ip_addr < 0) {
-    cerr << "ERROR - Can not determine target ip address for ARP response";
-    cerr << endl << libnet_geterror(_handler) << endl;
-    return;
-  }
-
-  // Get source MAC address
-  src_mac_addr = libnet_get_hwaddr(_handler);
-  if (src_mac_addr == NULL) {
-    cerr << "ERROR - Can not determine source mac address for ARP response";
-    cerr << endl << libnet_geterror(_handler) << endl;
-    return;
-  }
-
-  // Get destination MAC address
-  dst_mac_addr = (libnet_ether_addr*)ether_aton((char*)mac.c_str());
-  if (dst_mac_addr == NULL) {
-    cerr << "ERROR - Can not determine source mac address for ARP response";
-    cerr << endl << libnet_geterror(_handler) << endl;
-    return;
-  }
-
-  // Build ARP response header
-  _arp_tag = libnet_build_arp(ARPHRD_ETHER, ETHERTYPE_IP, 6, 4, ARPOP_REPLY,
-      src_mac_addr->ether_addr_octet, (u_int8_t*)(&src_ip_addr),
-      dst_mac_addr->ether_addr_octet, (u_int8_t*)(&dst_ip_addr), NULL, 0,
-      _handler, _arp_tag);
-  if (_arp_tag == -1) {
-    cerr << "ERROR - Can't build ARP header for target ip " << ip << endl;
-    cerr << libnet_geterror(_handler) << endl;
-    return;
-  }
-
-  // Build ethernet header
-  _eth_arp_tag = libnet_build_ethernet(dst_mac_addr->ether_addr_octet,
-      src_mac_addr->ether_addr_octet, ETHERTYPE_ARP, NULL, 0, _handler,
-      _eth_arp_tag);
-  if (_eth_arp_tag == -1) {
-    cerr << "ERROR - Can't build eth header for target ip " << ip << endl;
-    cerr << libnet_geterror(_handler) << endl;
-    return;
-  }
-
-  // Writing packet to interface
-  if (libnet_write(_handler) == -1) {
-    cerr << "ERROR - Can't write packet to interface" << endl;
-    cerr << libnet_geterror(_handler) << endl;
-  }
+void Injector::injectArpSpoofResponse(const Ipv4Addr& ip,
+    const MacAddr& mac)
+{
+  Probe probe = {PROBE_ARP_SPOOF, ip, mac};
+  dispatch(probe);
 }
 
 // Inject ICMP echo request to find reachability
-void Injector::injectIcmp(const string& ip, const string& mac) {
-  u_int32_t src_ip_addr;
-  u_int32_t dst_ip_addr;
-  struct libnet_ether_addr *src_mac_addr;
-  struct libnet_ether_addr *dst_mac_addr;
-  u_int16_t id;
-  u_int16_t seq;
-
-  // Generating a random id
-  libnet_seed_prand(_handler);
-  id = (u_int16_t)libnet_get_prand(LIBNET_PR16);
-
-  // Get source MAC address
-  src_mac_addr = libnet_get_hwaddr(_handler);
-  if (src_mac_addr == NULL) {
-    cerr << "ERROR - Can not determine source mac address for ICMP request";
-    cerr << endl << libnet_geterror(_handler) << endl;
-    return;
-  }
-
-  // Use spoofed ip address, if defined
-  string src_ip = _ip;
-  if (not _spoof_ip.empty()) {
-    src_ip = _spoof_ip;
-  }
-
-  // Get source IP address
-  src_ip_addr = libnet_name2addr4(_handler, (char*)src_ip.c_str(),
-      LIBNET_DONT_RESOLVE);
-  if (src_ip_addr < 0) {
-    cerr << "ERROR - Can not determine source ip address for ICMP request";
-    cerr << endl << libnet_geterror(_handler) << endl;
-    return;
-  }
-
-  // Get destination MAC address
-  dst_mac_addr = (struct libnet_ether_addr*)ether_aton(mac.c_str());
-  if (dst_mac_addr == NULL) {
-    cerr << "ERROR - Can not determine target mac address for ICMP request";
-    cerr << endl << libnet_geterror(_handler) << endl;
-    return;
-  }
-
-  // Get destination IP address
-  dst_ip_addr = libnet_name2addr4(_handler, (char*)ip.c_str(),
-      LIBNET_DONT_RESOLVE);
-  if (dst_ip_addr < 0) {
-    cerr << "ERROR - Can't determine target ip address for ICMP echo request";
-    cerr << endl << libnet_geterror(_handler) << endl;
-    return;
-  }
+void Injector::injectIcmp(const Ipv4Addr& ip, const MacAddr& mac) {
+  Probe probe = {PROBE_ICMP_ECHO, ip, mac};
+  dispatch(probe);
+}
 
-  // Build ICMP header
-  seq = 1;
-  _icmp_tag = libnet_build_icmpv4_echo(ICMP_ECHO, 0, 0, id, seq, NULL, 0,
-      _handler, _icmp_tag);
-  if (_icmp_tag == -1) {
-    cerr << "ERROR - Can't build icmp echo request for ip " << ip << endl;
-    cerr << libnet_geterror(_handler) << endl;
-    return;
-  }
+// Checks if a device was probed recently, noting it is probed now otherwise
+bool Injector::probed(const Ipv4Addr& ip) {
+  chrono::steady_clock::time_point now = chrono::steady_clock::now();
 
-  // Build IPv4 header
-  _ip_tag = libnet_build_ipv4(LIBNET_IPV4_H + LIBNET_ICMPV4_ECHO_H, 0, 0, 0,
-      127, IPPROTO_ICMP, 0, src_ip_addr, dst_ip_addr, NULL, 0, _handler,
-      _ip_tag);
-  if (_ip_tag == -1) {
-    cerr << "ERROR - Can't build ipv4 header for ip " << ip << endl;
-    cerr << libnet_geterror(_handler) << endl;
-    return;
+  pair<unordered_map<Ipv4Addr,chrono::steady_clock::time_point>::iterator,
+      bool> result = _probed.insert(make_pair(ip, now));
+  if (not result.second) {
+    if (now - result.first->second < chrono::seconds(RETRY)) {
+      return true;
+    }
+    result.first->second = now;
   }
+  return false;
+}
 
-  // Build ethernet header
-  _eth_ip_tag = libnet_build_ethernet(dst_mac_addr->ether_addr_octet,
-      src_mac_addr->ether_addr_octet, ETHERTYPE_IP, NULL, 0, _handler,
-      _eth_ip_tag);
-  if (_eth_ip_tag == -1) {
-    cerr << "ERROR - Can't build eth header for target ip " << ip << endl;
-    cerr << libnet_geterror(_handler) << endl;
-    return;
-  }
+// Forgets devices probed long ago
+void Injector::expire(void) {
+  chrono::steady_clock::time_point now = chrono::steady_clock::now();
 
-  // Writing packet to interface
-  if (libnet_write(_handler) == -1) {
-    cerr << "ERROR - Can't write packet to interface" << endl;
-    cerr << libnet_geterror(_handler) << endl;
+  unordered_map<Ipv4Addr,chrono::steady_clock::time_point>::iterator it;
+  for (it = _probed.begin(); it != _probed.end();) {
+    if (now - it->second >= chrono::seconds(RETRY)) {
+      it = _probed.erase(it);
+    }
+    else {
+      ++it;
+    }
   }
 }
 
 // Spoofed ip address getter
-const string& Injector::getSpoofIp(void) const {
+const Ipv4Addr& Injector::getSpoofIp(void) const {
   return _spoof_ip;
 }
 
 // Ip address getter
-const string& Injector::getIp(void) const {
+const Ipv4Addr& Injector::getIp(void) const {
   return _ip;
 }
 
 // Mac address getter
-const string& Injector::getMac(void) const {
+const MacAddr& Injector::getMac(void) const {
   return _mac;
 }
 
+// Capture interface index getter
+int Injector::getIndex(void) const {
+  return _index;
+}
+
+// Injection interface name getter
+const string& Injector::getInterface(void) const {
+  return _iface;
+}
+
+
+// Queue a probe on worker which owns its target
+void Injector::dispatch(const Probe& probe) {
+  size_t i = hash<Ipv4Addr>()(probe.ip) % _workers.size();
+  _workers[i]->push(probe);
+}
@@ -18,116 +18,147 @@
  */
 
 /**
- * @file Class Injector definition. Singleton pattern implementation
+ * @file Class Injector definition
  */
 
 #ifndef _INJECTOR_H_
 #define _INJECTOR_H_
 
-  #include <iomanip>
+  #include <chrono>
   #include <iostream>
   #include <libnet.h>
   #include <netinet/ether.h>
   #include <string>
   #include <thread>
+  #include <unordered_map>
+  #include <vector>
 
   #include "actions.h"
   #include "monitor.h"
+  #include "worker.h"
   using namespace std;
 
   /**
-   * Singleton object which reads devices from monitor, and injects packets
-   * to some interface to try to guess device information. Uses libnet.
+   * Reads devices from monitor, and injects packets to some interface to
+   * try to guess device information. Uses libnet. There is an injector per
+   * capture interface, which only probes devices found on it.
+   * Packets are forged by a pool of workers; all packets for the same target
+   * are sent by the same worker, so they keep their order.
    */
   class Injector {
     public:
 
+      // Number of devices copied from monitor at once
+      static const size_t CHUNK_SIZE = 1024;
+
+      // Seconds before probing again a device which did not answer
+      static const int RETRY = 30;
+
       /**
-       * Implementation of Singleton pattern
-       * @return Pointer to singleton injector object
+       * Constructor
+       * @param index Index of capture interface whose devices are probed
        */
-      static Injector* getInstance(void) {
-        if (_instance == 0) {
-          _instance = new Injector();
-        }
-        return _instance;
-      }
+      explicit Injector(int index = 0);
 
       /**
-       * Destroyer for singleton injector object
+       * Destructor
        */
-      static void destroy(void) {
-        delete _instance;
-      }
+      ~Injector(void);
 
       /**
-       * Initialize injector object, and launch as thread
+       * Initialize injector object and its workers, and launch as thread
        * @param iface Name of network interface on which inject packets
        * @param ip Optional ip address to perform ip spoofing
+       * @param workers Number of injection workers. Zero means one per core
        */
-      void start(string& iface, string ip = "");
+      void start(string& iface, Ipv4Addr ip = Ipv4Addr(), int workers = 0);
 
       /**
        * Inject ARP request to find MAC address
        * @param target Ip address of device whose mac address we want to guess
        */
-      void injectArpRequest(const string& target);
+      void injectArpRequest(const Ipv4Addr& target);
 
       /**
        * Inject ARP response to perform IP spoofing
        * @param ip Ip address of target which ARP table will be poisoned
        * @param mac Mac address of target which ARP table will be poisoned
        */
-      void injectArpSpoofResponse(const string& ip, const string& mac);
+      void injectArpSpoofResponse(const Ipv4Addr& ip, const MacAddr& mac);
 
       /**
        * Inject ICMP echo request to find reachability
        * @param ip Ip address of device whose reachability we want to guess
        * @param mac Mac address of device whose reachability we want to guess
        */
-      void injectIcmp(const string& ip, const string& mac);
+      void injectIcmp(const Ipv4Addr& ip, const MacAddr& mac);
+
+      /**
+       * Checks if a device was probed recently, noting it is probed now
+       * otherwise. Devices which do not answer are only probed again after
+       * RETRY seconds
+       * @param ip Ip address of device
+       * @return True if device was probed less than RETRY seconds ago,
+       * false either
+       */
+      bool probed(const Ipv4Addr& ip);
+
+      /**
+       * Forgets devices probed more than RETRY seconds ago
+       */
+      void expire(void);
 
       /**
        * Spoofed ip address getter
        * @return Spoofed ip address for inject interface
        */
-      const string& getSpoofIp(void) const;
+      const Ipv4Addr& getSpoofIp(void) const;
 
       /**
        * Own ip address getter
        * @return Ip address of interface on which we are injecting packets
        */
-      const string& getIp(void) const;
+      const Ipv4Addr& getIp(void) const;
 
       /**
        * Own mac address getter
        * @return Mac address of interface on which we are injecting packets
        */
-      const string& getMac(void) const;
+      const MacAddr& getMac(void) const;
 
-    protected:
-      // Constructor, destructor, copy constructor and assing operator
-      // are protected due to singleton pattern implementation
-      Injector(void);
-      ~Injector(void);
+      /**
+       * Capture interface index getter
+       * @return Index of capture interface whose devices are probed
+       */
+      int getIndex(void) const;
+
+      /**
+       * Injection interface name getter
+       * @return Name of interface on which we are injecting packets
+       */
+      const string& getInterface(void) const;
+
+    private:
+      // Copy constructor and assign operator are private, as each injector
+      // owns its workers
       Injector(const Injector& injector);
       Injector& operator=(const Injector& injector);
 
-    private:
-      string _spoof_ip;
-      string _ip;
-      string _mac;
-      libnet_ptag_t _eth_arp_tag;
-      libnet_ptag_t _arp_tag;
-      libnet_ptag_t _eth_ip_tag;
-      libnet_ptag_t _ip_tag;
-      libnet_ptag_t _icmp_tag;
-      libnet_t* _handler;
+      // Private function which queues a probe on its target's worker
+      void dispatch(const Probe& probe);
+
+      // Attributes
+      string _iface;
+      Ipv4Addr _spoof_ip;
+      Ipv4Addr _ip;
+      MacAddr _mac;
+      vector<Worker*> _workers;
       bool _initialized;
-      static Injector* _instance;
-  };
+      int _index;
 
-  #define injector Injector::getInstance()
+      // Last probe of each device, only used by injector thread
+      unordered_map<Ipv4Addr,chrono::steady_clock::time_point> _probed;
+  };
 
 #endif
 
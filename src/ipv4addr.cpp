@@ -0,0 +1,110 @@
+/**
+ * Copyright 2013 Ezequiel Vázquez De la calle
+ *
+ * This file is part of Swarm.
+ *
+ * Swarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Swarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file Implementation of Ipv4Addr class methods
+ */
+
+#include "ipv4addr.h"
+using namespace std;
+
+// Text of every octet value, with its length, built only once
+struct OctetTable {
+  char text[256][4];
+  size_t len[256];
+
+  OctetTable(void) {
+    for (int i = 0; i < 256; ++i) {
+      len[i] = snprintf(text[i], sizeof(text[i]), "%d", i);
+    }
+  }
+};
+
+// Constructor from dot separated text
+Ipv4Addr::Ipv4Addr(const string& text) : _addr(0) {
+  if (parse(text.c_str(), *this)) {
+    _addr = 0;
+  }
+}
+
+// Parses dot separated text
+bool Ipv4Addr::parse(const char* text, Ipv4Addr& addr) {
+  uint32_t value = 0;
+
+  for (int i = 0; i < 4; ++i) {
+    // Each octet has one to three digits, without leading zeros
+    if (*text < '0' or *text > '9') {
+      return true;
+    }
+
+    uint32_t octet = 0;
+    const char* start = text;
+    while (*text >= '0' and *text <= '9' and text - start < 3) {
+      octet = octet * 10 + (*text++ - '0');
+    }
+    if (octet > 255 or (*start == '0' and text - start > 1)) {
+      return true;
+    }
+    value = (value << 8) | octet;
+
+    // Octets are separated by dots, and text ends after last one
+    if (*text != (i < 3 ? '.' : '\0')) {
+      return true;
+    }
+    ++text;
+  }
+
+  addr._addr = value;
+  return false;
+}
+
+// Formats address as text, without allocations
+size_t Ipv4Addr::format(char* buf) const {
+  static const OctetTable table;
+  size_t len = 0;
+
+  if (empty()) {
+    buf[0] = '\0';
+    return 0;
+  }
+
+  for (int i = 0; i < 4; ++i) {
+    uint8_t octet = getOctet(i);
+    memcpy(buf + len, table.text[octet], table.len[octet]);
+    len += table.len[octet];
+    buf[len++] = '.';
+  }
+  buf[--len] = '\0';
+
+  return len;
+}
+
+// Formats address as text
+string Ipv4Addr::toString(void) const {
+  char buf[16];
+  size_t len = format(buf);
+  return string(buf, len);
+}
+
+// Writes an address as text to a stream
+ostream& operator<<(ostream& out, const Ipv4Addr& addr) {
+  char buf[16];
+  addr.format(buf);
+  return out << buf;
+}
@@ -0,0 +1,187 @@
+/**
+ * Copyright 2013 Ezequiel Vázquez De la calle
+ *
+ * This file is part of Swarm.
+ *
+ * Swarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Swarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file Class Ipv4Addr definition
+ */
+
+#ifndef _IPV4ADDR_H_
+#define _IPV4ADDR_H_
+
+  #include <arpa/inet.h>
+  #include <cstdint>
+  #include <cstdio>
+  #include <cstring>
+  #include <functional>
+  #include <iostream>
+  #include <string>
+
+  using namespace std;
+
+  /**
+   * IPv4 address as a four bytes value, so addresses are copied, compared
+   * and hashed without allocations. Address is kept on host byte order, so
+   * addresses sort numerically. Text is only parsed or formatted at the
+   * edges: command line, logs, and storage. Address 0.0.0.0 means no
+   * address, and is formatted as empty text
+   */
+  class Ipv4Addr {
+    public:
+      /**
+       * Constructor of an empty address
+       */
+      constexpr Ipv4Addr(void) : _addr(0) {}
+
+      /**
+       * Constructor from octets, in dot separated order
+       */
+      constexpr Ipv4Addr(uint8_t a, uint8_t b, uint8_t c, uint8_t d) :
+          _addr(((uint32_t)a << 24) | ((uint32_t)b << 16) |
+          ((uint32_t)c << 8) | (uint32_t)d) {}
+
+      /**
+       * Constructor from dot separated text. Invalid text gives an empty
+       * address
+       * @param text Address on dot separated decimals format
+       */
+      explicit Ipv4Addr(const string& text);
+
+      /**
+       * Builds an address from network byte order, as found on packets
+       * @param addr Address on network byte order
+       * @return Address
+       */
+      static Ipv4Addr fromNetwork(uint32_t addr) {
+        return Ipv4Addr(ntohl(addr), 0);
+      }
+
+      /**
+       * Builds an address from host byte order
+       * @param addr Address on host byte order
+       * @return Address
+       */
+      static constexpr Ipv4Addr fromHost(uint32_t addr) {
+        return Ipv4Addr(addr, 0);
+      }
+
+      /**
+       * Parses dot separated text, without allocations
+       * @param text Address on dot separated decimals format
+       * @param addr Parsed address
+       * @return True if text is not a valid address, false either
+       */
+      static bool parse(const char* text, Ipv4Addr& addr);
+
+      /**
+       * Returns address on network byte order, as used on packets
+       * @return Address on network byte order
+       */
+      uint32_t toNetwork(void) const {
+        return htonl(_addr);
+      }
+
+      /**
+       * Returns address on host byte order
+       * @return Address on host byte order
+       */
+      constexpr uint32_t toHost(void) const {
+        return _addr;
+      }
+
+      /**
+       * Returns an octet of address
+       * @param index Octet position, in dot separated order
+       * @return Octet value
+       */
+      constexpr uint8_t getOctet(int index) const {
+        return (_addr >> (24 - 8 * index)) & 0xFF;
+      }
+
+      /**
+       * Checks if address is empty
+       * @return True if address is 0.0.0.0, false either
+       */
+      constexpr bool empty(void) const {
+        return _addr == 0;
+      }
+
+      /**
+       * Checks if address is private. Based on IANA reserved private
+       * network ranges, discarding their broadcast addresses
+       * @return True if address is private, false if it's public
+       */
+      constexpr bool isPrivate(void) const {
+        return ((_addr & 0xFF000000U) == 0x0A000000U and
+            _addr != 0x0AFFFFFFU) or
+            ((_addr & 0xFFF00000U) == 0xAC100000U and
+            _addr != 0xAC1FFFFFU) or
+            ((_addr & 0xFFFF0000U) == 0xC0A80000U and
+            _addr != 0xC0A8FFFFU);
+      }
+
+      /**
+       * Formats address as text, without allocations
+       * @param buf Buffer of at least 16 bytes, null terminated on return
+       * @return Length of text
+       */
+      size_t format(char* buf) const;
+
+      /**
+       * Formats address as text
+       * @return Address on dot separated decimals format, or empty text
+       */
+      string toString(void) const;
+
+      // Comparison operators
+      constexpr bool operator==(const Ipv4Addr& other) const {
+        return _addr == other._addr;
+      }
+      constexpr bool operator!=(const Ipv4Addr& other) const {
+        return _addr != other._addr;
+      }
+      constexpr bool operator<(const Ipv4Addr& other) const {
+        return _addr < other._addr;
+      }
+
+    private:
+      // Private constructor from host byte order. Second parameter avoids
+      // mistaking it with network byte order
+      constexpr Ipv4Addr(uint32_t addr, int) : _addr(addr) {}
+
+      // Attributes
+      uint32_t _addr;
+  };
+
+  /**
+   * Writes an address as text to a stream
+   */
+  ostream& operator<<(ostream& out, const Ipv4Addr& addr);
+
+  /**
+   * Hash of an address, so it can be used as key of unordered containers
+   */
+  namespace std {
+    template<> struct hash<Ipv4Addr> {
+      size_t operator()(const Ipv4Addr& addr) const {
+        return hash<uint32_t>()(addr.toHost());
+      }
+    };
+  }
+
+#endif
@@ -0,0 +1,529 @@
+/**
+ * Copyright 2013 Ezequiel Vázquez De la calle
+ *
+ * This file is part of Swarm.
+ *
+ * Swarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Swarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file Implementation of JournalStorage class methods
+ */
+
+#include "journalstorage.h"
+using namespace std;
+
+const off_t JournalStorage::COMPACT_SIZE;
+const int JournalStorage::COMPACT_INTERVAL;
+
+// Bytes read from files at once while replaying
+static const size_t READ_SIZE = 1024 * 1024;
+
+// Largest valid record, so a corrupt length is not waited for forever
+static const size_t MAX_RECORD = 1024 * 1024;
+
+// Suffixes of snapshot file, and of log being compacted
+static const char* SNAPSHOT = ".snapshot";
+static const char* COMPACTING = ".compacting";
+
+// FNV-1a hash of some bytes, used as record checksum
+static uint32_t checksum(const char* buf, size_t len) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < len; ++i) {
+    hash = (hash ^ (unsigned char)buf[i]) * 16777619u;
+  }
+  return hash;
+}
+
+// Append a 32 bits integer to a buffer
+static void putInt(string& out, uint32_t value) {
+  out.append((const char*)&value, sizeof(value));
+}
+
+// Read a 32 bits integer from a buffer, if there are enough bytes left
+static bool getInt(const char* buf, size_t len, size_t& pos,
+    uint32_t& value)
+{
+  if (len - pos < sizeof(value)) {
+    return true;
+  }
+  memcpy(&value, buf + pos, sizeof(value));
+  pos += sizeof(value);
+  return false;
+}
+
+// Check if a record which can't be decoded is corrupt. It may only be a
+// write torn by a crash while it still reaches the end of read bytes
+static bool isCorrupt(const string& buf) {
+  size_t pos = 0;
+  uint32_t size;
+  if (getInt(buf.data(), buf.size(), pos, size)) {
+    return false;
+  }
+  return (size > MAX_RECORD or
+      buf.size() - pos > sizeof(uint32_t) + size);
+}
+
+// Constructor
+JournalStorage::JournalStorage(void) {
+  _fd = -1;
+  _last_id = 0;
+}
+
+// Destructor: close log file
+JournalStorage::~JournalStorage(void) {
+  if (_fd >= 0) {
+    close(_fd);
+    _fd = -1;
+  }
+}
+
+// Replay files to find last id, open log and launch compactor thread
+bool JournalStorage::init(const string& file) {
+  _file = file;
+
+  // A previous compaction may have been interrupted, so its log is replayed
+  // before current one
+  map<int,Device> devices;
+  off_t valid;
+  if (replay(_file + SNAPSHOT, devices) < 0 or
+      replay(_file + COMPACTING, devices) < 0 or
+      (valid = replay(_file, devices)) < 0)
+  {
+    return true;
+  }
+
+  if (not devices.empty()) {
+    _last_id = devices.rbegin()->first;
+  }
+
+  _fd = open(_file.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644);
+  if (_fd < 0) {
+    cerr << "ERROR - Can't open journal file " << _file << endl;
+    return true;
+  }
+
+  // Drop any incomplete record left by a crash, so next ones can be read
+  if (ftruncate(_fd, valid) < 0) {
+    cerr << "ERROR - Can't truncate journal file " << _file << endl;
+    return true;
+  }
+
+  // Launch thread
+  thread t1(&JournalStorage::run, this);
+  t1.detach();
+  return false;
+}
+
+// Returns highest device id stored
+bool JournalStorage::getLastId(int& id) {
+  lock_guard<mutex> lock(_mutex);
+  id = _last_id;
+  return false;
+}
+
+// Replays all files, and returns devices by ip
+bool JournalStorage::load(Devices& devices) {
+  map<int,Device> found;
+  if (replayAll(found)) {
+    return true;
+  }
+
+  // Newest devices first, so they are kept if some ip is repeated
+  map<int,Device>::reverse_iterator it;
+  for (it = found.rbegin(); it != found.rend(); ++it) {
+    it->second.clearDirty();
+    devices.insert(pair<Ipv4Addr,Device>(it->second.getIp(), it->second));
+  }
+
+  return false;
+}
+
+// Replays all files, and hands devices to a reader by id order
+bool JournalStorage::scan(DeviceReader& reader) {
+  map<int,Device> found;
+  if (replayAll(found)) {
+    return true;
+  }
+
+  map<int,Device>::iterator it;
+  for (it = found.begin(); it != found.end(); ++it) {
+    it->second.clearDirty();
+    if (reader.readDevice(it->second)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// Replays all files to find a device using its id
+bool JournalStorage::read(int id, Device& device) {
+  map<int,Device> found;
+  if (replayAll(found)) {
+    return true;
+  }
+
+  map<int,Device>::iterator it = found.find(id);
+  if (it == found.end()) {
+    return true;
+  }
+
+  device = it->second;
+  device.clearDirty();
+  return false;
+}
+
+// Appends a record per device with a single write
+bool JournalStorage::write(const vector<Device>& devices, int fields) {
+  string buf;
+  int last_id = 0;
+
+  if (devices.empty()) {
+    return false;
+  }
+
+  for (size_t i = 0; i < devices.size(); ++i) {
+    encode(buf, devices[i], fields);
+    last_id = max(last_id, devices[i].getId());
+  }
+
+  lock_guard<mutex> lock(_mutex);
+  _last_id = max(_last_id, last_id);
+
+  if (writeAll(_fd, buf)) {
+    cerr << "ERROR - Can't write journal file " << _file << endl;
+    return true;
+  }
+
+  return false;
+}
+
+// Appends a record to a buffer
+void JournalStorage::encode(string& out, const Device& device, int fields) {
+  string payload;
+
+  fields &= FIELD_ALL;
+  putInt(payload, device.getId());
+  putInt(payload, fields);
+
+  for (int i = 0; i < NUM_FIELDS; ++i) {
+    if (not (fields & (1 << i))) {
+      continue;
+    }
+
+    if (isInteger(i)) {
+      putInt(payload, getInteger(device, i));
+    }
+    else {
+      // Longer strings are truncated, as length takes 16 bits
+      string value = getText(device, i);
+      uint16_t len = min(value.size(), (size_t)UINT16_MAX);
+      payload.append((const char*)&len, sizeof(len));
+      payload.append(value.data(), len);
+    }
+  }
+
+  putInt(out, payload.size());
+  putInt(out, checksum(payload.data(), payload.size()));
+  out.append(payload);
+}
+
+// Reads a record from a buffer
+bool JournalStorage::decode(const char* buf, size_t len, size_t& pos,
+    Device& delta, int& fields)
+{
+  size_t cur = pos;
+  uint32_t size;
+  uint32_t sum;
+
+  if (getInt(buf, len, cur, size) or getInt(buf, len, cur, sum) or
+      size > len - cur or checksum(buf + cur, size) != sum)
+  {
+    return true;
+  }
+
+  // Payload is checked, so only its inner lengths must be validated
+  size_t end = cur + size;
+  uint32_t value;
+  if (getInt(buf, end, cur, value)) {
+    return true;
+  }
+  delta.setId(value);
+
+  if (getInt(buf, end, cur, value) or (value & ~FIELD_ALL)) {
+    return true;
+  }
+  fields = value;
+
+  for (int i = 0; i < NUM_FIELDS; ++i) {
+    int field = 1 << i;
+    if (not (fields & field)) {
+      continue;
+    }
+
+    if (isInteger(i)) {
+      if (getInt(buf, end, cur, value)) {
+        return true;
+      }
+
+      if (field == FIELD_HOPS) {
+        delta.setHops(value);
+      }
+      else if (field == FIELD_VLAN) {
+        delta.setVlan(value);
+      }
+      else {
+        delta.setReachable(value);
+      }
+      continue;
+    }
+
+    uint16_t length;
+    if (end - cur < sizeof(length)) {
+      return true;
+    }
+    memcpy(&length, buf + cur, sizeof(length));
+    cur += sizeof(length);
+    if (end - cur < length) {
+      return true;
+    }
+    string text(buf + cur, length);
+    cur += length;
+
+    switch (field) {
+      case FIELD_HOSTNAME:
+        delta.setHostname(text);
+        break;
+
+      case FIELD_DESCRIPTION:
+        delta.setDescription(text);
+        break;
+
+      case FIELD_MAC:
+        delta.setMac(MacAddr(text));
+        break;
+
+      case FIELD_SUBNET:
+        delta.setSubnetMask(Ipv4Addr(text));
+        break;
+
+      case FIELD_PATH:
+        delta.setPath(text);
+        break;
+
+      default:
+        delta.setIp(Ipv4Addr(text));
+    }
+  }
+
+  pos = end;
+  return false;
+}
+
+// Copies some attributes from a record to a device
+void JournalStorage::apply(Device& device, const Device& delta, int fields) {
+  device.setId(delta.getId());
+
+  if (fields & FIELD_HOSTNAME) {
+    device.setHostname(delta.getHostname());
+  }
+  if (fields & FIELD_DESCRIPTION) {
+    device.setDescription(delta.getDescription());
+  }
+  if (fields & FIELD_MAC) {
+    device.setMac(delta.getMac());
+  }
+  if (fields & FIELD_IP) {
+    device.setIp(delta.getIp());
+  }
+  if (fields & FIELD_SUBNET) {
+    device.setSubnetMask(delta.getSubnetMask());
+  }
+  if (fields & FIELD_HOPS) {
+    device.setHops(delta.getHops());
+  }
+  if (fields & FIELD_PATH) {
+    device.setPath(delta.getPath());
+  }
+  if (fields & FIELD_VLAN) {
+    device.setVlan(delta.getVlan());
+  }
+  if (fields & FIELD_REACHABLE) {
+    device.setReachable(delta.getReachable());
+  }
+}
+
+// Checks log size every few seconds, and compacts it if needed
+void JournalStorage::run(void) {
+  struct stat info;
+
+  while (1) {
+    this_thread::sleep_for(chrono::seconds(COMPACT_INTERVAL));
+
+    if (stat(_file.c_str(), &info) == 0 and info.st_size >= COMPACT_SIZE) {
+      compact();
+    }
+  }
+}
+
+// Folds snapshot and log into a new snapshot
+bool JournalStorage::compact(void) {
+  lock_guard<mutex> compact_lock(_compact_mutex);
+  string compacting = _file + SNAPSHOT + COMPACTING;
+  string old_log = _file + COMPACTING;
+  string snapshot = _file + SNAPSHOT;
+
+  // Move log aside and start a new one, so writers are not blocked while
+  // folding. A log left by an interrupted compaction is folded first
+  struct stat info;
+  if (stat(old_log.c_str(), &info) < 0) {
+    lock_guard<mutex> lock(_mutex);
+
+    if (rename(_file.c_str(), old_log.c_str()) < 0) {
+      cerr << "ERROR - Can't rotate journal file " << _file << endl;
+      return true;
+    }
+
+    int fd = open(_file.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644);
+    if (fd < 0) {
+      cerr << "ERROR - Can't open journal file " << _file << endl;
+      rename(old_log.c_str(), _file.c_str());
+      return true;
+    }
+    close(_fd);
+    _fd = fd;
+  }
+
+  map<int,Device> devices;
+  if (replay(snapshot, devices) < 0 or replay(old_log, devices) < 0) {
+    return true;
+  }
+
+  // Write a full record per device on a temporary file, and replace
+  // snapshot only when it is safely on disk
+  int fd = open(compacting.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    cerr << "ERROR - Can't create snapshot file " << compacting << endl;
+    return true;
+  }
+
+  string buf;
+  bool error = false;
+  map<int,Device>::iterator it;
+  for (it = devices.begin(); it != devices.end() and not error; ++it) {
+    encode(buf, it->second, FIELD_ALL);
+    if (buf.size() >= READ_SIZE) {
+      error = writeAll(fd, buf);
+      buf.clear();
+    }
+  }
+
+  if (error or writeAll(fd, buf) or fsync(fd) < 0) {
+    cerr << "ERROR - Can't write snapshot file " << compacting << endl;
+    close(fd);
+    unlink(compacting.c_str());
+    return true;
+  }
+  close(fd);
+
+  if (rename(compacting.c_str(), snapshot.c_str()) < 0) {
+    cerr << "ERROR - Can't replace snapshot file " << snapshot << endl;
+    return true;
+  }
+
+  unlink(old_log.c_str());
+  return false;
+}
+
+// Replays a file into devices by id
+off_t JournalStorage::replay(const string& file,
+    map<int,Device>& devices) const
+{
+  int fd = open(file.c_str(), O_RDONLY);
+  if (fd < 0) {
+    if (errno == ENOENT) {
+      return 0;
+    }
+    cerr << "ERROR - Can't open journal file " << file << endl;
+    return -1;
+  }
+
+  vector<char> chunk(READ_SIZE);
+  string buf;
+  off_t valid = 0;
+  ssize_t bytes;
+
+  // Stop on end of file, or on a record which can't be read and is followed
+  // by other bytes, as only the last one may have been torn by a crash
+  while ((bytes = ::read(fd, &chunk[0], chunk.size())) > 0) {
+    buf.append(&chunk[0], bytes);
+
+    size_t pos = 0;
+    Device delta;
+    int fields;
+    while (not decode(buf.data(), buf.size(), pos, delta, fields)) {
+      apply(devices[delta.getId()], delta, fields);
+    }
+    valid += pos;
+    buf.erase(0, pos);
+
+    if (isCorrupt(buf)) {
+      close(fd);
+      cerr << "ERROR - Corrupt record in journal file " << file <<
+          " at byte " << valid << endl;
+      return -1;
+    }
+  }
+
+  close(fd);
+  if (bytes < 0) {
+    cerr << "ERROR - Can't read journal file " << file << endl;
+    return -1;
+  }
+
+  if (not buf.empty()) {
+    cerr << "WARNING - Discarding incomplete record of " << file << endl;
+  }
+
+  return valid;
+}
+
+// Replays snapshot and all logs
+bool JournalStorage::replayAll(map<int,Device>& devices) const {
+  // Files are not moved while replaying
+  lock_guard<mutex> lock(_compact_mutex);
+
+  return (replay(_file + SNAPSHOT, devices) < 0 or
+      replay(_file + COMPACTING, devices) < 0 or
+      replay(_file, devices) < 0);
+}
+
+// Writes a whole buffer to a file
+bool JournalStorage::writeAll(int fd, const string& buf) {
+  size_t done = 0;
+
+  while (done < buf.size()) {
+    ssize_t bytes = ::write(fd, buf.data() + done, buf.size() - done);
+    if (bytes < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return true;
+    }
+    done += bytes;
+  }
+
+  return false;
+}
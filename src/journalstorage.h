@@ -0,0 +1,190 @@
+/**
+ * Copyright 2013 Ezequiel Vázquez De la calle
+ *
+ * This file is part of Swarm.
+ *
+ * Swarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Swarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file Class JournalStorage definition
+ */
+
+#ifndef _JOURNALSTORAGE_H_
+#define _JOURNALSTORAGE_H_
+
+  #include <algorithm>
+  #include <cerrno>
+  #include <chrono>
+  #include <cstdint>
+  #include <cstdio>
+  #include <cstring>
+  #include <fcntl.h>
+  #include <iostream>
+  #include <map>
+  #include <mutex>
+  #include <string>
+  #include <sys/stat.h>
+  #include <thread>
+  #include <unistd.h>
+  #include <vector>
+
+  #include "storage.h"
+  using namespace std;
+
+  /**
+   * Storage backend which appends binary records to a local log file, with
+   * no SQL at all. Each record holds changed attributes of a device, keyed
+   * by its id, and each write is a single sequential append. A background
+   * thread folds log into a snapshot once it grows too much, and startup
+   * replays snapshot and log. Records use host byte order, as files are
+   * only read by the same host.
+   *
+   * Record layout: payload length and payload checksum, as 32 bits
+   * unsigned integers, followed by payload: device id and mask of changed
+   * attributes as 32 bits integers, and then each changed attribute in
+   * DeviceField bit order. Integers take 32 bits, and strings take a 16
+   * bits length followed by their bytes.
+   */
+  class JournalStorage : public Storage {
+    public:
+
+      // Log size, in bytes, which triggers a compaction
+      static const off_t COMPACT_SIZE = 64 * 1024 * 1024;
+
+      // Seconds between two checks of log size
+      static const int COMPACT_INTERVAL = 10;
+
+      /**
+       * Constructor
+       */
+      JournalStorage(void);
+
+      /**
+       * Destructor, closes log file
+       */
+      ~JournalStorage(void);
+
+      /**
+       * Opens log, replaying snapshot and log to find last id used, and
+       * launches compactor thread. An incomplete record at the end of log,
+       * left by a crash, is discarded, but a corrupt record followed by
+       * others is an error
+       * @param file Path of log file. Snapshot uses same path, ending in
+       * .snapshot
+       * @return True if there was an error, false either
+       */
+      bool init(const string& file);
+
+      /**
+       * Returns highest device id stored
+       * @param id Highest id, or zero if there are no devices
+       * @return True if there was an error, false either
+       */
+      bool getLastId(int& id);
+
+      /**
+       * Replays snapshot and log, and returns all devices found
+       * @param devices Map where devices are inserted, by ip address
+       * @return True if there was an error, false either
+       */
+      bool load(Devices& devices);
+
+      /**
+       * Reads all stored devices one at a time, by id order. Files are
+       * replayed as a whole before, as records only hold changes
+       * @param reader Receiver of devices
+       * @return True if there was an error or reader stopped, false either
+       */
+      bool scan(DeviceReader& reader);
+
+      /**
+       * Replays snapshot and log to find a device using its id
+       * @param id Identifier of device to read
+       * @param device Device where read attributes are stored
+       * @return True if there was an error, or device was not found
+       */
+      bool read(int id, Device& device);
+
+      /**
+       * Appends a record for each device, using a single write
+       * @param devices Devices to write
+       * @param fields Mask of DeviceField values to write, same for all
+       * @return True if there was an error, false either
+       */
+      bool write(const vector<Device>& devices, int fields);
+
+      /**
+       * Appends a record to a buffer
+       * @param out Buffer where record is appended
+       * @param device Device to write
+       * @param fields Mask of DeviceField values to write
+       */
+      static void encode(string& out, const Device& device, int fields);
+
+      /**
+       * Reads a record from a buffer, checking it is complete and valid
+       * @param buf Buffer where record is read from
+       * @param len Length of buffer
+       * @param pos Position of record, moved to next record if valid
+       * @param delta Device where id and written attributes are stored
+       * @param fields Mask of DeviceField values found on record
+       * @return True if record is incomplete or corrupt, false either
+       */
+      static bool decode(const char* buf, size_t len, size_t& pos,
+          Device& delta, int& fields);
+
+      /**
+       * Copies some attributes from a record to a device
+       * @param device Device to update
+       * @param delta Device read from a record
+       * @param fields Mask of DeviceField values to copy
+       */
+      static void apply(Device& device, const Device& delta, int fields);
+
+    private:
+      // Copy constructor and assign operator are private, as log file can
+      // not be shared
+      JournalStorage(const JournalStorage& journal);
+      JournalStorage& operator=(const JournalStorage& journal);
+
+      // Private function which checks log size every few seconds, and
+      // compacts it if needed. Launch as thread
+      void run(void);
+
+      // Private function which folds snapshot and log into a new snapshot
+      bool compact(void);
+
+      // Private function which replays a file into devices by id. Returns
+      // number of valid bytes read, or -1 if file can't be read or holds a
+      // corrupt record before its end
+      off_t replay(const string& file, map<int,Device>& devices) const;
+
+      // Private function which replays snapshot and all logs
+      bool replayAll(map<int,Device>& devices) const;
+
+      // Private function which writes a whole buffer to a file
+      static bool writeAll(int fd, const string& buf);
+
+      // Attributes
+      string _file;
+      int _fd;
+      int _last_id;
+      mutex _mutex;
+
+      // Only one compaction or replay of old logs at a time
+      mutable mutex _compact_mutex;
+  };
+
+#endif
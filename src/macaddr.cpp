@@ -0,0 +1,120 @@
+/**
+ * Copyright 2013 Ezequiel Vázquez De la calle
+ *
+ * This file is part of Swarm.
+ *
+ * Swarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Swarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file Implementation of MacAddr class methods
+ */
+
+#include "macaddr.h"
+using namespace std;
+
+const MacAddr MacAddr::BROADCAST(0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF);
+
+// Digits used to format each half of a byte
+static const char HEX_DIGITS[] = "0123456789ABCDEF";
+
+// Value of an hexadecimal digit, or -1 if it's not a digit
+static int hexValue(char c) {
+  if (c >= '0' and c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' and c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' and c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+// Constructor from colon separated text
+MacAddr::MacAddr(const string& text) {
+  if (parse(text.c_str(), *this)) {
+    memset(_octets, 0, sizeof(_octets));
+  }
+}
+
+// Parses colon separated text. Octets may have one or two digits
+bool MacAddr::parse(const char* text, MacAddr& addr) {
+  uint8_t octets[6];
+
+  for (int i = 0; i < 6; ++i) {
+    int high = hexValue(*text++);
+    if (high < 0) {
+      return true;
+    }
+
+    int low = hexValue(*text);
+    if (low >= 0) {
+      octets[i] = (high << 4) | low;
+      ++text;
+    }
+    else {
+      octets[i] = high;
+    }
+
+    if (*text++ != (i < 5 ? ':' : '\0')) {
+      return true;
+    }
+  }
+
+  memcpy(addr._octets, octets, sizeof(octets));
+  return false;
+}
+
+// Checks if address is empty
+bool MacAddr::empty(void) const {
+  for (size_t i = 0; i < sizeof(_octets); ++i) {
+    if (_octets[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Formats address as text, without allocations
+size_t MacAddr::format(char* buf) const {
+  if (empty()) {
+    buf[0] = '\0';
+    return 0;
+  }
+
+  for (int i = 0; i < 6; ++i) {
+    buf[i * 3] = HEX_DIGITS[_octets[i] >> 4];
+    buf[i * 3 + 1] = HEX_DIGITS[_octets[i] & 0x0F];
+    buf[i * 3 + 2] = ':';
+  }
+  buf[17] = '\0';
+
+  return 17;
+}
+
+// Formats address as text
+string MacAddr::toString(void) const {
+  char buf[18];
+  size_t len = format(buf);
+  return string(buf, len);
+}
+
+// Writes an address as text to a stream
+ostream& operator<<(ostream& out, const MacAddr& addr) {
+  char buf[18];
+  addr.format(buf);
+  return out << buf;
+}
@@ -0,0 +1,142 @@
+/**
+ * Copyright 2013 Ezequiel Vázquez De la calle
+ *
+ * This file is part of Swarm.
+ *
+ * Swarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Swarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file Class MacAddr definition
+ */
+
+#ifndef _MACADDR_H_
+#define _MACADDR_H_
+
+  #include <cstdint>
+  #include <cstring>
+  #include <functional>
+  #include <iostream>
+  #include <string>
+
+  using namespace std;
+
+  /**
+   * MAC address as a six bytes value, so addresses are copied and compared
+   * without allocations. Text is only parsed or formatted at the edges:
+   * logs and storage. Address 00:00:00:00:00:00 means no address, and is
+   * formatted as empty text
+   */
+  class MacAddr {
+    public:
+      /**
+       * Constructor of an empty address
+       */
+      constexpr MacAddr(void) : _octets{0, 0, 0, 0, 0, 0} {}
+
+      /**
+       * Constructor from octets, in colon separated order
+       */
+      constexpr MacAddr(uint8_t a, uint8_t b, uint8_t c, uint8_t d,
+          uint8_t e, uint8_t f) : _octets{a, b, c, d, e, f} {}
+
+      /**
+       * Constructor from six bytes, as found on packets
+       * @param octets Address bytes
+       */
+      explicit MacAddr(const uint8_t* octets) {
+        memcpy(_octets, octets, sizeof(_octets));
+      }
+
+      /**
+       * Constructor from colon separated text. Invalid text gives an empty
+       * address
+       * @param text Address on colon separated hexadecimal format
+       */
+      explicit MacAddr(const string& text);
+
+      /**
+       * Parses colon separated text, without allocations
+       * @param text Address on colon separated hexadecimal format
+       * @param addr Parsed address
+       * @return True if text is not a valid address, false either
+       */
+      static bool parse(const char* text, MacAddr& addr);
+
+      /**
+       * Returns address bytes, as used on packets
+       * @return Pointer to six bytes
+       */
+      const uint8_t* getOctets(void) const {
+        return _octets;
+      }
+
+      /**
+       * Checks if address is empty
+       * @return True if all bytes are zero, false either
+       */
+      bool empty(void) const;
+
+      /**
+       * Formats address as text, without allocations
+       * @param buf Buffer of at least 18 bytes, null terminated on return
+       * @return Length of text
+       */
+      size_t format(char* buf) const;
+
+      /**
+       * Formats address as text
+       * @return Address on colon separated uppercase hexadecimal format, or
+       * empty text
+       */
+      string toString(void) const;
+
+      // Comparison operators
+      bool operator==(const MacAddr& other) const {
+        return memcmp(_octets, other._octets, sizeof(_octets)) == 0;
+      }
+      bool operator!=(const MacAddr& other) const {
+        return memcmp(_octets, other._octets, sizeof(_octets)) != 0;
+      }
+      bool operator<(const MacAddr& other) const {
+        return memcmp(_octets, other._octets, sizeof(_octets)) < 0;
+      }
+
+      // Broadcast address
+      static const MacAddr BROADCAST;
+
+    private:
+      // Attributes
+      uint8_t _octets[6];
+  };
+
+  /**
+   * Writes an address as text to a stream
+   */
+  ostream& operator<<(ostream& out, const MacAddr& addr);
+
+  /**
+   * Hash of an address, so it can be used as key of unordered containers
+   */
+  namespace std {
+    template<> struct hash<MacAddr> {
+      size_t operator()(const MacAddr& addr) const {
+        uint64_t value = 0;
+        memcpy(&value, addr.getOctets(), 6);
+        return hash<uint64_t>()(value);
+      }
+    };
+  }
+
+#endif
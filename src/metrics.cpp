@@ -0,0 +1,346 @@
+/**
+ * Copyright 2013 Ezequiel Vázquez De la calle
+ *
+ * This file is part of Swarm.
+ *
+ * Swarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Swarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file Class Metrics method definition
+ */
+
+#include "metrics.h"
+#include "actions.h"
+#include "conversations.h"
+#include "flusher.h"
+#include "monitor.h"
+#include "pool.h"
+#include "symbol.h"
+using namespace std;
+
+Metrics* Metrics::_instance = 0;
+const int Metrics::MAX_SHARDS;
+const int Metrics::NUM_BUCKETS;
+const int Metrics::INTERVAL;
+
+// Names and descriptions of counters, in MetricCounter order
+static const char* COUNTER_NAMES[NUM_COUNTERS][2] = {
+  {"swarm_packets_total", "Packets captured"},
+  {"swarm_packets_dropped_total", "Packets dropped by kernel"},
+  {"swarm_packets_skipped_total", "Packets skipped by overload sampling"},
+  {"swarm_devices_total", "Devices found"},
+  {"swarm_probes_total", "Probes injected"},
+  {"swarm_probe_errors_total", "Probes which could not be injected"},
+  {"swarm_queries_total", "Database queries executed"},
+  {"swarm_query_errors_total", "Database queries which failed"}
+};
+
+// Names and descriptions of histograms, in MetricHistogram order
+static const char* HISTOGRAM_NAMES[NUM_HISTOGRAMS][2] = {
+  {"swarm_packet_seconds", "Time spent processing a captured packet"},
+  {"swarm_monitor_lock_seconds", "Time monitor lock is held"},
+  {"swarm_query_seconds", "Time spent executing a database query"}
+};
+
+// Formats a duration using its most readable unit
+static string formatDuration(uint64_t ns) {
+  stringstream text;
+  if (ns < 1000) {
+    text << ns << "ns";
+  }
+  else if (ns < 1000000) {
+    text << ns / 1000 << "us";
+  }
+  else if (ns < 1000000000) {
+    text << ns / 1000000 << "ms";
+  }
+  else {
+    text << ns / 1000000000 << "s";
+  }
+  return text.str();
+}
+
+// Constructor: clear all shards
+Metrics::Metrics(void) {
+  for (int i = 0; i < MAX_SHARDS; ++i) {
+    Shard& shard = _shards[i];
+    for (int j = 0; j < NUM_COUNTERS; ++j) {
+      shard.counters[j].store(0);
+    }
+    for (int j = 0; j < NUM_HISTOGRAMS; ++j) {
+      for (int k = 0; k < NUM_BUCKETS; ++k) {
+        shard.buckets[j][k].store(0);
+      }
+      shard.sums[j].store(0);
+    }
+  }
+  _next_shard.store(0);
+  _socket = -1;
+  _interval = 0;
+  _last_stats = 0;
+  _last_packets = 0;
+}
+
+// Destructor: close metrics socket
+Metrics::~Metrics(void) {
+  if (_socket >= 0) {
+    close(_socket);
+  }
+}
+
+// Opens metrics socket, and launches as thread
+bool Metrics::start(const string& socket, int interval) {
+  _interval = max(0, interval);
+  _last_stats = now();
+
+  if (not socket.empty()) {
+    struct sockaddr_un addr;
+    if (socket.size() >= sizeof(addr.sun_path)) {
+      cerr << "ERROR - Metrics socket path is too long: " << socket << endl;
+      return true;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket.c_str());
+
+    // Remove socket left by a previous run
+    unlink(socket.c_str());
+
+    _socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (_socket < 0 or
+        bind(_socket, (struct sockaddr*)&addr, sizeof(addr)) or
+        listen(_socket, 16))
+    {
+      cerr << "ERROR - Can't open metrics socket " << socket << ": ";
+      cerr << strerror(errno) << endl;
+      return true;
+    }
+  }
+
+  // Nothing to do if there is no socket and no stats line
+  if (_socket < 0 and _interval == 0) {
+    return false;
+  }
+
+  thread t1(serveMetrics);
+  t1.detach();
+  return false;
+}
+
+// Answers clients of metrics socket, and prints stats line when due
+void Metrics::serve(void) {
+  int timeout = -1;
+
+  // Wait for clients no longer than next stats line
+  if (_interval > 0) {
+    uint64_t due = _last_stats + _interval * 1000000000ULL;
+    uint64_t current = now();
+    timeout = (due > current) ? (due - current) / 1000000 + 1 : 0;
+  }
+
+  struct pollfd fd = {_socket, POLLIN, 0};
+  if (poll(&fd, (_socket >= 0) ? 1 : 0, timeout) > 0) {
+    int client = accept(_socket, NULL, NULL);
+    if (client >= 0) {
+      // Request is read and ignored, if client sends any. Clients which
+      // send nothing get metrics too
+      char request[1024];
+      struct pollfd cfd = {client, POLLIN, 0};
+      if (poll(&cfd, 1, 100) > 0) {
+        recv(client, request, sizeof(request), 0);
+      }
+
+      string body = render();
+      stringstream answer;
+      answer << "HTTP/1.0 200 OK\r\n";
+      answer << "Content-Type: text/plain; version=0.0.4\r\n";
+      answer << "Content-Length: " << body.size() << "\r\n\r\n" << body;
+
+      string text = answer.str();
+      size_t done = 0;
+      while (done < text.size()) {
+        ssize_t bytes = send(client, text.data() + done, text.size() - done,
+            MSG_NOSIGNAL);
+        if (bytes <= 0) {
+          break;
+        }
+        done += bytes;
+      }
+      close(client);
+    }
+  }
+
+  if (_interval > 0 and now() - _last_stats >= _interval * 1000000000ULL) {
+    printStats();
+  }
+}
+
+// Returns all metrics in Prometheus text format
+string Metrics::render(void) const {
+  stringstream text;
+
+  for (int i = 0; i < NUM_COUNTERS; ++i) {
+    text << "# HELP " << COUNTER_NAMES[i][0] << " " << COUNTER_NAMES[i][1];
+    text << "\n# TYPE " << COUNTER_NAMES[i][0] << " counter\n";
+    text << COUNTER_NAMES[i][0] << " " << getCounter((MetricCounter)i);
+    text << "\n";
+  }
+
+  // Buckets are cumulative, and bounds are given in seconds
+  for (int i = 0; i < NUM_HISTOGRAMS; ++i) {
+    const char* name = HISTOGRAM_NAMES[i][0];
+    uint64_t buckets[NUM_BUCKETS];
+    uint64_t count = 0;
+    uint64_t sum = 0;
+
+    getBuckets((MetricHistogram)i, buckets);
+    for (int j = 0; j < MAX_SHARDS; ++j) {
+      sum += _shards[j].sums[i].load(memory_order_relaxed);
+    }
+
+    text << "# HELP " << name << " " << HISTOGRAM_NAMES[i][1] << "\n";
+    text << "# TYPE " << name << " histogram\n";
+    for (int j = 0; j < NUM_BUCKETS - 1; ++j) {
+      count += buckets[j];
+      text << name << "_bucket{le=\"" << (double)(1ULL << j) / 1e9;
+      text << "\"} " << count << "\n";
+    }
+    count += buckets[NUM_BUCKETS - 1];
+    text << name << "_bucket{le=\"+Inf\"} " << count << "\n";
+    text << name << "_sum " << sum / 1e9 << "\n";
+    text << name << "_count " << count << "\n";
+  }
+
+  // State of other modules, read when asked
+  text << "# HELP swarm_monitor_devices Devices on monitor\n";
+  text << "# TYPE swarm_monitor_devices gauge\n";
+  text << "swarm_monitor_devices " << monitor->count() << "\n";
+  text << "# HELP swarm_flusher_queued Devices with changes queued\n";
+  text << "# TYPE swarm_flusher_queued gauge\n";
+  text << "swarm_flusher_queued " << flusher->getQueued() << "\n";
+  text << "# HELP swarm_flusher_spill_bytes Spilled bytes not written yet\n";
+  text << "# TYPE swarm_flusher_spill_bytes gauge\n";
+  text << "swarm_flusher_spill_bytes " << flusher->getSpillBacklog() << "\n";
+  text << "# HELP swarm_flusher_spilled_total Changes sent to spill file\n";
+  text << "# TYPE swarm_flusher_spilled_total counter\n";
+  text << "swarm_flusher_spilled_total " << flusher->getSpilled() << "\n";
+  text << "# HELP swarm_flusher_replayed_total Spilled changes written\n";
+  text << "# TYPE swarm_flusher_replayed_total counter\n";
+  text << "swarm_flusher_replayed_total " << flusher->getReplayed() << "\n";
+  text << "# HELP swarm_flusher_failures_total Failed writes to storage\n";
+  text << "# TYPE swarm_flusher_failures_total counter\n";
+  text << "swarm_flusher_failures_total " << flusher->getFailures() << "\n";
+  text << "# HELP swarm_conversations Pairs of devices not written yet\n";
+  text << "# TYPE swarm_conversations gauge\n";
+  text << "swarm_conversations " << conversations->count() << "\n";
+
+  // Memory of pools and interned texts, so it can be checked capture takes
+  // no memory from heap once devices were found
+  uint64_t slabs, used, free;
+  Pool::getStats(slabs, used, free);
+  text << "# HELP swarm_pool_slabs Slabs taken from heap by pools\n";
+  text << "# TYPE swarm_pool_slabs gauge\n";
+  text << "swarm_pool_slabs " << slabs << "\n";
+  text << "# HELP swarm_pool_slab_bytes Bytes of each slab\n";
+  text << "# TYPE swarm_pool_slab_bytes gauge\n";
+  text << "swarm_pool_slab_bytes " << Pool::SLAB_SIZE << "\n";
+  text << "# HELP swarm_pool_used_blocks Pool blocks in use\n";
+  text << "# TYPE swarm_pool_used_blocks gauge\n";
+  text << "swarm_pool_used_blocks " << used << "\n";
+  text << "# HELP swarm_pool_free_blocks Pool blocks ready for reuse\n";
+  text << "# TYPE swarm_pool_free_blocks gauge\n";
+  text << "swarm_pool_free_blocks " << free << "\n";
+  text << "# HELP swarm_symbols Distinct texts interned\n";
+  text << "# TYPE swarm_symbols gauge\n";
+  text << "swarm_symbols " << Symbol::count() << "\n";
+
+  return text.str();
+}
+
+// Returns a counter, added up from all shards
+uint64_t Metrics::getCounter(MetricCounter counter) const {
+  uint64_t value = 0;
+  for (int i = 0; i < MAX_SHARDS; ++i) {
+    value += _shards[i].counters[counter].load(memory_order_relaxed);
+  }
+  return value;
+}
+
+// Returns approximate quantile of a histogram
+uint64_t Metrics::getQuantile(MetricHistogram histogram,
+    double quantile) const
+{
+  uint64_t buckets[NUM_BUCKETS];
+  uint64_t count = 0;
+
+  getBuckets(histogram, buckets);
+  for (int i = 0; i < NUM_BUCKETS; ++i) {
+    count += buckets[i];
+  }
+  if (count == 0) {
+    return 0;
+  }
+
+  // Find first bucket which reaches wanted rank
+  uint64_t rank = quantile * count;
+  uint64_t seen = 0;
+  for (int i = 0; i < NUM_BUCKETS; ++i) {
+    seen += buckets[i];
+    if (seen > rank) {
+      return 1ULL << i;
+    }
+  }
+  return 1ULL << (NUM_BUCKETS - 1);
+}
+
+// Adds up buckets of a histogram
+void Metrics::getBuckets(MetricHistogram histogram, uint64_t* buckets) const
+{
+  for (int i = 0; i < NUM_BUCKETS; ++i) {
+    buckets[i] = 0;
+    for (int j = 0; j < MAX_SHARDS; ++j) {
+      buckets[i] += _shards[j].buckets[histogram][i].load(
+          memory_order_relaxed);
+    }
+  }
+}
+
+// Prints stats line
+void Metrics::printStats(void) {
+  uint64_t current = now();
+  uint64_t packets = getCounter(COUNTER_PACKETS);
+  double elapsed = (current - _last_stats) / 1e9;
+
+  cerr << "STATS - " << packets << " packets (";
+  cerr << (uint64_t)((packets - _last_packets) / elapsed) << "/s, ";
+  cerr << getCounter(COUNTER_PACKETS_DROPPED) << " dropped, ";
+  cerr << getCounter(COUNTER_PACKETS_SKIPPED) << " skipped), ";
+  cerr << monitor->count() << " devices, ";
+  cerr << getCounter(COUNTER_PROBES) << " probes (";
+  cerr << getCounter(COUNTER_PROBE_ERRORS) << " errors), ";
+  cerr << getCounter(COUNTER_QUERIES) << " queries (";
+  cerr << getCounter(COUNTER_QUERY_ERRORS) << " errors), ";
+  cerr << flusher->getQueued() << " queued changes, packet p50 ";
+  cerr << formatDuration(getQuantile(HISTOGRAM_PACKET, 0.5)) << " p99 ";
+  cerr << formatDuration(getQuantile(HISTOGRAM_PACKET, 0.99));
+  cerr << ", lock p99 ";
+  cerr << formatDuration(getQuantile(HISTOGRAM_MONITOR_LOCK, 0.99));
+  cerr << ", query p99 ";
+  cerr << formatDuration(getQuantile(HISTOGRAM_QUERY, 0.99)) << endl;
+
+  _last_stats = current;
+  _last_packets = packets;
+}
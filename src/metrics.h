@@ -0,0 +1,238 @@
+/**
+ * Copyright 2013 Ezequiel Vázquez De la calle
+ *
+ * This file is part of Swarm.
+ *
+ * Swarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Swarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file Class Metrics definition. Singleton pattern implementation
+ */
+
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+  #include <algorithm>
+  #include <atomic>
+  #include <chrono>
+  #include <cerrno>
+  #include <cstdint>
+  #include <cstdio>
+  #include <cstring>
+  #include <iostream>
+  #include <poll.h>
+  #include <sstream>
+  #include <string>
+  #include <sys/socket.h>
+  #include <sys/un.h>
+  #include <thread>
+  #include <unistd.h>
+
+  using namespace std;
+
+  /**
+   * Counters of events, which only grow
+   */
+  enum MetricCounter {
+    COUNTER_PACKETS,
+    COUNTER_PACKETS_DROPPED,
+    COUNTER_PACKETS_SKIPPED,
+    COUNTER_DEVICES,
+    COUNTER_PROBES,
+    COUNTER_PROBE_ERRORS,
+    COUNTER_QUERIES,
+    COUNTER_QUERY_ERRORS,
+    NUM_COUNTERS
+  };
+
+  /**
+   * Histograms of durations
+   */
+  enum MetricHistogram {
+    HISTOGRAM_PACKET,
+    HISTOGRAM_MONITOR_LOCK,
+    HISTOGRAM_QUERY,
+    NUM_HISTOGRAMS
+  };
+
+  /**
+   * Singleton registry of runtime metrics. Each thread records into its
+   * own shard, on its own cache lines, using relaxed atomic additions, so
+   * recording takes a few nanoseconds and threads never wait for each
+   * other. Shards are only added up when metrics are read.
+   *
+   * Histograms count durations, in nanoseconds, on buckets whose bounds
+   * are powers of two. Metrics are served on a local UNIX socket, as an
+   * HTTP answer in Prometheus text format, and summarized on a stats line
+   * printed every few seconds.
+   */
+  class Metrics {
+    public:
+
+      // Number of shards. Threads beyond this number share shards
+      static const int MAX_SHARDS = 64;
+
+      // Number of histogram buckets. Bucket i counts durations below 2^i
+      // nanoseconds, and last one counts all longer durations
+      static const int NUM_BUCKETS = 36;
+
+      // Default seconds between two stats lines
+      static const int INTERVAL = 60;
+
+      /**
+       * Implementation of Singleton pattern
+       * @return Pointer to singleton metrics object
+       */
+      static Metrics* getInstance(void) {
+        if (_instance == 0) {
+          _instance = new Metrics();
+        }
+        return _instance;
+      }
+
+      /**
+       * Destroyer for singleton metrics object
+       */
+      static void destroy(void) {
+        delete _instance;
+      }
+
+      /**
+       * Opens metrics socket, and launches as thread. Metrics are recorded
+       * even if not started
+       * @param socket Path of UNIX socket. Empty to not serve metrics
+       * @param interval Seconds between two stats lines. Zero disables them
+       * @return True if there was an error, false either
+       */
+      bool start(const string& socket, int interval = INTERVAL);
+
+      /**
+       * Adds to a counter
+       * @param counter Counter to increase
+       * @param value Value to add
+       */
+      void add(MetricCounter counter, uint64_t value = 1) {
+        getShard().counters[counter].fetch_add(value, memory_order_relaxed);
+      }
+
+      /**
+       * Records a duration on a histogram
+       * @param histogram Histogram where duration is counted
+       * @param ns Duration, in nanoseconds
+       */
+      void observe(MetricHistogram histogram, uint64_t ns) {
+        int bucket = (ns == 0) ? 0 : 64 - __builtin_clzll(ns);
+        if (bucket >= NUM_BUCKETS) {
+          bucket = NUM_BUCKETS - 1;
+        }
+        Shard& shard = getShard();
+        shard.buckets[histogram][bucket].fetch_add(1, memory_order_relaxed);
+        shard.sums[histogram].fetch_add(ns, memory_order_relaxed);
+      }
+
+      /**
+       * Records time elapsed since some moment on a histogram
+       * @param histogram Histogram where duration is counted
+       * @param start Moment, as returned by now
+       */
+      void since(MetricHistogram histogram, uint64_t start) {
+        observe(histogram, now() - start);
+      }
+
+      /**
+       * Returns current time of a monotonic clock
+       * @return Nanoseconds since some fixed moment
+       */
+      static uint64_t now(void) {
+        return chrono::duration_cast<chrono::nanoseconds>(
+            chrono::steady_clock::now().time_since_epoch()).count();
+      }
+
+      /**
+       * Answers clients of metrics socket, waiting for them until next
+       * stats line is due, and prints stats line if so
+       */
+      void serve(void);
+
+      /**
+       * Returns all metrics in Prometheus text format
+       * @return Metrics text
+       */
+      string render(void) const;
+
+      /**
+       * Returns a counter, added up from all shards
+       * @param counter Counter to read
+       * @return Counter value
+       */
+      uint64_t getCounter(MetricCounter counter) const;
+
+      /**
+       * Returns approximate quantile of a histogram, as upper bound of
+       * bucket where it falls
+       * @param histogram Histogram to read
+       * @param quantile Quantile, between 0 and 1
+       * @return Duration, in nanoseconds, or zero if histogram is empty
+       */
+      uint64_t getQuantile(MetricHistogram histogram, double quantile) const;
+
+    protected:
+      // Constructor, destructor, copy constructor and assing operator
+      // are protected due to singleton pattern implementation
+      Metrics(void);
+      ~Metrics(void);
+      Metrics(const Metrics& metrics);
+      Metrics& operator=(const Metrics& metrics);
+
+    private:
+      // Metrics recorded by some threads. Padding keeps consecutive
+      // shards off each other cache lines
+      struct Shard {
+        atomic<uint64_t> counters[NUM_COUNTERS];
+        atomic<uint64_t> buckets[NUM_HISTOGRAMS][NUM_BUCKETS];
+        atomic<uint64_t> sums[NUM_HISTOGRAMS];
+        char padding[64];
+      };
+
+      // Private function which returns shard of calling thread, taking a
+      // new one on first use
+      Shard& getShard(void) {
+        static thread_local Shard* shard = 0;
+        if (shard == 0) {
+          shard = &_shards[_next_shard.fetch_add(1) % MAX_SHARDS];
+        }
+        return *shard;
+      }
+
+      // Private function which adds up buckets of a histogram
+      void getBuckets(MetricHistogram histogram, uint64_t* buckets) const;
+
+      // Private function which prints stats line
+      void printStats(void);
+
+      // Attributes
+      Shard _shards[MAX_SHARDS];
+      atomic<int> _next_shard;
+      int _socket;
+      int _interval;
+      uint64_t _last_stats;
+      uint64_t _last_packets;
+      static Metrics* _instance;
+  };
+
+  #define metrics Metrics::getInstance()
+
+#endif
@@ -22,58 +22,112 @@
  */
 
 #include "monitor.h"
+#include "flusher.h"
+#include "history.h"
+#include "metrics.h"
+#include "timeline.h"
 using namespace std;
 
 Monitor* Monitor::_instance = 0;
 
-// Constructor: does nothing
+// Constructor
 Monitor::Monitor(void) {
+  _locked = 0;
+}
+
+// Destructor: does nothing
+Monitor::~Monitor(void) {
+}
+
+// Loads all stored devices
+bool Monitor::load(void) {
+  lock();
+  bool error = storage->load(_devices);
+  _it = _devices.begin();
+  unlock();
+
+  if (error) {
+    cerr << "ERROR - Can not load stored devices" << endl;
+  }
+  return error;
 }
 
 // Adds new device to monitor
 bool Monitor::addDevice(Device& device) {
+  TRACE_SPAN("monitor insert");
+
   // Map insert operation returns a pair of iterator and boolean
   pair<Devices::iterator, bool> result;
 
   // Protect access using mutex lock
-  _mutex.lock();
-  result = _devices.insert(pair<string,Device>(device.getIp(), device));
-  // Save updated device to database
-  result.first->second.save();
+  lock();
+  result = _devices.insert(pair<Ipv4Addr,Device>(device.getIp(), device));
+
+  // Queue new device to be saved to database, using a fresh id
+  if (result.second) {
+    metrics->add(COUNTER_DEVICES);
+    Device& stored = result.first->second;
+    if (stored.getId() == 0) {
+      stored.setId(flusher->nextId(stored.getIp()));
+    }
+    flusher->enqueue(stored, FIELD_ALL);
+    stored.clearDirty();
+    history->record(stored.getId(), SIGHTING_NEW, string(),
+        stored.getIp().toString());
+  }
   device = result.first->second;
-  _mutex.unlock();
+  unlock();
 
   // Return true if device was inserted, false if it existed
   return result.second;
 }
 
 // Updates a device, searching by ip address
-bool Monitor::updateDevice(const string& ip, Device& device) {
+bool Monitor::updateDevice(const Ipv4Addr& ip, Device& device) {
   // Check if received ip is registered, else exit
   if (not checkDevice(ip)) {
     return true;
   }
 
-  // Actually update stored device
-  // Save updated device to database
-  _mutex.lock();
-  _devices[ip] = device;
-  _devices[ip].save();
-  device = _devices[ip];
-  _mutex.unlock();
+  // Actually update stored device, copying only attributes changed by
+  // caller so changes done meanwhile by other threads are kept, and queue
+  // them to be saved to database
+  lock();
+  Device& stored = _devices[ip];
+  int fields = device.getDirty();
+
+  // Events are recorded only for attributes changed by caller, as others
+  // may be outdated on its copy
+  if ((fields & FIELD_MAC) and stored.getMac() != device.getMac()) {
+    history->record(stored.getId(), SIGHTING_MAC,
+        stored.getMac().toString(), device.getMac().toString());
+  }
+  if ((fields & FIELD_REACHABLE) and
+      stored.getReachable() != device.getReachable())
+  {
+    history->record(stored.getId(), SIGHTING_REACHABLE,
+        to_string(stored.getReachable()), to_string(device.getReachable()));
+  }
+  stored.merge(device, fields);
+  if (stored.getDirty()) {
+    flusher->enqueue(stored, stored.getDirty());
+    stored.clearDirty();
+  }
+  device = stored;
+  unlock();
 
   return false;
 }
 
 // Return reference to concrete device identified by ip address
-Device Monitor::getDevice(const string& ip) throw (exception) {
+Device Monitor::getDevice(const Ipv4Addr& ip) throw (exception) {
   // Map find operation returns an iterator
   Devices::iterator it;
 
   // Search selected device, using mutex lock
-  _mutex.lock();
+  lock();
   it = _devices.find(ip);
-  _mutex.unlock();
+  unlock();
 
   // Throw exception if device not found
   if (it == _devices.end()) {
@@ -81,33 +135,47 @@ Device Monitor::getDevice(const string& ip) throw (exception) {
   }
 
   // Return device if found
-  _mutex.lock();
+  lock();
   Device device = it->second;
-  _mutex.unlock();
+  unlock();
   return device;
 }
 
 // Checks if some ip address has been registered before
-bool Monitor::checkDevice(const string& ip) {
-  _mutex.lock();
+bool Monitor::checkDevice(const Ipv4Addr& ip) {
+  lock();
   bool found = (_devices.find(ip) != _devices.end());
-  _mutex.unlock();
+  unlock();
+
+  return found;
+}
+
+// Checks if some ip address has been registered before, recording it was
+// seen if so
+bool Monitor::sightDevice(const Ipv4Addr& ip) {
+  lock();
+  Devices::const_iterator it = _devices.find(ip);
+  bool found = (it != _devices.end());
+  if (found) {
+    history->seen(it->second.getId());
+  }
+  unlock();
 
   return found;
 }
 
 // Reset internal pointer to first device object
 void Monitor::reset(void) {
-  _mutex.lock();
+  lock();
   _it = _devices.begin();
-  _mutex.unlock();
+  unlock();
 }
 
 // Advance internal pointer to next device object
 void Monitor::next(void) {
-  _mutex.lock();
+  lock();
   ++_it;
-  _mutex.unlock();
+  unlock();
 
   // It new position is end, reset pointer
   if (_it == _devices.end()) {
@@ -120,8 +188,45 @@ const Device& Monitor::getCurrent(void) const {
   return _it->second;
 }
 
-// Returns number of devices stored
-int Monitor::count(void) const {
-  return _devices.size();
+// Copies some devices, starting at given ip address
+size_t Monitor::getDevices(const Ipv4Addr& from, vector<Device>& devices,
+    size_t count)
+{
+  size_t found = 0;
+
+  if (devices.size() < count) {
+    devices.resize(count);
+  }
+
+  lock();
+  Devices::const_iterator it = _devices.lower_bound(from);
+  for (; it != _devices.end() and found < count; ++it) {
+    devices[found++] = it->second;
+  }
+  unlock();
+
+  devices.resize(found);
+  return found;
+}
+
+// Returns number of devices stored. Map may be changing on other threads
+int Monitor::count(void) {
+  lock();
+  int found = _devices.size();
+  unlock();
+  return found;
 }
 
+
+// Takes lock, and notes when
+void Monitor::lock(void) {
+  _mutex.lock();
+  _locked = Metrics::now();
+}
+
+// Releases lock, recording how long it was held
+void Monitor::unlock(void) {
+  uint64_t held = Metrics::now() - _locked;
+  _mutex.unlock();
+  metrics->observe(HISTOGRAM_MONITOR_LOCK, held);
+}
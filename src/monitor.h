@@ -24,17 +24,17 @@
 #ifndef _MONITOR_H_
 #define _MONITOR_H_
 
+  #include <cstdint>
   #include <map>
   #include <mutex>
   #include <stdexcept>
   #include <string>
+  #include <vector>
 
   #include "device.h"
+  #include "storage.h"
   using namespace std;
 
-  // Type definitions
-  typedef map<string,Device> Devices;
-
   /**
    * List of network devices found. Implements Singleton pattern, and all
    * access to internal data structure are mutex protected by own lock
@@ -60,6 +60,12 @@
         delete _instance;
       }
 
+      /**
+       * Loads all stored devices, so they are not found and inserted again
+       * @return True if there was an error, false either
+       */
+      bool load(void);
+
       /**
        * Adds a new device to monitor
        * @param device Device object to add to monitor
@@ -68,12 +74,15 @@
       bool addDevice(Device& device);
 
       /**
-       * Updates an stored device, identified by its ip address
+       * Updates an stored device, identified by its ip address. Only
+       * attributes changed on given device are stored, so other threads'
+       * changes done meanwhile are not lost
        * @param ip Ip address which identifies device to update
-       * @param device Device object to store in place of existing one
+       * @param device Device whose changed attributes are stored. On return,
+       * it holds stored device
        * @return True if there was an error, false either
        */
-      bool updateDevice(const string& ip, Device& device);
+      bool updateDevice(const Ipv4Addr& ip, Device& device);
 
       /**
        * Returns a concrete device identified by its ip address
@@ -81,14 +90,22 @@
        * @throws Standard exception if device was not found
        * @return Device which ip address is the received one
        */
-      Device getDevice(const string& ip) throw (exception);
+      Device getDevice(const Ipv4Addr& ip) throw (exception);
 
       /**
        * Checks if some ip address has been registered before
        * @param ip Ip address to check if has been registered on monitor
        * @return True if ip address was found, false either
        */
-      bool checkDevice(const string& ip);
+      bool checkDevice(const Ipv4Addr& ip);
+
+      /**
+       * Checks if some ip address has been registered before, and records
+       * device was seen if so. Used for every captured packet
+       * @param ip Ip address to check
+       * @return True if ip address was found, false either
+       */
+      bool sightDevice(const Ipv4Addr& ip);
 
       /**
        * Reset internal pointer to first device object
@@ -106,11 +123,24 @@
        */
        const Device& getCurrent(void) const;
 
+      /**
+       * Copies some devices, in ip address order, so they can be read
+       * without holding lock. Devices already on vector are overwritten,
+       * reusing their memory
+       * @param from Lowest ip address of devices to copy
+       * @param devices Vector where devices are copied. Resized to number
+       * of devices found
+       * @param count Maximum number of devices to copy
+       * @return Number of devices copied
+       */
+      size_t getDevices(const Ipv4Addr& from, vector<Device>& devices,
+          size_t count);
+
       /**
        * Returns number of devices registered
        * @return Integer which indicates the number of devices
        */
-      int count(void) const;
+      int count(void);
 
     protected:
       // Constructor, destructor, copy constructor and assing operator
@@ -121,9 +151,16 @@
       Monitor& operator=(const Monitor& monitor);
 
     private:
+      // Private functions which take and release lock, recording how long
+      // it was held
+      void lock(void);
+      void unlock(void);
+
+      // Attributes
       Devices _devices;
       Devices::const_iterator _it;
       mutex _mutex;
+      uint64_t _locked;
       static Monitor* _instance;
   };
 
@@ -0,0 +1,478 @@
+/**
+ * Copyright 2013 Ezequiel Vázquez De la calle
+ *
+ * This file is part of Swarm.
+ *
+ * Swarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Swarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file Implementation of MysqlStorage class methods
+ */
+
+#include "mysqlstorage.h"
+using namespace std;
+
+const size_t MysqlStorage::BATCH_ROWS;
+
+// Expression which reads a column, turning binary addresses into text
+string MysqlStorage::getSelect(int index) {
+  stringstream expr;
+
+  switch (1 << index) {
+    case FIELD_IP:
+    case FIELD_SUBNET:
+      expr << "COALESCE(INET_NTOA(" << getColumn(index) << "), '')";
+      break;
+
+    case FIELD_MAC:
+      expr << "IF(LENGTH(mac) = 6, CONCAT_WS(':'";
+      for (int i = 1; i < 12; i += 2) {
+        expr << ", MID(HEX(mac), " << i << ", 2)";
+      }
+      expr << "), '')";
+      break;
+
+    default:
+      expr << getColumn(index);
+  }
+
+  return expr.str();
+}
+
+// Placeholder of a column, turning text addresses into binary
+const char* MysqlStorage::getPlaceholder(int index) {
+  switch (1 << index) {
+    case FIELD_IP:
+    case FIELD_SUBNET:
+      return "INET_ATON(?)";
+
+    case FIELD_MAC:
+      return "UNHEX(REPLACE(?, ':', ''))";
+
+    default:
+      return "?";
+  }
+}
+
+// Select list of all columns, id first
+string MysqlStorage::getColumns(void) {
+  string columns = "id";
+  for (int i = 0; i < NUM_FIELDS; ++i) {
+    columns += ", " + getSelect(i);
+  }
+  return columns;
+}
+
+// Returns highest device id stored
+bool MysqlStorage::getLastId(int& id) {
+  Result result;
+
+  if (db->query("SELECT COALESCE(MAX(id), 0) AS id FROM devices", result) or
+      result.empty())
+  {
+    return true;
+  }
+
+  id = atoi(result.at(0)["id"].c_str());
+  return false;
+}
+
+// Streams all stored devices
+bool MysqlStorage::load(Devices& devices) {
+  Connection* con = db->acquire();
+  if (con == NULL) {
+    return true;
+  }
+
+  // Newest records first, so they are kept if some ip is repeated
+  Cursor cursor;
+  if (con->open("SELECT " + getColumns() + " FROM devices ORDER BY id DESC",
+      cursor))
+  {
+    db->release(con);
+    return true;
+  }
+
+  while (cursor.next()) {
+    Device device(Ipv4Addr(cursor.getText(4)));
+    device.setId(cursor.getInt(0));
+    device.setHostname(cursor.getText(1));
+    device.setDescription(cursor.getText(2));
+    device.setMac(MacAddr(cursor.getText(3)));
+    device.setSubnetMask(Ipv4Addr(cursor.getText(5)));
+    device.setHops(cursor.getInt(6));
+    device.setPath(cursor.getText(7));
+    device.setVlan(cursor.getInt(8));
+    device.setReachable(cursor.getInt(9));
+    device.clearDirty();
+
+    devices.insert(pair<Ipv4Addr,Device>(device.getIp(), device));
+  }
+
+  // Rows may stop because connection was lost, so devices are incomplete
+  bool error = cursor.failed();
+  if (error) {
+    cerr << "ERROR - Can not read devices" << endl;
+  }
+
+  cursor.close();
+  db->release(con);
+  return error;
+}
+
+// Streams all stored devices to a reader
+bool MysqlStorage::scan(DeviceReader& reader) {
+  Connection* con = db->acquire();
+  if (con == NULL) {
+    return true;
+  }
+
+  Cursor cursor;
+  if (con->open("SELECT " + getColumns() + " FROM devices ORDER BY id",
+      cursor))
+  {
+    db->release(con);
+    return true;
+  }
+
+  bool stopped = false;
+  while (not stopped and cursor.next()) {
+    Device device(Ipv4Addr(cursor.getText(4)));
+    device.setId(cursor.getInt(0));
+    device.setHostname(cursor.getText(1));
+    device.setDescription(cursor.getText(2));
+    device.setMac(MacAddr(cursor.getText(3)));
+    device.setSubnetMask(Ipv4Addr(cursor.getText(5)));
+    device.setHops(cursor.getInt(6));
+    device.setPath(cursor.getText(7));
+    device.setVlan(cursor.getInt(8));
+    device.setReachable(cursor.getInt(9));
+    device.clearDirty();
+
+    stopped = reader.readDevice(device);
+  }
+
+  // Rows may stop because connection was lost, so devices are incomplete
+  bool error = cursor.failed();
+  if (error) {
+    cerr << "ERROR - Can not read devices" << endl;
+  }
+
+  cursor.close();
+  db->release(con);
+  return (error or stopped);
+}
+
+// Reads a device using its id
+bool MysqlStorage::read(int id, Device& device) {
+  // Take a connection for this thread only, as statements can't be shared
+  Connection* con = db->acquire();
+  if (con == NULL) {
+    return true;
+  }
+
+  // Statement is prepared only once per connection, on first read
+  Statement* stmt = con->prepare("SELECT " + getColumns() +
+      " FROM devices WHERE id = ?");
+  if (stmt == NULL) {
+    db->release(con);
+    return true;
+  }
+
+  // Execute query. If resultset is empty, device does not exist
+  stmt->setInt(0, id);
+  if (stmt->execute() or not stmt->next()) {
+    db->release(con);
+    return true;
+  }
+
+  // Store values found into object attributes
+  device.setId(id);
+  device.setHostname(stmt->getString(1));
+  device.setDescription(stmt->getString(2));
+  device.setMac(MacAddr(stmt->getString(3)));
+  device.setIp(Ipv4Addr(stmt->getString(4)));
+  device.setSubnetMask(Ipv4Addr(stmt->getString(5)));
+  device.setHops(stmt->getInt(6));
+  device.setPath(stmt->getString(7));
+  device.setVlan(stmt->getInt(8));
+  device.setReachable(stmt->getInt(9));
+  device.clearDirty();
+
+  db->release(con);
+  return false;
+}
+
+// Writes devices using batches whose size is a power of two
+bool MysqlStorage::write(const vector<Device>& devices, int fields) {
+  bool error = false;
+
+  if (devices.empty()) {
+    return false;
+  }
+
+  // Take a connection for all batches, as statements can't be shared
+  Connection* con = db->acquire();
+  if (con == NULL) {
+    return true;
+  }
+
+  size_t first = 0;
+  while (first < devices.size()) {
+    size_t count = BATCH_ROWS;
+    while (count > devices.size() - first) {
+      count >>= 1;
+    }
+
+    if (write(con, devices, fields, first, count)) {
+      error = true;
+    }
+    first += count;
+  }
+
+  db->release(con);
+  return error;
+}
+
+// Write some rows using a single statement
+bool MysqlStorage::write(Connection* con, const vector<Device>& devices,
+    int fields, size_t first, size_t count)
+{
+  stringstream sql;
+  stringstream row;
+  stringstream update;
+
+  // Columns and placeholders of a single row. Stored id is never changed,
+  // as history and conversations refer to it
+  sql << "INSERT INTO devices(id";
+  row << "(?";
+  update << "id = id";
+  for (int i = 0; i < NUM_FIELDS; ++i) {
+    if (fields & (1 << i)) {
+      sql << ", " << getColumn(i);
+      row << ", " << getPlaceholder(i);
+      update << ", " << getColumn(i) << " = VALUES(" << getColumn(i) << ")";
+    }
+  }
+  sql << ") VALUES ";
+  row << ")";
+
+  for (size_t i = 0; i < count; ++i) {
+    sql << (i ? ", " : "") << row.str();
+  }
+  sql << " ON DUPLICATE KEY UPDATE " << update.str();
+
+  Statement* stmt = con->prepare(sql.str());
+  if (stmt == NULL) {
+    return true;
+  }
+
+  // Bind id and changed attributes of each row
+  size_t index = 0;
+  for (size_t i = first; i < first + count; ++i) {
+    stmt->setInt(index++, devices[i].getId());
+    for (int j = 0; j < NUM_FIELDS; ++j) {
+      if (not (fields & (1 << j))) {
+        continue;
+      }
+
+      if (isInteger(j)) {
+        stmt->setInt(index++, getInteger(devices[i], j));
+      }
+      else {
+        stmt->setString(index++, getText(devices[i], j));
+      }
+    }
+  }
+
+  return stmt->execute();
+}
+
+// Appends sightings using batches whose size is a power of two
+bool MysqlStorage::writeSightings(const vector<Sighting>& sightings) {
+  bool error = false;
+
+  if (sightings.empty()) {
+    return false;
+  }
+
+  Connection* con = db->acquire();
+  if (con == NULL) {
+    return true;
+  }
+
+  // Batches are written in a single transaction, as counts are added to
+  // stored ones and failed sightings are written again later
+  error = con->begin();
+  size_t first = 0;
+  while (not error and first < sightings.size()) {
+    size_t count = BATCH_ROWS;
+    while (count > sightings.size() - first) {
+      count >>= 1;
+    }
+
+    error = writeSightings(con, sightings, first, count);
+    first += count;
+  }
+
+  if (error) {
+    con->rollback();
+  }
+  else {
+    error = con->commit();
+  }
+
+  db->release(con);
+  return error;
+}
+
+// Removes sightings of older buckets
+bool MysqlStorage::expireSightings(time_t before) {
+  Connection* con = db->acquire();
+  if (con == NULL) {
+    return true;
+  }
+
+  Statement* stmt = con->prepare("DELETE FROM sightings "
+      "WHERE bucket < FROM_UNIXTIME(?)");
+  bool error = (stmt == NULL);
+  if (not error) {
+    stmt->setInt(0, before);
+    error = stmt->execute();
+  }
+
+  db->release(con);
+  return error;
+}
+
+// Write some sightings using a single statement
+bool MysqlStorage::writeSightings(Connection* con,
+    const vector<Sighting>& sightings, size_t first, size_t count)
+{
+  stringstream sql;
+  sql << "INSERT INTO sightings(bucket, device_id, event, old_value, ";
+  sql << "new_value, count) VALUES ";
+  for (size_t i = 0; i < count; ++i) {
+    sql << (i ? ", " : "") << "(FROM_UNIXTIME(?), ?, ?, ?, ?, ?)";
+  }
+  sql << " ON DUPLICATE KEY UPDATE new_value = VALUES(new_value), ";
+  sql << "count = count + VALUES(count)";
+
+  Statement* stmt = con->prepare(sql.str());
+  if (stmt == NULL) {
+    return true;
+  }
+
+  size_t index = 0;
+  for (size_t i = first; i < first + count; ++i) {
+    stmt->setInt(index++, sightings[i].bucket);
+    stmt->setInt(index++, sightings[i].device);
+    stmt->setInt(index++, sightings[i].event);
+    stmt->setString(index++, sightings[i].old_value);
+    stmt->setString(index++, sightings[i].new_value);
+    stmt->setInt(index++, sightings[i].count);
+  }
+
+  return stmt->execute();
+}
+
+// Appends conversations using batches whose size is a power of two
+bool MysqlStorage::writeConversations(
+    const vector<Conversation>& traffic)
+{
+  bool error = false;
+
+  if (traffic.empty()) {
+    return false;
+  }
+
+  Connection* con = db->acquire();
+  if (con == NULL) {
+    return true;
+  }
+
+  // Batches are written in a single transaction, as counters are added to
+  // stored ones and failed conversations are written again later
+  error = con->begin();
+  size_t first = 0;
+  while (not error and first < traffic.size()) {
+    size_t count = BATCH_ROWS;
+    while (count > traffic.size() - first) {
+      count >>= 1;
+    }
+
+    error = writeConversations(con, traffic, first, count);
+    first += count;
+  }
+
+  if (error) {
+    con->rollback();
+  }
+  else {
+    error = con->commit();
+  }
+
+  db->release(con);
+  return error;
+}
+
+// Removes conversations of older buckets
+bool MysqlStorage::expireConversations(time_t before) {
+  Connection* con = db->acquire();
+  if (con == NULL) {
+    return true;
+  }
+
+  Statement* stmt = con->prepare("DELETE FROM conversations "
+      "WHERE bucket < FROM_UNIXTIME(?)");
+  bool error = (stmt == NULL);
+  if (not error) {
+    stmt->setInt(0, before);
+    error = stmt->execute();
+  }
+
+  db->release(con);
+  return error;
+}
+
+// Write some conversations using a single statement
+bool MysqlStorage::writeConversations(Connection* con,
+    const vector<Conversation>& traffic, size_t first, size_t count)
+{
+  stringstream sql;
+  sql << "INSERT INTO conversations(bucket, src_id, dst_id, packets, ";
+  sql << "bytes) VALUES ";
+  for (size_t i = 0; i < count; ++i) {
+    sql << (i ? ", " : "") << "(FROM_UNIXTIME(?), ?, ?, ?, ?)";
+  }
+  sql << " ON DUPLICATE KEY UPDATE packets = packets + VALUES(packets), ";
+  sql << "bytes = bytes + VALUES(bytes)";
+
+  Statement* stmt = con->prepare(sql.str());
+  if (stmt == NULL) {
+    return true;
+  }
+
+  size_t index = 0;
+  for (size_t i = first; i < first + count; ++i) {
+    stmt->setInt(index++, traffic[i].bucket);
+    stmt->setInt(index++, traffic[i].src);
+    stmt->setInt(index++, traffic[i].dst);
+    stmt->setInt64(index++, traffic[i].packets);
+    stmt->setInt64(index++, traffic[i].bytes);
+  }
+
+  return stmt->execute();
+}
@@ -0,0 +1,146 @@
+/**
+ * Copyright 2013 Ezequiel Vázquez De la calle
+ *
+ * This file is part of Swarm.
+ *
+ * Swarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Swarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file Class MysqlStorage definition
+ */
+
+#ifndef _MYSQLSTORAGE_H_
+#define _MYSQLSTORAGE_H_
+
+  #include <iostream>
+  #include <sstream>
+  #include <string>
+  #include <vector>
+
+  #include "db.h"
+  #include "storage.h"
+  using namespace std;
+
+  /**
+   * Storage backend which persists devices on a MySQL server, using
+   * connection pool of db object. Devices are written as multi-row upserts
+   * which only touch changed columns, keyed by id or unique ip address
+   */
+  class MysqlStorage : public Storage {
+    public:
+
+      // Maximum number of rows written by a single statement
+      static const size_t BATCH_ROWS = 64;
+
+      /**
+       * Returns highest device id stored
+       * @param id Highest id, or zero if there are no devices
+       * @return True if there was an error, false either
+       */
+      bool getLastId(int& id);
+
+      /**
+       * Streams all stored devices, newest first
+       * @param devices Map where devices are inserted, by ip address
+       * @return True if there was an error, false either
+       */
+      bool load(Devices& devices);
+
+      /**
+       * Reads all stored devices one at a time, by id order, streaming
+       * them from server
+       * @param reader Receiver of devices
+       * @return True if there was an error or reader stopped, false either
+       */
+      bool scan(DeviceReader& reader);
+
+      /**
+       * Reads a device using its id
+       * @param id Identifier of device to read
+       * @param device Device where read attributes are stored
+       * @return True if there was an error, or device was not found
+       */
+      bool read(int id, Device& device);
+
+      /**
+       * Writes devices using batches whose size is a power of two, so only
+       * a few different statements are ever prepared
+       * @param devices Devices to write
+       * @param fields Mask of DeviceField values to write, same for all
+       * @return True if there was an error, false either
+       */
+      bool write(const vector<Device>& devices, int fields);
+
+      /**
+       * Appends sightings in a single transaction, using batches whose
+       * size is a power of two. Counts of sightings already written are
+       * added
+       * @param sightings Sightings to write, sorted by bucket
+       * @return True if there was an error, false either
+       */
+      bool writeSightings(const vector<Sighting>& sightings);
+
+      /**
+       * Removes sightings of older buckets
+       * @param before Buckets starting before this time are removed
+       * @return True if there was an error, false either
+       */
+      bool expireSightings(time_t before);
+
+      /**
+       * Appends conversations in a single transaction, using batches whose
+       * size is a power of two. Counters of conversations already written
+       * are added
+       * @param traffic Conversations to write
+       * @return True if there was an error, false either
+       */
+      bool writeConversations(const vector<Conversation>& traffic);
+
+      /**
+       * Removes conversations of older buckets
+       * @param before Buckets starting before this time are removed
+       * @return True if there was an error, false either
+       */
+      bool expireConversations(time_t before);
+
+    private:
+      // Private function which returns expression reading a column, as
+      // addresses are stored as binary
+      static string getSelect(int index);
+
+      // Private function which returns placeholder of a column value
+      static const char* getPlaceholder(int index);
+
+      // Private function which returns select list of all columns
+      static string getColumns(void);
+
+      // Private function which writes some rows using a single statement.
+      // Returns true if there was an error
+      bool write(Connection* con, const vector<Device>& devices, int fields,
+          size_t first, size_t count);
+
+      // Private function which writes some sightings using a single
+      // statement. Returns true if there was an error
+      bool writeSightings(Connection* con, const vector<Sighting>& sightings,
+          size_t first, size_t count);
+
+      // Private function which writes some conversations using a single
+      // statement. Returns true if there was an error
+      bool writeConversations(Connection* con,
+          const vector<Conversation>& traffic, size_t first,
+          size_t count);
+  };
+
+#endif
@@ -0,0 +1,451 @@
+/**
+ * Copyright 2013 Ezequiel Vázquez De la calle
+ *
+ * This file is part of Swarm.
+ *
+ * Swarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Swarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file Class Poller method definition
+ */
+
+#include "poller.h"
+using namespace std;
+
+Poller* Poller::_instance = 0;
+const size_t Poller::MAX_REQUESTS;
+const int Poller::RATE;
+const int Poller::TIMEOUT;
+const int Poller::RETRIES;
+const int Poller::RETRY;
+
+// BER tags and SNMP constants used by poller
+#define BER_INTEGER 0x02
+#define BER_OCTET_STRING 0x04
+#define BER_NULL 0x05
+#define BER_OID 0x06
+#define BER_SEQUENCE 0x30
+#define SNMP_GET_REQUEST 0xA0
+#define SNMP_GET_RESPONSE 0xA2
+#define SNMP_VERSION_2C 1
+
+// Encoded object identifiers of sysDescr.0 and sysName.0
+static const string SYS_DESCR("\x2B\x06\x01\x02\x01\x01\x01\x00", 8);
+static const string SYS_NAME("\x2B\x06\x01\x02\x01\x01\x05\x00", 8);
+
+// Constructor
+Poller::Poller(void) {
+  _socket = -1;
+  _port = 161;
+  _next_id = 1;
+  _tokens = 0;
+  _initialized = false;
+}
+
+// Destructor
+Poller::~Poller(void) {
+  if (_socket != -1) {
+    close(_socket);
+  }
+}
+
+// Initialize poller object, and launch as thread
+void Poller::start(string community, int port) {
+  // Do not initialize twice
+  if (_initialized) {
+    return;
+  }
+
+  // Open non-blocking UDP socket, shared by requests to all devices
+  _socket = socket(AF_INET, SOCK_DGRAM, 0);
+  if (_socket == -1 or
+      fcntl(_socket, F_SETFL, fcntl(_socket, F_GETFL) | O_NONBLOCK) == -1)
+  {
+    cerr << "ERROR - Can't open socket for SNMP requests" << endl;
+    exit(EXIT_FAILURE);
+  }
+
+  // Start request ids on a random positive value
+  srand(time(NULL));
+  _next_id = (rand() & 0x7FFFFFFF) | 1;
+
+  // Launch thread
+  _community = community;
+  _port = port;
+  _refill = chrono::steady_clock::now();
+  _initialized = true;
+  thread t1(pollDevices);
+  t1.detach();
+}
+
+// Queue some device to ask for its name and description
+bool Poller::enqueue(const Ipv4Addr& ip) {
+  // Nothing to do if poller is not running
+  if (not _initialized) {
+    return false;
+  }
+
+  _mutex.lock();
+
+  // Device which could not tell its description waits before it's asked
+  // again
+  map<Ipv4Addr,chrono::steady_clock::time_point>::iterator it;
+  it = _failed.find(ip);
+  if (it != _failed.end()) {
+    if (chrono::steady_clock::now() < it->second) {
+      _mutex.unlock();
+      return false;
+    }
+    _failed.erase(it);
+  }
+
+  bool queued = _queued.insert(ip).second;
+  if (queued) {
+    _pending.push_back(ip);
+  }
+  _mutex.unlock();
+
+  return queued;
+}
+
+// Send queued requests
+void Poller::send(void) {
+  chrono::steady_clock::time_point now = chrono::steady_clock::now();
+
+  _mutex.lock();
+
+  // Refill request budget, allowing bursts of at most one second
+  chrono::duration<double> elapsed = now - _refill;
+  _tokens = min((double)RATE, _tokens + elapsed.count() * RATE);
+  _refill = now;
+
+  while (_tokens >= 1 and _requests.size() < MAX_REQUESTS and
+      not _pending.empty())
+  {
+    // Find a free request id, keeping it positive
+    while (_requests.find(_next_id) != _requests.end() or _next_id <= 0) {
+      _next_id = (_next_id < 0x7FFFFFFF) ? _next_id + 1 : 1;
+    }
+
+    // Socket buffer is full, so try again later
+    if (request(_next_id, _pending.front())) {
+      break;
+    }
+
+    Request& r = _requests[_next_id];
+    r.ip = _pending.front();
+    r.attempts = 1;
+    r.sent = now;
+    _next_id = (_next_id < 0x7FFFFFFF) ? _next_id + 1 : 1;
+    _pending.pop_front();
+    _tokens -= 1;
+  }
+
+  _mutex.unlock();
+}
+
+// Wait for answers and process them
+void Poller::receive(void) {
+  u_char msg[65535];
+  ssize_t len;
+  struct sockaddr_in sa;
+  socklen_t sa_len = sizeof(sa);
+  vector<Answer> found;
+
+  // Wait a few milliseconds for something to read
+  struct pollfd fd = {_socket, POLLIN, 0};
+  if (poll(&fd, 1, 10) <= 0) {
+    return;
+  }
+
+  // Process everything received until now
+  _mutex.lock();
+  while ((len = recvfrom(_socket, msg, sizeof(msg), 0,
+      (struct sockaddr*)&sa, &sa_len)) > 0)
+  {
+    process(msg, len, Ipv4Addr::fromNetwork(sa.sin_addr.s_addr));
+    sa_len = sizeof(sa);
+  }
+  found.swap(_found);
+  _mutex.unlock();
+
+  // Store results on corresponding devices, without holding lock. Reverse
+  // DNS names are preferred, so sysName is only used if there is none
+  for (size_t i = 0; i < found.size(); ++i) {
+    const Ipv4Addr& ip = found[i].ip;
+    Device dev;
+
+    try {
+      dev = monitor->getDevice(ip);
+    }
+    catch (exception) {
+      continue;
+    }
+
+    if (dev.getHostname().empty()) {
+      dev.setHostname(found[i].name);
+    }
+    dev.setDescription(found[i].description);
+    if (monitor->updateDevice(ip, dev)) {
+      cerr << "ERROR - Can't update device with ip " << ip << endl;
+    }
+  }
+
+  // Answers are stored, so devices may be queued again
+  _mutex.lock();
+  for (size_t i = 0; i < found.size(); ++i) {
+    _queued.erase(found[i].ip);
+  }
+  _mutex.unlock();
+}
+
+// Send again requests which got no answer in time, or give up
+void Poller::expire(void) {
+  chrono::steady_clock::time_point now = chrono::steady_clock::now();
+
+  _mutex.lock();
+  map<int32_t,Request>::iterator it = _requests.begin();
+  while (it != _requests.end()) {
+    Request& r = it->second;
+
+    if (now - r.sent < chrono::seconds(TIMEOUT)) {
+      ++it;
+      continue;
+    }
+
+    // Retry using the same id, so a late answer is still accepted
+    if (r.attempts <= RETRIES) {
+      if (not request(it->first, r.ip)) {
+        r.attempts++;
+        r.sent = now;
+      }
+      ++it;
+    }
+    else {
+      _queued.erase(r.ip);
+      _failed[r.ip] = now + chrono::seconds(RETRY);
+      _requests.erase(it++);
+    }
+  }
+  _mutex.unlock();
+}
+
+// Checks if poller has been initialized
+bool Poller::isRunning(void) const {
+  return _initialized;
+}
+
+// Build and send a GET request. Returns true if it could not be sent
+bool Poller::request(int32_t id, const Ipv4Addr& ip) {
+  string oid, null, varbinds, pdu, body, msg;
+  struct sockaddr_in sa;
+
+  // Destination address
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_port = htons(_port);
+  sa.sin_addr.s_addr = ip.toNetwork();
+
+  // Request id is encoded as a four bytes signed integer
+  string id_bytes;
+  id_bytes.push_back((id >> 24) & 0xFF);
+  id_bytes.push_back((id >> 16) & 0xFF);
+  id_bytes.push_back((id >> 8) & 0xFF);
+  id_bytes.push_back(id & 0xFF);
+
+  // Variable bindings, asking for sysName and sysDescr
+  writeTlv(null, BER_NULL, string());
+  writeTlv(oid, BER_OID, SYS_NAME);
+  writeTlv(varbinds, BER_SEQUENCE, oid + null);
+  oid.clear();
+  writeTlv(oid, BER_OID, SYS_DESCR);
+  writeTlv(varbinds, BER_SEQUENCE, oid + null);
+
+  // Protocol data unit: request id, error status and index, and bindings
+  writeTlv(pdu, BER_INTEGER, id_bytes);
+  writeTlv(pdu, BER_INTEGER, string(1, 0));
+  writeTlv(pdu, BER_INTEGER, string(1, 0));
+  writeTlv(pdu, BER_SEQUENCE, varbinds);
+
+  // Message: version, community and protocol data unit
+  writeTlv(body, BER_INTEGER, string(1, SNMP_VERSION_2C));
+  writeTlv(body, BER_OCTET_STRING, _community);
+  writeTlv(body, SNMP_GET_REQUEST, pdu);
+  writeTlv(msg, BER_SEQUENCE, body);
+
+  return (sendto(_socket, msg.data(), msg.size(), 0, (struct sockaddr*)&sa,
+      sizeof(sa)) != (ssize_t)msg.size());
+}
+
+// Parse an answer received from some ip
+void Poller::process(const u_char* msg, size_t len,
+    const Ipv4Addr& from)
+{
+  size_t pos = 0;
+  size_t vlen;
+  u_char tag;
+  Answer answer;
+
+  // Message header: sequence, version and community
+  if (readTlv(msg, len, pos, tag, vlen) or tag != BER_SEQUENCE or
+      readTlv(msg, len, pos, tag, vlen) or tag != BER_INTEGER)
+  {
+    return;
+  }
+  pos += vlen;
+  if (readTlv(msg, len, pos, tag, vlen) or tag != BER_OCTET_STRING) {
+    return;
+  }
+  pos += vlen;
+
+  // Response PDU and its request id
+  if (readTlv(msg, len, pos, tag, vlen) or tag != SNMP_GET_RESPONSE or
+      readTlv(msg, len, pos, tag, vlen) or tag != BER_INTEGER or
+      vlen == 0 or vlen > 4)
+  {
+    return;
+  }
+  int32_t id = (msg[pos] & 0x80) ? -1 : 0;
+  for (size_t i = 0; i < vlen; ++i) {
+    id = (id << 8) | msg[pos + i];
+  }
+  pos += vlen;
+
+  // Discard answers to unknown requests, or coming from another device
+  map<int32_t,Request>::iterator it = _requests.find(id);
+  if (it == _requests.end() or it->second.ip != from) {
+    return;
+  }
+  answer.ip = from;
+  _requests.erase(it);
+
+  // Devices which can't tell their description are asked again after a
+  // while. Devices with something to store stay queued until it's stored
+  bool failed = readAnswer(msg, len, pos, answer) or
+      answer.description.empty();
+  if (failed) {
+    _failed[from] = chrono::steady_clock::now() + chrono::seconds(RETRY);
+  }
+  if (not answer.name.empty() or not answer.description.empty()) {
+    _found.push_back(answer);
+  }
+  else {
+    _queued.erase(from);
+  }
+}
+
+// Read error status and variable bindings of an answer
+bool Poller::readAnswer(const u_char* msg, size_t len, size_t pos,
+    Answer& answer) const
+{
+  size_t vlen;
+  u_char tag;
+
+  // Error status: device has no answer for us
+  if (readTlv(msg, len, pos, tag, vlen) or tag != BER_INTEGER) {
+    return true;
+  }
+  bool error = (vlen != 1 or msg[pos] != 0);
+  pos += vlen;
+  if (error or readTlv(msg, len, pos, tag, vlen) or tag != BER_INTEGER) {
+    return true;
+  }
+  pos += vlen;
+
+  // Variable bindings: take string values of known objects
+  if (readTlv(msg, len, pos, tag, vlen) or tag != BER_SEQUENCE) {
+    return true;
+  }
+  size_t end = pos + vlen;
+  while (pos < end) {
+    if (readTlv(msg, len, pos, tag, vlen) or tag != BER_SEQUENCE) {
+      return true;
+    }
+    size_t next = pos + vlen;
+
+    if (readTlv(msg, len, pos, tag, vlen) or tag != BER_OID) {
+      return true;
+    }
+    string oid((const char*)msg + pos, vlen);
+    pos += vlen;
+
+    if (readTlv(msg, len, pos, tag, vlen)) {
+      return true;
+    }
+    if (tag == BER_OCTET_STRING) {
+      // Control characters, as new lines on descriptions, become spaces
+      string value((const char*)msg + pos, vlen);
+      for (size_t i = 0; i < value.size(); ++i) {
+        if ((u_char)value[i] < 0x20 or value[i] == 0x7F) {
+          value[i] = ' ';
+        }
+      }
+      if (oid == SYS_NAME) {
+        answer.name = value;
+      }
+      else if (oid == SYS_DESCR) {
+        answer.description = value;
+      }
+    }
+    pos = next;
+  }
+
+  return false;
+}
+
+// Read type and length of a BER encoded value
+bool Poller::readTlv(const u_char* msg, size_t len, size_t& pos, u_char& tag,
+    size_t& vlen) const
+{
+  if (pos + 2 > len) {
+    return true;
+  }
+  tag = msg[pos++];
+  vlen = msg[pos++];
+
+  // Long form: low bits tell how many bytes hold length
+  if (vlen & 0x80) {
+    size_t bytes = vlen & 0x7F;
+    if (bytes == 0 or bytes > 4 or pos + bytes > len) {
+      return true;
+    }
+    vlen = 0;
+    for (size_t i = 0; i < bytes; ++i) {
+      vlen = (vlen << 8) | msg[pos++];
+    }
+  }
+
+  return (pos + vlen > len);
+}
+
+// Append a BER encoded value to a buffer
+void Poller::writeTlv(string& out, u_char tag, const string& value) const {
+  out.push_back(tag);
+
+  // Short form for lengths below 128, else long form
+  if (value.size() < 0x80) {
+    out.push_back(value.size());
+  }
+  else if (value.size() <= 0xFF) {
+    out.push_back((char)0x81);
+    out.push_back(value.size());
+  }
+  else {
+    out.push_back((char)0x82);
+    out.push_back((value.size() >> 8) & 0xFF);
+    out.push_back(value.size() & 0xFF);
+  }
+  out.append(value);
+}
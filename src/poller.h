@@ -0,0 +1,201 @@
+/**
+ * Copyright 2013 Ezequiel Vázquez De la calle
+ *
+ * This file is part of Swarm.
+ *
+ * Swarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Swarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file Class Poller definition. Singleton pattern implementation
+ */
+
+#ifndef _POLLER_H_
+#define _POLLER_H_
+
+  #include <arpa/inet.h>
+  #include <chrono>
+  #include <cstring>
+  #include <deque>
+  #include <fcntl.h>
+  #include <iostream>
+  #include <map>
+  #include <mutex>
+  #include <poll.h>
+  #include <set>
+  #include <string>
+  #include <sys/socket.h>
+  #include <thread>
+  #include <vector>
+
+  #include "actions.h"
+  #include "monitor.h"
+  using namespace std;
+
+  /**
+   * Singleton object which asks devices for their name and description,
+   * using SNMP v2c GET requests for sysName and sysDescr. A single
+   * non-blocking UDP socket is shared by all requests, which are matched
+   * to their answers using request id, so thousands of devices may be
+   * waiting for an answer at the same time.
+   */
+  class Poller {
+    public:
+
+      // Maximum number of requests waiting for an answer
+      static const size_t MAX_REQUESTS = 4096;
+
+      // Maximum number of requests sent per second
+      static const int RATE = 500;
+
+      // Seconds to wait for an answer before sending request again
+      static const int TIMEOUT = 2;
+
+      // Times a request is sent again before giving up
+      static const int RETRIES = 1;
+
+      // Seconds before a device which could not tell its description is
+      // asked again
+      static const int RETRY = 3600;
+
+      /**
+       * Implementation of Singleton pattern
+       * @return Pointer to singleton poller object
+       */
+      static Poller* getInstance(void) {
+        if (_instance == 0) {
+          _instance = new Poller();
+        }
+        return _instance;
+      }
+
+      /**
+       * Destroyer for singleton poller object
+       */
+      static void destroy(void) {
+        delete _instance;
+      }
+
+      /**
+       * Initialize poller object, and launch as thread
+       * @param community SNMP community used on requests
+       * @param port UDP port where devices listen for SNMP requests
+       */
+      void start(string community = "public", int port = 161);
+
+      /**
+       * Queue some device to ask for its name and description. Devices
+       * already queued or being asked, or which could not tell their
+       * description recently, are discarded
+       * @param ip Ip address of device to ask
+       * @return True if device was queued, false if it was discarded
+       */
+      bool enqueue(const Ipv4Addr& ip);
+
+      /**
+       * Send queued requests, without exceeding rate and number of requests
+       * waiting for an answer
+       */
+      void send(void);
+
+      /**
+       * Wait a few milliseconds for answers, process all received ones, and
+       * store results on monitor
+       */
+      void receive(void);
+
+      /**
+       * Send again requests which got no answer in time, or give up
+       */
+      void expire(void);
+
+      /**
+       * Checks if poller has been initialized
+       * @return True if poller is running, false either
+       */
+      bool isRunning(void) const;
+
+    protected:
+      // Constructor, destructor, copy constructor and assing operator
+      // are protected due to singleton pattern implementation
+      Poller(void);
+      ~Poller(void);
+      Poller(const Poller& poller);
+      Poller& operator=(const Poller& poller);
+
+    private:
+      // Request waiting for an answer
+      struct Request {
+        Ipv4Addr ip;
+        int attempts;
+        chrono::steady_clock::time_point sent;
+      };
+
+      // Answer waiting to be stored on monitor
+      struct Answer {
+        Ipv4Addr ip;
+        string name;
+        string description;
+      };
+
+      // Private function which builds and sends a GET request
+      bool request(int32_t id, const Ipv4Addr& ip);
+
+      // Private function which parses an answer received from some ip
+      void process(const u_char* msg, size_t len, const Ipv4Addr& from);
+
+      // Private function which reads error status and values of an
+      // answer, starting at its error status. Returns true if device
+      // answered an error, or answer is malformed
+      bool readAnswer(const u_char* msg, size_t len, size_t pos,
+          Answer& answer) const;
+
+      // Private function which reads type and length of a BER encoded
+      // value, leaving position at value start. Returns true if malformed
+      bool readTlv(const u_char* msg, size_t len, size_t& pos, u_char& tag,
+          size_t& vlen) const;
+
+      // Private function which appends a BER encoded value to a buffer
+      void writeTlv(string& out, u_char tag, const string& value) const;
+
+      // Attributes
+      int _socket;
+      int _port;
+      string _community;
+      int32_t _next_id;
+      double _tokens;
+      chrono::steady_clock::time_point _refill;
+      bool _initialized;
+      mutex _mutex;
+      static Poller* _instance;
+
+      // Devices waiting to be asked, requests waiting for an answer, and
+      // answers waiting to be stored on monitor
+      deque<Ipv4Addr> _pending;
+      map<int32_t,Request> _requests;
+      vector<Answer> _found;
+
+      // Internal list of devices queued or being asked, until their answer
+      // is stored. Avoid repeating tasks, while letting answered devices be
+      // asked again
+      set<Ipv4Addr> _queued;
+
+      // Devices which could not tell their description, and when they may
+      // be asked again
+      map<Ipv4Addr,chrono::steady_clock::time_point> _failed;
+  };
+
+  #define poller Poller::getInstance()
+
+#endif
@@ -0,0 +1,122 @@
+/**
+ * Copyright 2013 Ezequiel Vázquez De la calle
+ *
+ * This file is part of Swarm.
+ *
+ * Swarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Swarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file Class Pool method definition
+ */
+
+#include "pool.h"
+using namespace std;
+
+const size_t Pool::SLAB_SIZE;
+mutex Pool::_pools_mutex;
+
+// Constructor: registers pool. Blocks are big enough to link them
+Pool::Pool(size_t size) {
+  _size = max(size, sizeof(Block));
+  _size = (_size + sizeof(void*) - 1) / sizeof(void*) * sizeof(void*);
+  _free = NULL;
+  _used = 0;
+  _available = 0;
+
+  lock_guard<mutex> lock(_pools_mutex);
+  getPools().push_back(this);
+}
+
+// Destructor: unregisters pool, and releases its slabs
+Pool::~Pool(void) {
+  {
+    lock_guard<mutex> lock(_pools_mutex);
+    vector<Pool*>& pools = getPools();
+    for (size_t i = 0; i < pools.size(); ++i) {
+      if (pools[i] == this) {
+        pools.erase(pools.begin() + i);
+        break;
+      }
+    }
+  }
+
+  for (size_t i = 0; i < _slabs.size(); ++i) {
+    delete[] _slabs[i];
+  }
+}
+
+// Takes a block from free list, carving a new slab if it's empty
+void* Pool::allocate(void) {
+  lock_guard<mutex> lock(_mutex);
+  if (_free == NULL) {
+    grow();
+  }
+
+  Block* block = _free;
+  _free = block->next;
+  ++_used;
+  --_available;
+  return block;
+}
+
+// Gives back a block to free list
+void Pool::deallocate(void* block) {
+  lock_guard<mutex> lock(_mutex);
+  Block* freed = (Block*)block;
+  freed->next = _free;
+  _free = freed;
+  --_used;
+  ++_available;
+}
+
+// Adds up statistics of all pools
+void Pool::getStats(uint64_t& slabs, uint64_t& used, uint64_t& free) {
+  slabs = 0;
+  used = 0;
+  free = 0;
+
+  lock_guard<mutex> lock(_pools_mutex);
+  vector<Pool*>& pools = getPools();
+  for (size_t i = 0; i < pools.size(); ++i) {
+    lock_guard<mutex> pool_lock(pools[i]->_mutex);
+    slabs += pools[i]->_slabs.size();
+    used += pools[i]->_used;
+    free += pools[i]->_available;
+  }
+}
+
+
+// Carves a new slab into blocks, all of them linked on free list. Slabs
+// hold at least a block, whatever its size
+void Pool::grow(void) {
+  size_t count = max((size_t)1, SLAB_SIZE / _size);
+  char* slab = new char[count * _size];
+  _slabs.push_back(slab);
+
+  for (size_t i = count; i > 0; --i) {
+    Block* block = (Block*)(slab + (i - 1) * _size);
+    block->next = _free;
+    _free = block;
+  }
+  _available += count;
+}
+
+// Returns list of registered pools. Built on first use, so pools of
+// static containers find it
+vector<Pool*>& Pool::getPools(void) {
+  static vector<Pool*> pools;
+  return pools;
+}
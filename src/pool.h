@@ -0,0 +1,191 @@
+/**
+ * Copyright 2013 Ezequiel Vázquez De la calle
+ *
+ * This file is part of Swarm.
+ *
+ * Swarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Swarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file Class Pool and PoolAllocator definition
+ */
+
+#ifndef _POOL_H_
+#define _POOL_H_
+
+  #include <cstddef>
+  #include <cstdint>
+  #include <mutex>
+  #include <new>
+  #include <vector>
+
+  using namespace std;
+
+  /**
+   * Allocator of fixed size blocks, carved from large slabs. Freed blocks
+   * are kept on a free list and given again on next allocations, so once
+   * a container has reached its size, inserting and erasing its elements
+   * takes no memory from heap. Slabs are only returned to heap when pool
+   * is destroyed.
+   *
+   * Pools are safe to use from several threads, and all of them are
+   * registered, so their statistics can be added up.
+   */
+  class Pool {
+    public:
+
+      // Bytes of each slab
+      static const size_t SLAB_SIZE = 65536;
+
+      /**
+       * Constructor
+       * @param size Bytes of each block
+       */
+      explicit Pool(size_t size);
+
+      /**
+       * Destructor. Releases all slabs, so no block must be in use
+       */
+      ~Pool(void);
+
+      /**
+       * Takes a block
+       * @return Pointer to a block of pool size
+       */
+      void* allocate(void);
+
+      /**
+       * Gives back a block
+       * @param block Block previously taken from this pool
+       */
+      void deallocate(void* block);
+
+      /**
+       * Adds up statistics of all pools
+       * @param slabs Number of slabs taken from heap
+       * @param used Number of blocks in use
+       * @param free Number of blocks on free lists
+       */
+      static void getStats(uint64_t& slabs, uint64_t& used, uint64_t& free);
+
+    private:
+      // Copy constructor and assign operator are private, as each pool
+      // owns its slabs
+      Pool(const Pool& pool);
+      Pool& operator=(const Pool& pool);
+
+      // Free blocks are linked through their own memory
+      struct Block {
+        Block* next;
+      };
+
+      // Private function which carves a new slab into free blocks
+      void grow(void);
+
+      // Private function which returns list of registered pools
+      static vector<Pool*>& getPools(void);
+
+      // Attributes
+      size_t _size;
+      Block* _free;
+      vector<char*> _slabs;
+      uint64_t _used;
+      uint64_t _available;
+      mutex _mutex;
+      static mutex _pools_mutex;
+  };
+
+  /**
+   * Allocator for node based containers (map, set, list), which takes
+   * nodes from a pool of their size. Requests of several elements at once
+   * go to heap
+   */
+  template<class T> class PoolAllocator {
+    public:
+      // Types required from allocators
+      typedef T value_type;
+      typedef T* pointer;
+      typedef const T* const_pointer;
+      typedef T& reference;
+      typedef const T& const_reference;
+      typedef size_t size_type;
+      typedef ptrdiff_t difference_type;
+
+      template<class U> struct rebind {
+        typedef PoolAllocator<U> other;
+      };
+
+      // Constructors. Allocator has no state, so all of them are equal
+      PoolAllocator(void) {}
+      PoolAllocator(const PoolAllocator&) {}
+      template<class U> PoolAllocator(const PoolAllocator<U>&) {}
+
+      pointer address(reference value) const {
+        return &value;
+      }
+
+      const_pointer address(const_reference value) const {
+        return &value;
+      }
+
+      pointer allocate(size_type n, const void* = 0) {
+        if (n == 1) {
+          return (pointer)getPool().allocate();
+        }
+        return (pointer)::operator new(n * sizeof(T));
+      }
+
+      void deallocate(pointer p, size_type n) {
+        if (n == 1) {
+          getPool().deallocate(p);
+        }
+        else {
+          ::operator delete(p);
+        }
+      }
+
+      size_type max_size(void) const {
+        return size_t(-1) / sizeof(T);
+      }
+
+      template<class U, class... Args> void construct(U* p, Args&&... args) {
+        ::new((void*)p) U(std::forward<Args>(args)...);
+      }
+
+      template<class U> void destroy(U* p) {
+        p->~U();
+      }
+
+    private:
+      // Private function which returns pool of blocks of this type, shared
+      // by all containers. Pool is never destroyed, as containers of
+      // static objects may give back their blocks after it
+      static Pool& getPool(void) {
+        static Pool* pool = new Pool(sizeof(T));
+        return *pool;
+      }
+  };
+
+  template<class T, class U>
+  bool operator==(const PoolAllocator<T>&, const PoolAllocator<U>&) {
+    return true;
+  }
+
+  template<class T, class U>
+  bool operator!=(const PoolAllocator<T>&, const PoolAllocator<U>&) {
+    return false;
+  }
+
+#endif
@@ -0,0 +1,442 @@
+/**
+ * Copyright 2013 Ezequiel Vázquez De la calle
+ *
+ * This file is part of Swarm.
+ *
+ * Swarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Swarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file Class Resolver method definition
+ */
+
+#include "resolver.h"
+using namespace std;
+
+Resolver* Resolver::_instance = 0;
+const size_t Resolver::MAX_QUERIES;
+const int Resolver::RATE;
+const int Resolver::TIMEOUT;
+const int Resolver::RETRIES;
+const int Resolver::NEGATIVE_TTL;
+const int Resolver::FAILURE_TTL;
+const int Resolver::MAX_TTL;
+
+// DNS constants used by resolver
+#define DNS_HEADER_SIZE 12
+#define DNS_FLAG_QR 0x8000
+#define DNS_FLAG_RD 0x0100
+#define DNS_RCODE_MASK 0x000F
+#define DNS_RCODE_NOERROR 0
+#define DNS_RCODE_NXDOMAIN 3
+#define DNS_TYPE_SOA 6
+#define DNS_TYPE_PTR 12
+#define DNS_CLASS_IN 1
+
+// Constructor
+Resolver::Resolver(void) {
+  _socket = -1;
+  _next_id = 0;
+  _tokens = 0;
+  _initialized = false;
+}
+
+// Destructor
+Resolver::~Resolver(void) {
+  if (_socket != -1) {
+    close(_socket);
+  }
+}
+
+// Initialize resolver object, and launch as thread
+void Resolver::start(string server, int port) {
+  struct sockaddr_in sa;
+
+  // Do not initialize twice
+  if (_initialized) {
+    return;
+  }
+
+  // Use system nameserver, if none received
+  if (server.empty()) {
+    server = getDefaultServer();
+  }
+
+  // Check server address validity
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_port = htons(port);
+  if (inet_pton(AF_INET, server.c_str(), &(sa.sin_addr)) <= 0) {
+    cerr << "ERROR - Invalid DNS server address " << server << endl;
+    exit(EXIT_FAILURE);
+  }
+
+  // Open non-blocking UDP socket, connected to server so answers from
+  // anyone else are discarded by kernel
+  _socket = socket(AF_INET, SOCK_DGRAM, 0);
+  if (_socket == -1 or
+      fcntl(_socket, F_SETFL, fcntl(_socket, F_GETFL) | O_NONBLOCK) == -1 or
+      connect(_socket, (struct sockaddr*)&sa, sizeof(sa)) == -1)
+  {
+    cerr << "ERROR - Can't open socket to DNS server " << server << endl;
+    exit(EXIT_FAILURE);
+  }
+
+  // Start query ids on a random value
+  srand(time(NULL));
+  _next_id = (u_int16_t)rand();
+
+  // Launch thread
+  _refill = chrono::steady_clock::now();
+  _initialized = true;
+  thread t1(resolve);
+  t1.detach();
+}
+
+// Queue some device to guess its hostname
+bool Resolver::enqueue(const Ipv4Addr& ip) {
+  // Nothing to do if resolver is not running
+  if (not _initialized) {
+    return false;
+  }
+
+  _mutex.lock();
+
+  // Device is already queued or being queried
+  if (_queued.find(ip) != _queued.end()) {
+    _mutex.unlock();
+    return false;
+  }
+
+  // Device has a cached answer. Expired answers are removed, so device is
+  // queried again
+  map<Ipv4Addr,Entry>::iterator it = _cache.find(ip);
+  if (it != _cache.end()) {
+    if (chrono::steady_clock::now() < it->second.expires) {
+      _mutex.unlock();
+      return false;
+    }
+    _cache.erase(it);
+  }
+
+  _queued.insert(ip);
+  _pending.push_back(ip);
+  _mutex.unlock();
+
+  return true;
+}
+
+// Send queued queries
+void Resolver::send(void) {
+  chrono::steady_clock::time_point now = chrono::steady_clock::now();
+
+  _mutex.lock();
+
+  // Refill query budget, allowing bursts of at most one second
+  chrono::duration<double> elapsed = now - _refill;
+  _tokens = min((double)RATE, _tokens + elapsed.count() * RATE);
+  _refill = now;
+
+  while (_tokens >= 1 and _queries.size() < MAX_QUERIES and
+      not _pending.empty())
+  {
+    // Find a free query id
+    while (_queries.find(_next_id) != _queries.end()) {
+      ++_next_id;
+    }
+
+    // Socket buffer is full, so try again later
+    if (query(_next_id, _pending.front())) {
+      break;
+    }
+
+    Query& q = _queries[_next_id++];
+    q.ip = _pending.front();
+    q.attempts = 1;
+    q.sent = now;
+    _pending.pop_front();
+    _tokens -= 1;
+  }
+
+  _mutex.unlock();
+}
+
+// Wait for answers and process them
+void Resolver::receive(void) {
+  u_char msg[1500];
+  ssize_t len;
+  vector<pair<Ipv4Addr,string> > found;
+
+  // Wait a few milliseconds for something to read
+  struct pollfd fd = {_socket, POLLIN, 0};
+  if (poll(&fd, 1, 10) <= 0) {
+    return;
+  }
+
+  // Process everything received until now
+  _mutex.lock();
+  while ((len = recv(_socket, msg, sizeof(msg), 0)) > 0) {
+    process(msg, len);
+  }
+  found.swap(_found);
+  _mutex.unlock();
+
+  // Store hostnames on corresponding devices, without holding lock
+  for (size_t i = 0; i < found.size(); ++i) {
+    const Ipv4Addr& ip = found[i].first;
+    Device dev;
+
+    try {
+      dev = monitor->getDevice(ip);
+    }
+    catch (exception) {
+      continue;
+    }
+
+    dev.setHostname(found[i].second);
+    if (monitor->updateDevice(ip, dev)) {
+      cerr << "ERROR - Can't update device with ip " << ip << endl;
+    }
+  }
+}
+
+// Send again queries which got no answer in time, or give up
+void Resolver::expire(void) {
+  chrono::steady_clock::time_point now = chrono::steady_clock::now();
+
+  _mutex.lock();
+  map<u_int16_t,Query>::iterator it = _queries.begin();
+  while (it != _queries.end()) {
+    Query& q = it->second;
+    u_int16_t id = (it++)->first;
+
+    if (now - q.sent < chrono::seconds(TIMEOUT)) {
+      continue;
+    }
+
+    // Retry using the same id, so a late answer is still accepted
+    if (q.attempts <= RETRIES and not query(id, q.ip)) {
+      q.attempts++;
+      q.sent = now;
+    }
+    else if (q.attempts > RETRIES) {
+      finish(id, string(), FAILURE_TTL);
+    }
+  }
+  _mutex.unlock();
+}
+
+// Checks if resolver has been initialized
+bool Resolver::isRunning(void) const {
+  return _initialized;
+}
+
+// Build and send a PTR query. Returns true if it could not be sent
+bool Resolver::query(u_int16_t id, const Ipv4Addr& ip) {
+  u_char msg[DNS_HEADER_SIZE + 64];
+  string name = getPtrName(ip);
+  size_t len = 0;
+
+  // Header: id, recursion desired flag, and a single question
+  memset(msg, 0, DNS_HEADER_SIZE);
+  msg[0] = id >> 8;
+  msg[1] = id & 0xFF;
+  msg[2] = DNS_FLAG_RD >> 8;
+  msg[5] = 1;
+  len = DNS_HEADER_SIZE;
+
+  // Question name, as a sequence of length prefixed labels
+  size_t start = 0;
+  while (start < name.size()) {
+    size_t end = name.find('.', start);
+    if (end == string::npos) {
+      end = name.size();
+    }
+    msg[len++] = end - start;
+    memcpy(msg + len, name.data() + start, end - start);
+    len += end - start;
+    start = end + 1;
+  }
+  msg[len++] = 0;
+
+  // Question type and class
+  msg[len++] = 0;
+  msg[len++] = DNS_TYPE_PTR;
+  msg[len++] = 0;
+  msg[len++] = DNS_CLASS_IN;
+
+  return (::send(_socket, msg, len, 0) != (ssize_t)len);
+}
+
+// Parse an answer, and cache its result
+void Resolver::process(const u_char* msg, size_t len) {
+  string name;
+  size_t pos = DNS_HEADER_SIZE;
+
+  // Discard anything which is not an answer
+  if (len < DNS_HEADER_SIZE) {
+    return;
+  }
+  u_int16_t id = (msg[0] << 8) | msg[1];
+  u_int16_t flags = (msg[2] << 8) | msg[3];
+  u_int16_t qdcount = (msg[4] << 8) | msg[5];
+  u_int16_t ancount = (msg[6] << 8) | msg[7];
+  u_int16_t nscount = (msg[8] << 8) | msg[9];
+  if (not (flags & DNS_FLAG_QR) or qdcount != 1) {
+    return;
+  }
+
+  // Discard answers to unknown queries, or to some other question
+  map<u_int16_t,Query>::iterator it = _queries.find(id);
+  if (it == _queries.end() or readName(msg, len, pos, name) or
+      pos + 4 > len or strcasecmp(name.c_str(),
+      getPtrName(it->second.ip).c_str()) != 0)
+  {
+    return;
+  }
+  pos += 4;
+
+  // Server failures are cached for a short time
+  int rcode = flags & DNS_RCODE_MASK;
+  if (rcode != DNS_RCODE_NOERROR and rcode != DNS_RCODE_NXDOMAIN) {
+    finish(id, string(), FAILURE_TTL);
+    return;
+  }
+
+  // Look for a PTR record on answer section, and SOA record on authority
+  // section, whose minimum field gives TTL for negative answers
+  int negative_ttl = NEGATIVE_TTL;
+  for (int i = 0; i < ancount + nscount; ++i) {
+    if (readName(msg, len, pos, name) or pos + 10 > len) {
+      break;
+    }
+    u_int16_t type = (msg[pos] << 8) | msg[pos + 1];
+    u_int32_t ttl = (msg[pos + 4] << 24) | (msg[pos + 5] << 16) |
+        (msg[pos + 6] << 8) | msg[pos + 7];
+    u_int16_t rdlength = (msg[pos + 8] << 8) | msg[pos + 9];
+    pos += 10;
+    if (pos + rdlength > len) {
+      break;
+    }
+
+    if (i < ancount and type == DNS_TYPE_PTR) {
+      size_t rdata = pos;
+      if (not readName(msg, len, rdata, name) and not name.empty()) {
+        finish(id, name, min(ttl, (u_int32_t)MAX_TTL));
+        return;
+      }
+    }
+    else if (i >= ancount and type == DNS_TYPE_SOA and rdlength >= 4) {
+      const u_char* min_field = msg + pos + rdlength - 4;
+      u_int32_t minimum = (min_field[0] << 24) | (min_field[1] << 16) |
+          (min_field[2] << 8) | min_field[3];
+      negative_ttl = min(min(ttl, minimum), (u_int32_t)MAX_TTL);
+    }
+    pos += rdlength;
+  }
+
+  // No hostname for this device
+  finish(id, string(), negative_ttl);
+}
+
+// Cache an answer and keep hostname to store it on monitor
+void Resolver::finish(u_int16_t id, const string& hostname, int ttl) {
+  map<u_int16_t,Query>::iterator it = _queries.find(id);
+  const Ipv4Addr& ip = it->second.ip;
+
+  Entry& entry = _cache[ip];
+  entry.hostname = hostname;
+  entry.expires = chrono::steady_clock::now() + chrono::seconds(ttl);
+
+  if (not hostname.empty()) {
+    _found.push_back(make_pair(ip, hostname));
+  }
+
+  _queued.erase(ip);
+  _queries.erase(it);
+}
+
+// Read a domain name, following compression pointers
+bool Resolver::readName(const u_char* msg, size_t len, size_t& pos,
+    string& name) const
+{
+  size_t cur = pos;
+  bool jumped = false;
+  int jumps = 0;
+
+  name.clear();
+  while (cur < len) {
+    u_char label = msg[cur];
+
+    // End of name. Names are returned without root dot
+    if (label == 0) {
+      if (not jumped) {
+        pos = cur + 1;
+      }
+      return false;
+    }
+
+    // Compression pointer: name goes on somewhere else on message. Limit
+    // number of jumps, to avoid loops on malicious messages
+    if ((label & 0xC0) == 0xC0) {
+      if (cur + 1 >= len or ++jumps > 16) {
+        return true;
+      }
+      if (not jumped) {
+        pos = cur + 2;
+        jumped = true;
+      }
+      cur = ((label & 0x3F) << 8) | msg[cur + 1];
+      continue;
+    }
+
+    // Plain label
+    if (cur + 1 + label > len) {
+      return true;
+    }
+    name.append(name.empty() ? "" : ".");
+    name.append((const char*)msg + cur + 1, label);
+    cur += 1 + label;
+  }
+  return true;
+}
+
+// Return reverse DNS domain for an ip address
+string Resolver::getPtrName(const Ipv4Addr& ip) const {
+  stringstream name;
+
+  // Octets are written in reverse order, under in-addr.arpa domain
+  for (int i = 3; i >= 0; --i) {
+    name << (int)ip.getOctet(i) << ".";
+  }
+  name << "in-addr.arpa";
+  return name.str();
+}
+
+// Read first nameserver from resolv.conf
+string Resolver::getDefaultServer(void) const {
+  ifstream f("/etc/resolv.conf");
+  string keyword, server;
+  struct sockaddr_in sa;
+
+  while (f >> keyword) {
+    if (keyword == "nameserver" and f >> server and
+        inet_pton(AF_INET, server.c_str(), &(sa.sin_addr)) > 0)
+    {
+      return server;
+    }
+    getline(f, keyword);
+  }
+  return "127.0.0.1";
+}
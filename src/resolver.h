@@ -0,0 +1,202 @@
+/**
+ * Copyright 2013 Ezequiel Vázquez De la calle
+ *
+ * This file is part of Swarm.
+ *
+ * Swarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Swarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file Class Resolver definition. Singleton pattern implementation
+ */
+
+#ifndef _RESOLVER_H_
+#define _RESOLVER_H_
+
+  #include <arpa/inet.h>
+  #include <chrono>
+  #include <cstring>
+  #include <deque>
+  #include <fcntl.h>
+  #include <fstream>
+  #include <iostream>
+  #include <map>
+  #include <mutex>
+  #include <poll.h>
+  #include <set>
+  #include <sstream>
+  #include <string>
+  #include <strings.h>
+  #include <sys/socket.h>
+  #include <thread>
+  #include <vector>
+
+  #include "actions.h"
+  #include "monitor.h"
+  using namespace std;
+
+  /**
+   * Singleton object which guesses device hostnames using reverse DNS. It
+   * talks to a DNS server through its own non-blocking UDP socket, so lots
+   * of PTR queries may be waiting for an answer at the same time, without
+   * blocking any other thread. Answers, even negative ones, are cached
+   * during the TTL given by server.
+   */
+  class Resolver {
+    public:
+
+      // Maximum number of queries waiting for an answer
+      static const size_t MAX_QUERIES = 1024;
+
+      // Maximum number of queries sent per second
+      static const int RATE = 1000;
+
+      // Seconds to wait for an answer before sending query again
+      static const int TIMEOUT = 2;
+
+      // Times a query is sent again before giving up
+      static const int RETRIES = 2;
+
+      // Seconds to cache a negative answer, if server gives no SOA record
+      static const int NEGATIVE_TTL = 300;
+
+      // Seconds to cache failures, as timeouts or server errors
+      static const int FAILURE_TTL = 60;
+
+      // Maximum seconds to cache any answer
+      static const int MAX_TTL = 86400;
+
+      /**
+       * Implementation of Singleton pattern
+       * @return Pointer to singleton resolver object
+       */
+      static Resolver* getInstance(void) {
+        if (_instance == 0) {
+          _instance = new Resolver();
+        }
+        return _instance;
+      }
+
+      /**
+       * Destroyer for singleton resolver object
+       */
+      static void destroy(void) {
+        delete _instance;
+      }
+
+      /**
+       * Initialize resolver object, and launch as thread
+       * @param server Ip address of DNS server. Empty to use the first
+       * nameserver found on /etc/resolv.conf
+       * @param port UDP port of DNS server
+       */
+      void start(string server = "", int port = 53);
+
+      /**
+       * Queue some device to guess its hostname. Devices already queued, or
+       * whose answer is still cached, are discarded
+       * @param ip Ip address of device to resolve
+       * @return True if device was queued, false if it was discarded
+       */
+      bool enqueue(const Ipv4Addr& ip);
+
+      /**
+       * Send queued queries, without exceeding rate and number of queries
+       * waiting for an answer
+       */
+      void send(void);
+
+      /**
+       * Wait a few milliseconds for answers, process all received ones, and
+       * store found hostnames on monitor
+       */
+      void receive(void);
+
+      /**
+       * Send again queries which got no answer in time, or give up
+       */
+      void expire(void);
+
+      /**
+       * Checks if resolver has been initialized
+       * @return True if resolver is running, false either
+       */
+      bool isRunning(void) const;
+
+    protected:
+      // Constructor, destructor, copy constructor and assing operator
+      // are protected due to singleton pattern implementation
+      Resolver(void);
+      ~Resolver(void);
+      Resolver(const Resolver& resolver);
+      Resolver& operator=(const Resolver& resolver);
+
+    private:
+      // Query waiting for an answer
+      struct Query {
+        Ipv4Addr ip;
+        int attempts;
+        chrono::steady_clock::time_point sent;
+      };
+
+      // Cached answer. Empty hostname means negative answer
+      struct Entry {
+        string hostname;
+        chrono::steady_clock::time_point expires;
+      };
+
+      // Private function which builds and sends a PTR query
+      bool query(u_int16_t id, const Ipv4Addr& ip);
+
+      // Private function which parses an answer and caches its result
+      void process(const u_char* msg, size_t len);
+
+      // Private function which caches an answer, and keeps hostname to
+      // store it on monitor
+      void finish(u_int16_t id, const string& hostname, int ttl);
+
+      // Private function which reads a domain name, following compression
+      // pointers. Returns true if name is malformed
+      bool readName(const u_char* msg, size_t len, size_t& pos,
+          string& name) const;
+
+      // Private function which returns reverse DNS domain for an ip address
+      string getPtrName(const Ipv4Addr& ip) const;
+
+      // Private function which reads first nameserver from resolv.conf
+      string getDefaultServer(void) const;
+
+      // Attributes
+      int _socket;
+      u_int16_t _next_id;
+      double _tokens;
+      chrono::steady_clock::time_point _refill;
+      bool _initialized;
+      mutex _mutex;
+      static Resolver* _instance;
+
+      // Devices waiting to be queried, queries waiting for an answer,
+      // cached answers, and hostnames waiting to be stored on monitor
+      deque<Ipv4Addr> _pending;
+      map<u_int16_t,Query> _queries;
+      map<Ipv4Addr,Entry> _cache;
+      vector<pair<Ipv4Addr,string> > _found;
+
+      // Internal list of devices queued or being queried
+      set<Ipv4Addr> _queued;
+  };
+
+  #define resolver Resolver::getInstance()
+
+#endif
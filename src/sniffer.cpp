@@ -22,44 +22,68 @@
  */
 
 #include "sniffer.h"
+#include "metrics.h"
 using namespace std;
 
-Sniffer* Sniffer::_instance = 0;
+const int Sniffer::OVERLOAD_DROPS;
+const int Sniffer::MAX_LEVEL;
+const int Sniffer::CALM_SECONDS;
+const size_t Sniffer::KNOWN_SIZE;
 
-// Constructor: does nothing
-Sniffer::Sniffer(void) {
+// Constructor: no host is known, and all packets are processed
+Sniffer::Sniffer(int index) : _known(KNOWN_SIZE) {
   _handler = NULL;
   _initialized = false;
+  _index = index;
+  _protocols = PROTOCOL_ALL;
+  _overload_drops = OVERLOAD_DROPS;
+  _level = 0;
+  _calm = 0;
+  _last_check = 0;
+  _drops = 0;
 }
 
 // Desctructor: close pcap session
 Sniffer::~Sniffer(void) {
-  pcap_close(_handler);
+  if (_handler != NULL) {
+    pcap_close(_handler);
+  }
 }
 
-// Initialize interface, open sniffing session and apply packet filter
-void Sniffer::start(string& iface, string& filter_str, string spoof) {
-  struct bpf_program filter;
-  bpf_u_int32 mask;
-  bpf_u_int32 net;
-
+// Initialize sniffer and launch capture thread
+void Sniffer::start(string& iface, string& filter_str,
+    const Ipv4Addr& spoof, int protocols)
+{
   // Do not initialize twice
   if (_initialized) {
     return;
   }
 
-  // Save spoof ip address, if any
-  if (not spoof.empty()) {
-    _spoof_ip = spoof;
-  }
+  // Save interface, filter, protocols and spoof ip address, if any
+  _iface = iface;
+  _filter = filter_str;
+  _protocols = protocols;
+  _spoof_ip = spoof;
 
   // Get ip address from selected interface
   _ip = getOwnIp(iface);
 
+  // Launch thread, which opens capture session once it's placed on its cpus
+  _initialized = true;
+  thread t1(capture, this);
+  t1.detach();
+}
+
+// Open sniffing session and apply packet filter
+void Sniffer::open(void) {
+  struct bpf_program filter;
+  bpf_u_int32 mask;
+  bpf_u_int32 net;
+
   // Create handler for sniffing
-  _handler = pcap_create(iface.c_str(), (char*)_errbuf.c_str());
+  _handler = pcap_create(_iface.c_str(), (char*)_errbuf.c_str());
   if (_handler == NULL) {
-    cerr << "ERROR - Couldn't open interface " << iface << ": ";
+    cerr << "ERROR - Couldn't open interface " << _iface << ": ";
     cerr << _errbuf << endl;
     exit(EXIT_FAILURE);
   }
@@ -68,138 +92,126 @@ void Sniffer::start(string& iface, string& filter_str, string spoof) {
   pcap_activate(_handler);
 
   // Attempt to get network and netmask from interface
-  if (pcap_lookupnet(iface.c_str(), &(net), &(mask),
+  if (pcap_lookupnet(_iface.c_str(), &(net), &(mask),
       (char*)_errbuf.c_str()) == -1)
   {
-    cerr << "ERROR - Can't get netmask for interface " << iface << endl;
+    cerr << "ERROR - Can't get netmask for interface " << _iface << endl;
     net = 0;
     mask = 0;
   }
 
   // Check link-layer type is supported (ethernet needed)
   if (pcap_datalink(_handler) != DLT_EN10MB) {
-    cerr << "ERROR - Interface " << iface << " is not Ethernet device" << endl;
+    cerr << "ERROR - Interface " << _iface << " is not Ethernet device";
+    cerr << endl;
     exit(EXIT_FAILURE);
   }
 
   // Compile packet filter
-  if (pcap_compile(_handler, &(filter), filter_str.c_str(), 0, net) == -1) {
-    cerr << "ERROR - Couldn't parse filter " << filter_str << ": ";
+  if (pcap_compile(_handler, &(filter), _filter.c_str(), 0, net) == -1) {
+    cerr << "ERROR - Couldn't parse filter " << _filter << ": ";
     cerr << pcap_geterr(_handler) << endl;
     exit(EXIT_FAILURE);
   }
 
   // Apply compiled filter
   if (pcap_setfilter(_handler, &(filter)) == -1) {
-    cerr << "ERROR - Couldn't install filter " << filter_str << ": ";
+    cerr << "ERROR - Couldn't install filter " << _filter << ": ";
     cerr << pcap_geterr(_handler) << endl;
     exit(EXIT_FAILURE);
   }
+}
 
-  // Launch thread
-  _initialized = true;
-  thread t1(capture);
-  t1.detach();
+// Sets drops which raise sampling level
+void Sniffer::setOverloadDrops(int drops) {
+  _overload_drops = drops;
 }
 
 // Parse information from an ARP request packet
-void Sniffer::processArp(const u_char* packet) {
-  // Dummy variable to check ip address validity
-  struct sockaddr_in sa;
+void Sniffer::processArp(const u_char* packet, int vlan) {
   Device dev;
 
   // Get ARP header
-  struct ether_arp *arp = (struct ether_arp *)(packet + sizeof(struct ethhdr));
+  struct ether_arp *arp = (struct ether_arp *)packet;
 
   // If ARP packet is response extract all data
   if (ntohs(arp->ea_hdr.ar_op) == ARPOP_REPLY) {
-    // Buffer to convert from integer to string, MAC formatted
-    stringstream ss_mac;
-
-    // Buffer to convert from integer to string
-    stringstream ss_ip;
-
-    // Struct to store MAC address
-    struct ether_addr* mac_addr;
-
     // Get source MAC address
-    mac_addr = (ether_addr*)arp->arp_sha;
-    for (int i = 0; i < 5; ++i) {
-      ss_mac << setfill('0') << setw(2) << uppercase << hex;
-      ss_mac << (int)mac_addr->ether_addr_octet[i] << ":";
-    }
-    ss_mac << setfill('0') << setw(2) << uppercase << hex;
-    ss_mac << (int)mac_addr->ether_addr_octet[5];
-    string sha = ss_mac.str();
+    MacAddr sha(arp->arp_sha);
 
     // If mac address has been already processed, do nothing
     if (_macs_processed.find(sha) != _macs_processed.end()) {
       return;
     }
 
-    // Reset stringstream
-    ss_mac.str(string());
-    ss_mac.clear();
-
     // Get source IP address
-    for (int i = 0; i < 4; ++i) {
-      ss_ip << (int)arp->arp_spa[i];
-      ss_ip << ((i != 3) ? "." : "");
-    }
-    string spa = ss_ip.str();
-
-    // Reset stringstream
-    ss_ip.str(string());
-    ss_ip.clear();
-
-    // Check ip address validity
-    if (inet_pton(AF_INET, spa.c_str(), &(sa.sin_addr)) > 0) {
-      // Do not store own ip address
-      if (spa.c_str() != sniffer->getIp() and
-          spa.c_str() != sniffer->getSpoofIp())
-      {
-        // If device is not registered, save it
-        try {
-          dev = monitor->getDevice(spa);
-        }
-        catch (exception) {
-          dev.setIp(spa);
-          monitor->addDevice(dev);
-        }
-
-        // Update MAC address of corresponding device
-        dev.setMac(sha);
-        if (monitor->updateDevice(spa, dev)) {
-          cerr << "ERROR - Can't update device with ip " << spa << endl;
-        }
-
-        // Add mac address to processed macs list
-        _macs_processed.insert(sha);
+    Ipv4Addr spa(arp->arp_spa[0], arp->arp_spa[1], arp->arp_spa[2],
+        arp->arp_spa[3]);
+
+    // Do not store own ip address, or an empty one
+    if (not spa.empty() and spa != _ip and spa != _spoof_ip) {
+      // If device is not registered, save it, as found on this interface
+      try {
+        dev = monitor->getDevice(spa);
+      }
+      catch (exception) {
+        dev.setIp(spa);
+        dev.setInterface(_index);
+        monitor->addDevice(dev);
+      }
+
+      // Update MAC address of corresponding device. Replies are not
+      // routed, so sender lives on VLAN of frame
+      dev.setMac(sha);
+      if (vlan != 0) {
+        dev.setVlan(vlan);
       }
+      if (monitor->updateDevice(spa, dev)) {
+        cerr << "ERROR - Can't update device with ip " << spa << endl;
+      }
+
+      // Add mac address to processed macs list
+      _macs_processed.insert(sha);
     }
     // No need to process target MAC address, as it's our own mac
   }
 }
 
-// TODO Implement VLAN stripping
-// Parse information from VLAN tagged packet
-void Sniffer::processVlan(const u_char* packet) {
-  cout << "VLAN" << endl;
-}
-
 // Parse information from ICMP response packet
-void Sniffer::processIcmp(const u_char* packet, const string& src) {
+void Sniffer::processIcmp(const u_char* packet, const Ipv4Addr& src) {
   Device dev;
-  string address;
+  Ipv4Addr address;
   bool reachable = false;
 
   // Get ip header
-  struct iphdr* iph = (struct iphdr*)(packet + sizeof(struct ethhdr));
-  // Move packet pointer, skipping layer 2 header and layer 3 packet
-  u_char* icmp = (u_char*)packet + sizeof(struct ethhdr) + (iph->ihl * 4);
+  struct iphdr* iph = (struct iphdr*)packet;
+  // Move packet pointer, skipping layer 3 packet
+  u_char* icmp = (u_char*)packet + (iph->ihl * 4);
   // Get layer 4 header: in this case, it's ICMP header
   struct icmphdr* icmphdr = (struct icmphdr*)icmp;
 
+  // Error messages carry original ip header, and first bytes of its payload.
+  // If original packet was a tracer probe, let tracer match it to its target
+  if (icmphdr->type == ICMP_TIME_EXCEEDED or
+      icmphdr->type == ICMP_DEST_UNREACH)
+  {
+    struct ip* orig = &((struct icmp*)icmp)->icmp_ip;
+    struct icmphdr* probe = (struct icmphdr*)((u_char*)orig + orig->ip_hl * 4);
+    if (orig->ip_p == IPPROTO_ICMP and probe->type == ICMP_ECHO and
+        ntohs(probe->un.echo.id) == tracer->getId())
+    {
+      tracer->processReply(Ipv4Addr::fromNetwork(orig->ip_dst.s_addr),
+          ntohs(probe->un.echo.sequence), src);
+    }
+  }
+
+  // Echo replies to tracer probes mean target was reached
+  if (icmphdr->type == ICMP_ECHOREPLY and
+      ntohs(icmphdr->un.echo.id) == tracer->getId())
+  {
+    tracer->processReply(src, ntohs(icmphdr->un.echo.sequence), src);
+  }
+
   // Get ip address to evaluate
   // Echo reply is received, then device is reachable
   if (icmphdr->type == ICMP_ECHOREPLY) {
@@ -211,7 +223,8 @@ void Sniffer::processIcmp(const u_char* packet, const string& src) {
     // Get full icmp packet
     struct icmp* icmp_pkt = (struct icmp*)(icmp);
     // Get destination ip address from original ip header
-    address = string(inet_ntoa(icmp_pkt->icmp_dun.id_ip.idi_ip.ip_dst));
+    address = Ipv4Addr::fromNetwork(
+        icmp_pkt->icmp_dun.id_ip.idi_ip.ip_dst.s_addr);
   }
   // No need to process any other icmp types
   else {
@@ -245,48 +258,71 @@ pcap_t* Sniffer::getHandler(void) const {
 }
 
 // Own ip address getter
-const string& Sniffer::getIp(void) const {
+Ipv4Addr Sniffer::getIp(void) const {
   return _ip;
 }
 
 // Spoof ip address getter
-const string& Sniffer::getSpoofIp(void) const {
+Ipv4Addr Sniffer::getSpoofIp(void) const {
   return _spoof_ip;
 }
 
-// Checks if some arbitrary ip address is private, according to IANA
-bool Sniffer::ipIsPrivate(const string& ip) const {
-  struct sockaddr_in sa;
+// Capture interface index getter
+int Sniffer::getIndex(void) const {
+  return _index;
+}
+
+// Capture interface name getter
+string Sniffer::getInterface(void) const {
+  return _iface;
+}
 
-  // Check ip address validity
-  if (inet_pton(AF_INET, ip.c_str(), &(sa.sin_addr)) > 0) {
-    uint32_t address = *((uint32_t*)&(sa.sin_addr));
+// Processed protocols getter
+int Sniffer::getProtocols(void) const {
+  return _protocols;
+}
 
-    // Private ip address, class A
-    if ((address & 0x000000FFU) == 0x0000000AU) {
-      // Discard broadcast address for class A
-      return (address != 0xFFFFFF0AU);
-    }
+// Reads kernel drops since last check, and changes sampling level
+void Sniffer::updateLevel(time_t now) {
+  struct pcap_stat stats;
 
-    // Private ip address, class B
-    if ((address & 0x0000F0FFU) == 0x000010ACU) {
-      // Discard broadcast address for class B
-      return (address != 0xFFFF1FACU);
-    }
+  _last_check = now;
+  if (_handler == NULL or pcap_stats(_handler, &stats) == -1) {
+    return;
+  }
 
-    // Private ip address, class C
-    if ((address & 0x0000FFFFU) == 0x0000A8C0U) {
-      // Discard broadcast address for class C
-      return (address != 0xFFFFA8C0U);
-    }
+  // Counters of libpcap only grow while session is open
+  uint64_t drops = (uint64_t)stats.ps_drop + stats.ps_ifdrop;
+  uint64_t dropped = (drops > _drops) ? drops - _drops : 0;
+  _drops = drops;
+  metrics->add(COUNTER_PACKETS_DROPPED, dropped);
+  if (_overload_drops <= 0) {
+    return;
+  }
+
+  // Sample fewer flows while kernel drops, and more once it stops
+  int level = _level;
+  if (dropped >= (uint64_t)_overload_drops) {
+    level = min(level + 1, MAX_LEVEL);
+    _calm = 0;
+  }
+  else if (level > 0 and ++_calm >= CALM_SECONDS) {
+    --level;
+    _calm = 0;
+  }
+
+  if (level != _level) {
+    cerr << "WARNING - Interface " << _iface << " processing 1 of ";
+    cerr << (1 << level) << " flows of known hosts (" << dropped;
+    cerr << " packets dropped)" << endl;
+    _level = level;
   }
-  return false;
 }
 
 // Get ip address from some interface name
-string Sniffer::getOwnIp(const string& name) const {
+Ipv4Addr Sniffer::getOwnIp(const string& name) const {
   struct ifaddrs *ifaddr, *ifa;
-  string ip;
+  Ipv4Addr ip;
 
   // Get all network interfaces of this system
   if (getifaddrs(&ifaddr) == -1) {
@@ -303,7 +339,8 @@ string Sniffer::getOwnIp(const string& name) const {
     // Save asked interface's ip address
     if (strcmp(ifa->ifa_name, name.c_str()) == 0) {
       if (ifa->ifa_addr->sa_family == AF_INET) {
-        ip = inet_ntoa(((struct sockaddr_in*)ifa->ifa_addr)->sin_addr);
+        ip = Ipv4Addr::fromNetwork(
+            ((struct sockaddr_in*)ifa->ifa_addr)->sin_addr.s_addr);
       }
     }
   }
@@ -18,15 +18,17 @@
  */
 
 /**
- * @file Sniffer class declaration. Singleton pattern implementation
+ * @file Sniffer class declaration
  */
 
 #ifndef _SNIFFER_H_
 #define _SNIFFER_H_
 
+  #include <algorithm>
+  #include <cstdint>
   #include <cstring>
+  #include <ctime>
   #include <ifaddrs.h>
-  #include <iomanip>
   #include <iostream>
   #include <netinet/ether.h>
   #include <netinet/ip_icmp.h>
@@ -34,63 +36,134 @@
   #include <string>
   #include <thread>
   #include <set>
+  #include <vector>
 
   #include "actions.h"
   #include "monitor.h"
+  #include "pool.h"
   using namespace std;
 
   /**
-   * Singleton object which captures network packets from some interface,
-   * using libpcap, reads some information about them, and then stores the
-   * network devices information on monitor registry.
+   * Protocols processed by sniffers, as bits of a set
+   */
+  enum PacketProtocol {
+    PROTOCOL_ARP = 1 << 0,
+    PROTOCOL_ICMP = 1 << 1,
+    PROTOCOL_VLAN = 1 << 2,
+    PROTOCOL_ALL = (1 << 3) - 1
+  };
+
+  /**
+   * Captures network packets from some interface, using libpcap, reads some
+   * information about them, and then stores the network devices information
+   * on monitor registry. There is a sniffer per capture interface, each on
+   * its own thread, and all of them share the same monitor.
+   *
+   * When kernel drops packets because sniffer can not keep up, it enters
+   * overload mode: packets between hosts it already knows are processed
+   * for a fraction of flows only, chosen by a hash of their addresses, so
+   * each flow is either always or never skipped. ARP, ICMP and packets of
+   * hosts not known yet are always processed. Fraction halves each second
+   * with drops, and doubles back after some seconds without them.
    */
   class Sniffer {
     public:
 
+      // Default packets dropped by kernel in a second which raise sampling
+      static const int OVERLOAD_DROPS = 100;
+
+      // Highest sampling level. Level n processes 1 of 2^n flows
+      static const int MAX_LEVEL = 6;
+
+      // Seconds without drops which lower sampling level
+      static const int CALM_SECONDS = 5;
+
+      // Number of hosts remembered as known, a power of two
+      static const size_t KNOWN_SIZE = 65536;
+
       /**
-       * Implementation of Singleton pattern
-       * @return Pointer to singleton sniffer object
+       * Constructor
+       * @param index Index of capture interface, given to found devices
        */
-      static Sniffer* getInstance(void) {
-        if (_instance == 0) {
-          _instance = new Sniffer();
-        }
-        return _instance;
-      }
+      explicit Sniffer(int index = 0);
 
       /**
-       * Destroyer for singleton sniffer object
+       * Destructor
        */
-      static void destroy(void) {
-        delete _instance;
-      }
+      ~Sniffer(void);
 
       /**
-       * Initialize sniffer and launch it as thread
+       * Initialize sniffer and launch it as thread. Capture session is
+       * opened by that thread, so its buffers are taken from memory close
+       * to cpus where it runs
        * @param iface Name of network interface on which we want to sniff
        * @param filter_str Filter, on libpcap format, to apply on capture
        * @param spoof Custom ip address to use as own (spoofing)
+       * @param protocols Set of protocols processed, as bits of
+       * PacketProtocol
        */
-      void start(string& iface, string& filter_str, string spoof = "");
+      void start(string& iface, string& filter_str,
+          const Ipv4Addr& spoof = Ipv4Addr(), int protocols = PROTOCOL_ALL);
 
       /**
-       * Process sniffed ARP packet. Extract some device's mac address
-       * @param packet Captured packet from network interface
+       * Open capture session on sniffer's interface, and apply its filter
        */
-      void processArp(const u_char* packet);
+      void open(void);
 
       /**
-       * Process sniffed VLAN tagged packet. Extract some device's vlan
-       * @param packet Captured packet from network interface
+       * Sets packets dropped by kernel in a second which raise sampling
+       * level. Must be called before sniffer starts
+       * @param drops Number of drops, or zero to never sample
        */
-      void processVlan(const u_char* packet);
+      void setOverloadDrops(int drops);
+
+      /**
+       * Checks kernel drops once each second of capture, and changes
+       * sampling level if needed
+       * @param now Timestamp of current packet, in seconds
+       */
+      void checkLoad(time_t now) {
+        if (now != _last_check) {
+          updateLevel(now);
+        }
+      }
+
+      /**
+       * Records a host was processed, so its packets may be skipped later
+       * @param ip Ip address of host
+       */
+      void remember(const Ipv4Addr& ip) {
+        if (ip.isPrivate()) {
+          _known[hash<Ipv4Addr>()(ip) & (KNOWN_SIZE - 1)] = ip;
+        }
+      }
+
+      /**
+       * Checks if a packet may be skipped due to overload. Its hosts must
+       * be already known, and its flow not be sampled
+       * @param src Source ip address of packet
+       * @param dst Destination ip address of packet
+       * @return True if packet may be skipped, false if it must be processed
+       */
+      bool skip(const Ipv4Addr& src, const Ipv4Addr& dst) const {
+        return _level > 0 and isKnown(src) and isKnown(dst) and
+            not isSampled(src, dst);
+      }
+
+      /**
+       * Process sniffed ARP packet. Extract some device's mac address, and
+       * its vlan if frame was tagged
+       * @param packet ARP header of captured packet, after layer 2 header
+       * @param vlan Id of 802.1Q VLAN tag of frame, or zero if untagged
+       */
+      void processArp(const u_char* packet, int vlan);
 
       /**
        * Process sniffed ICMP tagged packet. Extract some device's reachability
-       * @param packet Captured packet from network interface
+       * @param packet Ip header of captured packet, after layer 2 header
        * @param src Data packet's source ip address, to avoid double processing
        */
-      void processIcmp(const u_char* packet, const string& src);
+      void processIcmp(const u_char* packet, const Ipv4Addr& src);
 
       /**
        * Getter for libpcap capture session handler
@@ -102,48 +175,86 @@
        * Own ip address getter
        * @return Ip address of interface on which we are hearing
        */
-      const string& getIp(void) const;
+      Ipv4Addr getIp(void) const;
 
       /**
        * Spoofed ip address getter
        * @return Spoofed ip address for capture interface
        */
-      const string& getSpoofIp(void) const;
+      Ipv4Addr getSpoofIp(void) const;
 
       /**
-       * Checks if some arbitrary valid ip address is private. Based on IANA
-       * reserved private network ranges.
-       * @param ip Ip address, on dot separated decimals format
-       * @return True if ip is private, false if it's public
+       * Capture interface index getter
+       * @return Index of capture interface
        */
-      bool ipIsPrivate(const string& ip) const;
+      int getIndex(void) const;
 
-    protected:
-      // Constructor, destructor, copy constructor and assing operator
-      // are protected due to singleton pattern implementation
-      Sniffer(void);
-      ~Sniffer(void);
+      /**
+       * Capture interface name getter
+       * @return Name of capture interface
+       */
+      string getInterface(void) const;
+
+      /**
+       * Processed protocols getter
+       * @return Set of protocols processed, as bits of PacketProtocol
+       */
+      int getProtocols(void) const;
+
+    private:
+      // Copy constructor and assign operator are private, as each sniffer
+      // owns a capture session which can not be shared
       Sniffer(const Sniffer& sniffer);
       Sniffer& operator=(const Sniffer& sniffer);
 
-    private:
       // Private function which guess some iface ip address
-      string getOwnIp(const string& name) const;
+      Ipv4Addr getOwnIp(const string& name) const;
+
+      // Private function which reads kernel drops and changes sampling
+      // level
+      void updateLevel(time_t now);
+
+      // Private function which checks if a host was remembered. Public
+      // hosts are never stored, so they are always known
+      bool isKnown(const Ipv4Addr& ip) const {
+        return not ip.isPrivate() or
+            _known[hash<Ipv4Addr>()(ip) & (KNOWN_SIZE - 1)] == ip;
+      }
+
+      // Private function which checks if flow of some packet is sampled at
+      // current level. Both directions of a flow give the same hash
+      bool isSampled(const Ipv4Addr& src, const Ipv4Addr& dst) const {
+        uint64_t low = min(src.toHost(), dst.toHost());
+        uint64_t high = max(src.toHost(), dst.toHost());
+        uint64_t flow = ((high << 32) | low) * 0x9E3779B97F4A7C15ULL;
+        return (flow >> (64 - MAX_LEVEL)) < (1U << (MAX_LEVEL - _level));
+      }
 
       // Attributes
       string _errbuf;
-      string _ip;
-      string _spoof_ip;
+      string _iface;
+      string _filter;
+      Ipv4Addr _ip;
+      Ipv4Addr _spoof_ip;
       pcap_t* _handler;
       bool _initialized;
-      static Sniffer* _instance;
+      int _index;
+      int _protocols;
+
+      // Overload sampling state: drops which raise level, current level,
+      // seconds without drops, last check and drops seen by then
+      int _overload_drops;
+      int _level;
+      int _calm;
+      time_t _last_check;
+      uint64_t _drops;
+      vector<Ipv4Addr> _known;
 
       // Internal list of attributes already sniffed. Avoid repeating tasks
-      set<string> _macs_processed;
-      set<string> _reachability_processed;
+      set<MacAddr,less<MacAddr>,PoolAllocator<MacAddr> > _macs_processed;
+      set<Ipv4Addr,less<Ipv4Addr>,PoolAllocator<Ipv4Addr> >
+          _reachability_processed;
   };
 
-  #define sniffer Sniffer::getInstance()
-
 #endif
 
@@ -0,0 +1,515 @@
+/**
+ * Copyright 2013 Ezequiel Vázquez De la calle
+ *
+ * This file is part of Swarm.
+ *
+ * Swarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Swarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file Implementation of SqliteStorage class methods
+ */
+
+#include <sqlite3.h>
+
+#include "sqlitestorage.h"
+using namespace std;
+
+// Constructor
+SqliteStorage::SqliteStorage(void) {
+  _db = NULL;
+}
+
+// Destructor: close statements and database, if any
+SqliteStorage::~SqliteStorage(void) {
+  map<string,sqlite3_stmt*>::iterator it;
+  for (it = _statements.begin(); it != _statements.end(); ++it) {
+    sqlite3_finalize(it->second);
+  }
+  _statements.clear();
+
+  if (_db != NULL) {
+    sqlite3_close(_db);
+    _db = NULL;
+  }
+}
+
+// Open database file, and install schema if needed
+bool SqliteStorage::init(const string& file) {
+  // Own lock serializes access, so library lock is not needed
+  if (sqlite3_open_v2(file.c_str(), &_db, SQLITE_OPEN_READWRITE |
+      SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX, NULL) != SQLITE_OK)
+  {
+    cerr << "ERROR - Can't open database file " << file << endl;
+    cerr << sqlite3_errmsg(_db) << endl;
+    return true;
+  }
+
+  // Wait for other processes reading database, instead of failing
+  sqlite3_busy_timeout(_db, 5000);
+
+  // Write ahead log makes commits sequential appends, and readers do not
+  // block writer. Syncing only on checkpoints is safe on this mode
+  if (execute("PRAGMA journal_mode = WAL") or
+      execute("PRAGMA synchronous = NORMAL"))
+  {
+    return true;
+  }
+
+  stringstream sql;
+  sql << "CREATE TABLE IF NOT EXISTS devices ( ";
+  sql << "id INTEGER PRIMARY KEY, ";
+  sql << "hostname TEXT DEFAULT '', ";
+  sql << "description TEXT DEFAULT '', ";
+  sql << "mac TEXT DEFAULT '', ";
+  sql << "ip TEXT DEFAULT '', ";
+  sql << "subnet TEXT DEFAULT '', ";
+  sql << "hops INTEGER DEFAULT -1, ";
+  sql << "path TEXT DEFAULT '', ";
+  sql << "vlan INTEGER DEFAULT -1, ";
+  sql << "reachable INTEGER DEFAULT -1) ";
+
+  if (execute(sql.str())) {
+    cerr << "ERROR - Can not create database schema" << endl;
+    return true;
+  }
+
+  // Each ip address is stored once, as on MySQL. Databases created before
+  // the index keep newest device of each address
+  sqlite3_stmt* stmt = prepare("SELECT COUNT(*) FROM sqlite_master "
+      "WHERE type = 'index' AND name = 'devices_ip'");
+  if (stmt == NULL or sqlite3_step(stmt) != SQLITE_ROW) {
+    cerr << "ERROR - Can not create database schema" << endl;
+    return true;
+  }
+  bool indexed = sqlite3_column_int(stmt, 0);
+  sqlite3_reset(stmt);
+
+  if (not indexed and (execute("DELETE FROM devices WHERE id NOT IN "
+      "(SELECT MAX(id) FROM devices GROUP BY ip)") or
+      execute("CREATE UNIQUE INDEX devices_ip ON devices (ip)")))
+  {
+    cerr << "ERROR - Can not create database schema" << endl;
+    return true;
+  }
+
+  // History of devices, clustered by bucket
+  sql.str(string());
+  sql << "CREATE TABLE IF NOT EXISTS sightings ( ";
+  sql << "bucket INTEGER NOT NULL, ";
+  sql << "device_id INTEGER NOT NULL, ";
+  sql << "event INTEGER NOT NULL, ";
+  sql << "old_value TEXT DEFAULT '', ";
+  sql << "new_value TEXT DEFAULT '', ";
+  sql << "count INTEGER DEFAULT 1, ";
+  sql << "PRIMARY KEY (bucket, device_id, event)) ";
+
+  if (execute(sql.str()) or execute("CREATE INDEX IF NOT EXISTS "
+      "sightings_device ON sightings (device_id, bucket)"))
+  {
+    cerr << "ERROR - Can not create database schema" << endl;
+    return true;
+  }
+
+  // Traffic between devices, clustered by bucket
+  sql.str(string());
+  sql << "CREATE TABLE IF NOT EXISTS conversations ( ";
+  sql << "bucket INTEGER NOT NULL, ";
+  sql << "src_id INTEGER NOT NULL, ";
+  sql << "dst_id INTEGER NOT NULL, ";
+  sql << "packets INTEGER DEFAULT 0, ";
+  sql << "bytes INTEGER DEFAULT 0, ";
+  sql << "PRIMARY KEY (bucket, src_id, dst_id)) ";
+
+  if (execute(sql.str()) or execute("CREATE INDEX IF NOT EXISTS "
+      "conversations_src ON conversations (src_id, bucket)"))
+  {
+    cerr << "ERROR - Can not create database schema" << endl;
+    return true;
+  }
+
+  return false;
+}
+
+// Returns highest device id stored
+bool SqliteStorage::getLastId(int& id) {
+  lock_guard<mutex> lock(_mutex);
+
+  sqlite3_stmt* stmt = prepare("SELECT COALESCE(MAX(id), 0) FROM devices");
+  if (stmt == NULL) {
+    return true;
+  }
+
+  bool error = (sqlite3_step(stmt) != SQLITE_ROW);
+  if (not error) {
+    id = sqlite3_column_int(stmt, 0);
+  }
+  sqlite3_reset(stmt);
+
+  return error;
+}
+
+// Reads all stored devices
+bool SqliteStorage::load(Devices& devices) {
+  lock_guard<mutex> lock(_mutex);
+
+  // Newest records first, so they are kept if some ip is repeated
+  sqlite3_stmt* stmt = prepare("SELECT id, hostname, description, mac, ip, "
+      "subnet, hops, path, vlan, reachable FROM devices ORDER BY id DESC");
+  if (stmt == NULL) {
+    return true;
+  }
+
+  int status;
+  while ((status = sqlite3_step(stmt)) == SQLITE_ROW) {
+    Device device;
+    readRow(stmt, device);
+    devices.insert(pair<Ipv4Addr,Device>(device.getIp(), device));
+  }
+  sqlite3_reset(stmt);
+
+  return (status != SQLITE_DONE);
+}
+
+// Steps over all stored devices, handing them to a reader
+bool SqliteStorage::scan(DeviceReader& reader) {
+  lock_guard<mutex> lock(_mutex);
+
+  sqlite3_stmt* stmt = prepare("SELECT id, hostname, description, mac, ip, "
+      "subnet, hops, path, vlan, reachable FROM devices ORDER BY id");
+  if (stmt == NULL) {
+    return true;
+  }
+
+  int status;
+  bool stopped = false;
+  while (not stopped and (status = sqlite3_step(stmt)) == SQLITE_ROW) {
+    Device device;
+    readRow(stmt, device);
+    stopped = reader.readDevice(device);
+  }
+  sqlite3_reset(stmt);
+
+  return (stopped or status != SQLITE_DONE);
+}
+
+// Reads a device using its id
+bool SqliteStorage::read(int id, Device& device) {
+  lock_guard<mutex> lock(_mutex);
+
+  sqlite3_stmt* stmt = prepare("SELECT id, hostname, description, mac, ip, "
+      "subnet, hops, path, vlan, reachable FROM devices WHERE id = ?");
+  if (stmt == NULL) {
+    return true;
+  }
+
+  sqlite3_bind_int(stmt, 1, id);
+  bool error = (sqlite3_step(stmt) != SQLITE_ROW);
+  if (not error) {
+    readRow(stmt, device);
+  }
+  sqlite3_reset(stmt);
+
+  return error;
+}
+
+// Writes devices inside a single transaction
+bool SqliteStorage::write(const vector<Device>& devices, int fields) {
+  stringstream update;
+  stringstream insert;
+  stringstream values;
+  int num_fields = 0;
+
+  if (devices.empty()) {
+    return false;
+  }
+
+  // Id goes after changed attributes on both statements
+  update << "UPDATE devices SET ";
+  insert << "INSERT INTO devices(";
+  for (int i = 0; i < NUM_FIELDS; ++i) {
+    if (fields & (1 << i)) {
+      update << (num_fields ? ", " : "") << getColumn(i) << " = ?";
+      insert << getColumn(i) << ", ";
+      values << "?, ";
+      ++num_fields;
+    }
+  }
+  update << " WHERE id = ?";
+  insert << "id) VALUES(" << values.str() << "?)";
+
+  lock_guard<mutex> lock(_mutex);
+
+  sqlite3_stmt* update_stmt = prepare(update.str());
+  sqlite3_stmt* insert_stmt = prepare(insert.str());
+  if (update_stmt == NULL or insert_stmt == NULL or execute("BEGIN")) {
+    return true;
+  }
+
+  // Update each device, and insert it if it was not found
+  bool error = false;
+  for (size_t i = 0; i < devices.size() and not error; ++i) {
+    bindFields(update_stmt, 1, devices[i], fields);
+    sqlite3_bind_int(update_stmt, num_fields + 1, devices[i].getId());
+    error = (sqlite3_step(update_stmt) != SQLITE_DONE);
+    sqlite3_reset(update_stmt);
+
+    if (not error and sqlite3_changes(_db) == 0) {
+      bindFields(insert_stmt, 1, devices[i], fields);
+      sqlite3_bind_int(insert_stmt, num_fields + 1, devices[i].getId());
+      error = (sqlite3_step(insert_stmt) != SQLITE_DONE);
+      sqlite3_reset(insert_stmt);
+    }
+  }
+
+  if (error) {
+    cerr << "ERROR - Can not write devices" << endl;
+    cerr << sqlite3_errmsg(_db) << endl;
+    execute("ROLLBACK");
+    return true;
+  }
+
+  return commit();
+}
+
+// Appends sightings inside a single transaction
+bool SqliteStorage::writeSightings(const vector<Sighting>& sightings) {
+  if (sightings.empty()) {
+    return false;
+  }
+
+  lock_guard<mutex> lock(_mutex);
+
+  sqlite3_stmt* update_stmt = prepare("UPDATE sightings SET new_value = ?, "
+      "count = count + ? WHERE bucket = ? AND device_id = ? AND event = ?");
+  sqlite3_stmt* insert_stmt = prepare("INSERT INTO sightings(bucket, "
+      "device_id, event, old_value, new_value, count) "
+      "VALUES(?, ?, ?, ?, ?, ?)");
+  if (update_stmt == NULL or insert_stmt == NULL or execute("BEGIN")) {
+    return true;
+  }
+
+  // Add to sighting already written, and insert it if it was not found
+  bool error = false;
+  for (size_t i = 0; i < sightings.size() and not error; ++i) {
+    const Sighting& sighting = sightings[i];
+    sqlite3_bind_text(update_stmt, 1, sighting.new_value.data(),
+        sighting.new_value.size(), SQLITE_TRANSIENT);
+    sqlite3_bind_int(update_stmt, 2, sighting.count);
+    sqlite3_bind_int64(update_stmt, 3, sighting.bucket);
+    sqlite3_bind_int(update_stmt, 4, sighting.device);
+    sqlite3_bind_int(update_stmt, 5, sighting.event);
+    error = (sqlite3_step(update_stmt) != SQLITE_DONE);
+    sqlite3_reset(update_stmt);
+
+    if (not error and sqlite3_changes(_db) == 0) {
+      sqlite3_bind_int64(insert_stmt, 1, sighting.bucket);
+      sqlite3_bind_int(insert_stmt, 2, sighting.device);
+      sqlite3_bind_int(insert_stmt, 3, sighting.event);
+      sqlite3_bind_text(insert_stmt, 4, sighting.old_value.data(),
+          sighting.old_value.size(), SQLITE_TRANSIENT);
+      sqlite3_bind_text(insert_stmt, 5, sighting.new_value.data(),
+          sighting.new_value.size(), SQLITE_TRANSIENT);
+      sqlite3_bind_int(insert_stmt, 6, sighting.count);
+      error = (sqlite3_step(insert_stmt) != SQLITE_DONE);
+      sqlite3_reset(insert_stmt);
+    }
+  }
+
+  if (error) {
+    cerr << "ERROR - Can not write sightings" << endl;
+    cerr << sqlite3_errmsg(_db) << endl;
+    execute("ROLLBACK");
+    return true;
+  }
+
+  return commit();
+}
+
+// Removes sightings of older buckets
+bool SqliteStorage::expireSightings(time_t before) {
+  lock_guard<mutex> lock(_mutex);
+
+  sqlite3_stmt* stmt = prepare("DELETE FROM sightings WHERE bucket < ?");
+  if (stmt == NULL) {
+    return true;
+  }
+
+  sqlite3_bind_int64(stmt, 1, before);
+  bool error = (sqlite3_step(stmt) != SQLITE_DONE);
+  sqlite3_reset(stmt);
+
+  return error;
+}
+
+// Appends conversations inside a single transaction
+bool SqliteStorage::writeConversations(
+    const vector<Conversation>& traffic)
+{
+  if (traffic.empty()) {
+    return false;
+  }
+
+  lock_guard<mutex> lock(_mutex);
+
+  sqlite3_stmt* update_stmt = prepare("UPDATE conversations SET "
+      "packets = packets + ?, bytes = bytes + ? "
+      "WHERE bucket = ? AND src_id = ? AND dst_id = ?");
+  sqlite3_stmt* insert_stmt = prepare("INSERT INTO conversations(bucket, "
+      "src_id, dst_id, packets, bytes) VALUES(?, ?, ?, ?, ?)");
+  if (update_stmt == NULL or insert_stmt == NULL or execute("BEGIN")) {
+    return true;
+  }
+
+  // Add to conversation already written, and insert it if it was not found
+  bool error = false;
+  for (size_t i = 0; i < traffic.size() and not error; ++i) {
+    const Conversation& conversation = traffic[i];
+    sqlite3_bind_int64(update_stmt, 1, conversation.packets);
+    sqlite3_bind_int64(update_stmt, 2, conversation.bytes);
+    sqlite3_bind_int64(update_stmt, 3, conversation.bucket);
+    sqlite3_bind_int(update_stmt, 4, conversation.src);
+    sqlite3_bind_int(update_stmt, 5, conversation.dst);
+    error = (sqlite3_step(update_stmt) != SQLITE_DONE);
+    sqlite3_reset(update_stmt);
+
+    if (not error and sqlite3_changes(_db) == 0) {
+      sqlite3_bind_int64(insert_stmt, 1, conversation.bucket);
+      sqlite3_bind_int(insert_stmt, 2, conversation.src);
+      sqlite3_bind_int(insert_stmt, 3, conversation.dst);
+      sqlite3_bind_int64(insert_stmt, 4, conversation.packets);
+      sqlite3_bind_int64(insert_stmt, 5, conversation.bytes);
+      error = (sqlite3_step(insert_stmt) != SQLITE_DONE);
+      sqlite3_reset(insert_stmt);
+    }
+  }
+
+  if (error) {
+    cerr << "ERROR - Can not write conversations" << endl;
+    cerr << sqlite3_errmsg(_db) << endl;
+    execute("ROLLBACK");
+    return true;
+  }
+
+  return commit();
+}
+
+// Removes conversations of older buckets
+bool SqliteStorage::expireConversations(time_t before) {
+  lock_guard<mutex> lock(_mutex);
+
+  sqlite3_stmt* stmt = prepare("DELETE FROM conversations WHERE bucket < ?");
+  if (stmt == NULL) {
+    return true;
+  }
+
+  sqlite3_bind_int64(stmt, 1, before);
+  bool error = (sqlite3_step(stmt) != SQLITE_DONE);
+  sqlite3_reset(stmt);
+
+  return error;
+}
+
+// Commits current transaction, or rolls it back if commit fails
+bool SqliteStorage::commit(void) {
+  if (not execute("COMMIT")) {
+    return false;
+  }
+
+  // A busy database leaves transaction open, and following ones could not
+  // begin. Other errors may have rolled it back already
+  if (not sqlite3_get_autocommit(_db)) {
+    execute("ROLLBACK");
+  }
+  return true;
+}
+
+// Executes SQL sentences without result
+bool SqliteStorage::execute(const string& sql) {
+  char* errmsg = NULL;
+
+  if (sqlite3_exec(_db, sql.c_str(), NULL, NULL, &errmsg) != SQLITE_OK) {
+    cerr << "ERROR - Can not execute query" << endl;
+    cerr << (errmsg != NULL ? errmsg : "") << endl;
+    sqlite3_free(errmsg);
+    return true;
+  }
+
+  return false;
+}
+
+// Returns a prepared statement, preparing it on first use
+sqlite3_stmt* SqliteStorage::prepare(const string& sql) {
+  map<string,sqlite3_stmt*>::iterator it = _statements.find(sql);
+  if (it != _statements.end()) {
+    return it->second;
+  }
+
+  sqlite3_stmt* stmt = NULL;
+  if (sqlite3_prepare_v2(_db, sql.c_str(), sql.size() + 1, &stmt, NULL) !=
+      SQLITE_OK)
+  {
+    cerr << "ERROR - Can not prepare statement" << endl;
+    cerr << sqlite3_errmsg(_db) << endl;
+    return NULL;
+  }
+
+  _statements[sql] = stmt;
+  return stmt;
+}
+
+// Reads a device from current statement row
+void SqliteStorage::readRow(sqlite3_stmt* stmt, Device& device) const {
+  string text[NUM_FIELDS];
+
+  // Text columns are null terminated, and may be null
+  for (int i = 0; i < NUM_FIELDS; ++i) {
+    const unsigned char* value = sqlite3_column_text(stmt, i + 1);
+    if (value != NULL and not isInteger(i)) {
+      text[i] = (const char*)value;
+    }
+  }
+
+  device.setId(sqlite3_column_int(stmt, 0));
+  device.setHostname(text[0]);
+  device.setDescription(text[1]);
+  device.setMac(MacAddr(text[2]));
+  device.setIp(Ipv4Addr(text[3]));
+  device.setSubnetMask(Ipv4Addr(text[4]));
+  device.setHops(sqlite3_column_int(stmt, 6));
+  device.setPath(text[6]);
+  device.setVlan(sqlite3_column_int(stmt, 8));
+  device.setReachable(sqlite3_column_int(stmt, 9));
+  device.clearDirty();
+}
+
+// Binds changed attributes of some device
+void SqliteStorage::bindFields(sqlite3_stmt* stmt, int index,
+    const Device& device, int fields) const
+{
+  for (int i = 0; i < NUM_FIELDS; ++i) {
+    if (not (fields & (1 << i))) {
+      continue;
+    }
+
+    if (isInteger(i)) {
+      sqlite3_bind_int(stmt, index++, getInteger(device, i));
+    }
+    else {
+      string value = getText(device, i);
+      sqlite3_bind_text(stmt, index++, value.data(), value.size(),
+          SQLITE_TRANSIENT);
+    }
+  }
+}
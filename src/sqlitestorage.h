@@ -0,0 +1,167 @@
+/**
+ * Copyright 2013 Ezequiel Vázquez De la calle
+ *
+ * This file is part of Swarm.
+ *
+ * Swarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Swarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file Class SqliteStorage definition
+ */
+
+#ifndef _SQLITESTORAGE_H_
+#define _SQLITESTORAGE_H_
+
+  #include <iostream>
+  #include <map>
+  #include <mutex>
+  #include <sstream>
+  #include <string>
+  #include <vector>
+
+  #include "storage.h"
+  using namespace std;
+
+  // Library handlers, declared here as sqlite3.h clashes with db macro
+  struct sqlite3;
+  struct sqlite3_stmt;
+
+  /**
+   * Storage backend which persists devices on an embedded SQLite database
+   * file, so no database server is needed. Database runs in WAL mode, so
+   * writes are sequential appends, and each write is a single transaction
+   * of prepared statements. Access is serialized by own lock
+   */
+  class SqliteStorage : public Storage {
+    public:
+      /**
+       * Constructor
+       */
+      SqliteStorage(void);
+
+      /**
+       * Destructor, closes statements and database
+       */
+      ~SqliteStorage(void);
+
+      /**
+       * Opens database file, creating it and its schema if needed
+       * @param file Path of database file
+       * @return True if database could not be opened, false either
+       */
+      bool init(const string& file);
+
+      /**
+       * Returns highest device id stored
+       * @param id Highest id, or zero if there are no devices
+       * @return True if there was an error, false either
+       */
+      bool getLastId(int& id);
+
+      /**
+       * Reads all stored devices, newest first
+       * @param devices Map where devices are inserted, by ip address
+       * @return True if there was an error, false either
+       */
+      bool load(Devices& devices);
+
+      /**
+       * Reads all stored devices one at a time, by id order
+       * @param reader Receiver of devices
+       * @return True if there was an error or reader stopped, false either
+       */
+      bool scan(DeviceReader& reader);
+
+      /**
+       * Reads a device using its id
+       * @param id Identifier of device to read
+       * @param device Device where read attributes are stored
+       * @return True if there was an error, or device was not found
+       */
+      bool read(int id, Device& device);
+
+      /**
+       * Writes devices inside a single transaction. Each device is updated,
+       * or inserted if it did not exist
+       * @param devices Devices to write
+       * @param fields Mask of DeviceField values to write, same for all
+       * @return True if there was an error, false either
+       */
+      bool write(const vector<Device>& devices, int fields);
+
+      /**
+       * Appends sightings inside a single transaction. Counts of sightings
+       * already written are added
+       * @param sightings Sightings to write, sorted by bucket
+       * @return True if there was an error, false either
+       */
+      bool writeSightings(const vector<Sighting>& sightings);
+
+      /**
+       * Removes sightings of older buckets
+       * @param before Buckets starting before this time are removed
+       * @return True if there was an error, false either
+       */
+      bool expireSightings(time_t before);
+
+      /**
+       * Appends conversations inside a single transaction. Counters of
+       * conversations already written are added
+       * @param traffic Conversations to write
+       * @return True if there was an error, false either
+       */
+      bool writeConversations(const vector<Conversation>& traffic);
+
+      /**
+       * Removes conversations of older buckets
+       * @param before Buckets starting before this time are removed
+       * @return True if there was an error, false either
+       */
+      bool expireConversations(time_t before);
+
+    private:
+      // Copy constructor and assign operator are private, as database
+      // handler can not be shared
+      SqliteStorage(const SqliteStorage& sqlite);
+      SqliteStorage& operator=(const SqliteStorage& sqlite);
+
+      // Private function which executes SQL sentences without result
+      bool execute(const string& sql);
+
+      // Private function which commits current transaction, rolling it
+      // back if commit fails, so next ones can begin
+      bool commit(void);
+
+      // Private function which returns a prepared statement, preparing it
+      // only on first use. Returns NULL if it can't be prepared
+      sqlite3_stmt* prepare(const string& sql);
+
+      // Private function which reads a device from current statement row
+      void readRow(sqlite3_stmt* stmt, Device& device) const;
+
+      // Private function which binds changed attributes of some device,
+      // starting at given parameter position
+      void bindFields(sqlite3_stmt* stmt, int index, const Device& device,
+          int fields) const;
+
+      // Attributes
+      sqlite3* _db;
+      mutex _mutex;
+
+      // Statements already prepared, by SQL sentence
+      map<string,sqlite3_stmt*> _statements;
+  };
+
+#endif
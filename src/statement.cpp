@@ -0,0 +1,228 @@
+/**
+ * Copyright 2013 Ezequiel Vázquez De la calle
+ *
+ * This file is part of Swarm.
+ *
+ * Swarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Swarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file Implementation of Statement class methods
+ */
+
+#include "statement.h"
+#include "metrics.h"
+using namespace std;
+
+// Constructor
+Statement::Statement(MYSQL* con) {
+  _con = con;
+  _stmt = NULL;
+}
+
+// Destructor: close statement, if any
+Statement::~Statement(void) {
+  if (_stmt != NULL) {
+    mysql_stmt_close(_stmt);
+    _stmt = NULL;
+  }
+}
+
+// Parse statement on server, and bind parameter and result buffers
+bool Statement::prepare(const string& sql) {
+  _stmt = mysql_stmt_init(_con);
+  if (_stmt == NULL) {
+    cerr << "ERROR - Can not init statement" << endl;
+    return true;
+  }
+
+  if (mysql_stmt_prepare(_stmt, sql.c_str(), sql.size())) {
+    cerr << "ERROR - Can not prepare statement" << endl;
+    cerr << mysql_stmt_error(_stmt) << endl;
+    return true;
+  }
+
+  // Parameters are null until some value is set. Vectors are never resized
+  // again, so bindings may point to their elements
+  size_t num_params = mysql_stmt_param_count(_stmt);
+  _params.assign(num_params, MYSQL_BIND());
+  _param_strings.assign(num_params, string());
+  _param_ints.assign(num_params, 0);
+  _param_longs.assign(num_params, 0);
+  _param_lengths.assign(num_params, 0);
+  for (size_t i = 0; i < num_params; ++i) {
+    memset(&_params[i], 0, sizeof(MYSQL_BIND));
+    _params[i].buffer_type = MYSQL_TYPE_NULL;
+  }
+
+  // Statements without resultset, as inserts, are done
+  MYSQL_RES* meta = mysql_stmt_result_metadata(_stmt);
+  if (meta == NULL) {
+    return false;
+  }
+
+  // Bind a buffer for each result column, sized by column definition
+  MYSQL_FIELD* fields = mysql_fetch_fields(meta);
+  size_t num_fields = mysql_num_fields(meta);
+  _results.assign(num_fields, MYSQL_BIND());
+  _result_strings.assign(num_fields, vector<char>());
+  _result_ints.assign(num_fields, 0);
+  _result_lengths.assign(num_fields, 0);
+  _result_nulls.assign(num_fields, NullFlag());
+
+  for (size_t i = 0; i < num_fields; ++i) {
+    memset(&_results[i], 0, sizeof(MYSQL_BIND));
+    _results[i].length = &_result_lengths[i];
+    _results[i].is_null = &_result_nulls[i].value;
+
+    switch (fields[i].type) {
+      case MYSQL_TYPE_TINY:
+      case MYSQL_TYPE_SHORT:
+      case MYSQL_TYPE_INT24:
+      case MYSQL_TYPE_LONG:
+      case MYSQL_TYPE_LONGLONG:
+        _results[i].buffer_type = MYSQL_TYPE_LONG;
+        _results[i].buffer = &_result_ints[i];
+        break;
+
+      default:
+        _result_strings[i].resize(fields[i].length + 1);
+        _results[i].buffer_type = MYSQL_TYPE_STRING;
+        _results[i].buffer = &_result_strings[i][0];
+        _results[i].buffer_length = _result_strings[i].size();
+        break;
+    }
+  }
+  mysql_free_result(meta);
+
+  if (mysql_stmt_bind_result(_stmt, &_results[0])) {
+    cerr << "ERROR - Can not bind statement result" << endl;
+    cerr << mysql_stmt_error(_stmt) << endl;
+    return true;
+  }
+
+  return false;
+}
+
+// Set value of a string parameter
+void Statement::setString(size_t index, const string& value) {
+  _param_strings[index] = value;
+  _param_lengths[index] = value.size();
+  _params[index].buffer_type = MYSQL_TYPE_STRING;
+  _params[index].buffer = (void*)_param_strings[index].data();
+  _params[index].buffer_length = value.size();
+  _params[index].length = &_param_lengths[index];
+}
+
+// Set value of an integer parameter
+void Statement::setInt(size_t index, int value) {
+  _param_ints[index] = value;
+  _params[index].buffer_type = MYSQL_TYPE_LONG;
+  _params[index].buffer = &_param_ints[index];
+  _params[index].buffer_length = 0;
+  _params[index].length = NULL;
+}
+
+// Set value of a 64 bits integer parameter
+void Statement::setInt64(size_t index, int64_t value) {
+  _param_longs[index] = value;
+  _params[index].buffer_type = MYSQL_TYPE_LONGLONG;
+  _params[index].buffer = &_param_longs[index];
+  _params[index].buffer_length = 0;
+  _params[index].length = NULL;
+}
+
+// Execute statement using current parameter values
+bool Statement::execute(void) {
+  uint64_t start = Metrics::now();
+  bool error = run();
+  metrics->since(HISTOGRAM_QUERY, start);
+  metrics->add(error ? COUNTER_QUERY_ERRORS : COUNTER_QUERIES);
+  return error;
+}
+
+// Binds parameters, executes statement and buffers its result
+bool Statement::run(void) {
+  // Discard rows of previous execution not read yet
+  mysql_stmt_free_result(_stmt);
+
+  // Parameters are bound again, as string buffers may have moved
+  if (not _params.empty() and mysql_stmt_bind_param(_stmt, &_params[0])) {
+    cerr << "ERROR - Can not bind statement parameters" << endl;
+    cerr << mysql_stmt_error(_stmt) << endl;
+    return true;
+  }
+
+  if (mysql_stmt_execute(_stmt)) {
+    cerr << "ERROR - Can not execute statement" << endl;
+    cerr << mysql_stmt_error(_stmt) << endl;
+    return true;
+  }
+
+  // Buffer whole resultset on client, so connection is free again
+  if (not _results.empty() and mysql_stmt_store_result(_stmt)) {
+    cerr << "ERROR - Can not read statement result" << endl;
+    cerr << mysql_stmt_error(_stmt) << endl;
+    return true;
+  }
+
+  return false;
+}
+
+// Read next row of result
+bool Statement::next(void) {
+  if (_results.empty()) {
+    return false;
+  }
+
+  // Truncation only happens when a value exceeds its column definition,
+  // so row is still read
+  int status = mysql_stmt_fetch(_stmt);
+  return (status == 0 or status == MYSQL_DATA_TRUNCATED);
+}
+
+// Get a column of current row as string
+string Statement::getString(size_t index) const {
+  if (_result_nulls[index].value) {
+    return string();
+  }
+
+  if (_results[index].buffer_type == MYSQL_TYPE_LONG) {
+    stringstream ss;
+    ss << _result_ints[index];
+    return ss.str();
+  }
+
+  size_t len = min((size_t)_result_lengths[index],
+      _result_strings[index].size());
+  return string(&_result_strings[index][0], len);
+}
+
+// Get a column of current row as integer
+int Statement::getInt(size_t index) const {
+  if (_result_nulls[index].value) {
+    return 0;
+  }
+
+  if (_results[index].buffer_type != MYSQL_TYPE_LONG) {
+    return atoi(getString(index).c_str());
+  }
+
+  return _result_ints[index];
+}
+
+// Returns auto-increment value generated by last execution
+int Statement::getLastId(void) const {
+  return mysql_stmt_insert_id(_stmt);
+}
@@ -0,0 +1,155 @@
+/**
+ * Copyright 2013 Ezequiel Vázquez De la calle
+ *
+ * This file is part of Swarm.
+ *
+ * Swarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Swarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file Class Statement definition (mysql support only)
+ */
+
+#ifndef _STATEMENT_H_
+#define _STATEMENT_H_
+
+  #include <algorithm>
+  #include <cstdint>
+  #include <cstdlib>
+  #include <cstring>
+  #include <iostream>
+  #include <mysql/mysql.h>
+  #include <sstream>
+  #include <string>
+  #include <type_traits>
+  #include <vector>
+  using namespace std;
+
+  /**
+   * Prepared statement, parsed once by server and executed many times.
+   * Parameters are sent, and results received, in binary form, so values
+   * never need to be escaped. Integer columns are read as integers, and
+   * any other column as string
+   */
+  class Statement {
+    public:
+      /**
+       * Constructor
+       * @param con Connection on which statement will be prepared
+       */
+      Statement(MYSQL* con);
+
+      /**
+       * Destructor, closes statement on server
+       */
+      ~Statement(void);
+
+      /**
+       * Sends statement to server to be parsed, and binds buffers for its
+       * parameters and result columns
+       * @param sql SQL sentence, using ? as parameter placeholders
+       * @return True if statement could not be prepared, false either
+       */
+      bool prepare(const string& sql);
+
+      /**
+       * Sets value of a string parameter
+       * @param index Position of parameter, starting at zero
+       * @param value Value of parameter for next execution
+       */
+      void setString(size_t index, const string& value);
+
+      /**
+       * Sets value of an integer parameter
+       * @param index Position of parameter, starting at zero
+       * @param value Value of parameter for next execution
+       */
+      void setInt(size_t index, int value);
+
+      /**
+       * Sets value of a 64 bits integer parameter
+       * @param index Position of parameter, starting at zero
+       * @param value Value of parameter for next execution
+       */
+      void setInt64(size_t index, int64_t value);
+
+      /**
+       * Executes statement using current parameter values. Any result of
+       * previous execution is discarded
+       * @return True if statement could not be executed, false either
+       */
+      bool execute(void);
+
+      /**
+       * Reads next row of result into column buffers
+       * @return True if a row was read, false if there are no more rows
+       */
+      bool next(void);
+
+      /**
+       * Returns a column of current row as string
+       * @param index Position of column, starting at zero
+       * @return Value of column, empty if it is null
+       */
+      string getString(size_t index) const;
+
+      /**
+       * Returns a column of current row as integer
+       * @param index Position of column, starting at zero
+       * @return Value of column, zero if it is null
+       */
+      int getInt(size_t index) const;
+
+      /**
+       * Returns the value for an auto-increment column by last execution
+       * @return Value of last inserted auto-increment id
+       */
+      int getLastId(void) const;
+
+    private:
+      // Copy constructor and assign operator are private, as statement
+      // handler can not be shared
+      Statement(const Statement& statement);
+      Statement& operator=(const Statement& statement);
+
+      // Private function which actually executes statement
+      bool run(void);
+
+      // Null flag of a result column. Its type is my_bool on older client
+      // libraries and bool since MySQL 8.0, so it's taken from bindings.
+      // Wrapped, so a vector of them is never a packed vector of bool
+      struct NullFlag {
+        remove_pointer<decltype(MYSQL_BIND::is_null)>::type value;
+      };
+
+      // Attributes
+      MYSQL* _con;
+      MYSQL_STMT* _stmt;
+
+      // Parameter bindings, and their values
+      vector<MYSQL_BIND> _params;
+      vector<string> _param_strings;
+      vector<int> _param_ints;
+      vector<long long> _param_longs;
+      vector<unsigned long> _param_lengths;
+
+      // Result column bindings, and buffers where values are read
+      vector<MYSQL_BIND> _results;
+      vector<vector<char> > _result_strings;
+      vector<int> _result_ints;
+      vector<unsigned long> _result_lengths;
+      vector<NullFlag> _result_nulls;
+  };
+
+#endif
@@ -0,0 +1,81 @@
+/**
+ * Copyright 2013 Ezequiel Vázquez De la calle
+ *
+ * This file is part of Swarm.
+ *
+ * Swarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Swarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file Implementation of Storage class helpers, shared by backends
+ */
+
+#include "storage.h"
+using namespace std;
+
+Storage* Storage::_instance = 0;
+const int Storage::NUM_FIELDS;
+
+// Column names of device attributes, in DeviceField bit order
+static const char* COLUMNS[Storage::NUM_FIELDS] = {"hostname", "description",
+    "mac", "ip", "subnet", "hops", "path", "vlan", "reachable"};
+
+// Column name of an attribute
+const char* Storage::getColumn(int index) {
+  return COLUMNS[index];
+}
+
+// Checks if an attribute is stored as integer
+bool Storage::isInteger(int index) {
+  int field = 1 << index;
+  return (field == FIELD_HOPS or field == FIELD_VLAN or
+      field == FIELD_REACHABLE);
+}
+
+// Value of a text attribute
+string Storage::getText(const Device& device, int index) {
+  switch (1 << index) {
+    case FIELD_HOSTNAME:
+      return device.getHostname();
+
+    case FIELD_DESCRIPTION:
+      return device.getDescription();
+
+    case FIELD_MAC:
+      return device.getMac().toString();
+
+    case FIELD_SUBNET:
+      return device.getSubnetMask().toString();
+
+    case FIELD_PATH:
+      return device.getPath();
+
+    default:
+      return device.getIp().toString();
+  }
+}
+
+// Value of an integer attribute
+int Storage::getInteger(const Device& device, int index) {
+  switch (1 << index) {
+    case FIELD_HOPS:
+      return device.getHops();
+
+    case FIELD_VLAN:
+      return device.getVlan();
+
+    default:
+      return device.getReachable();
+  }
+}
@@ -0,0 +1,203 @@
+/**
+ * Copyright 2013 Ezequiel Vázquez De la calle
+ *
+ * This file is part of Swarm.
+ *
+ * Swarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Swarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file Class Storage definition. Interface of storage backends
+ */
+
+#ifndef _STORAGE_H_
+#define _STORAGE_H_
+
+  #include <ctime>
+  #include <map>
+  #include <string>
+  #include <vector>
+
+  #include "conversations.h"
+  #include "device.h"
+  #include "history.h"
+  #include "pool.h"
+  using namespace std;
+
+  // Type definitions. Nodes of devices come from a pool, so devices found
+  // while capturing reuse memory of those removed
+  typedef map<Ipv4Addr,Device,less<Ipv4Addr>,
+      PoolAllocator<pair<const Ipv4Addr,Device> > > Devices;
+
+  /**
+   * Receiver of devices read one at a time from storage, so they are never
+   * kept in memory all together
+   */
+  class DeviceReader {
+    public:
+      /**
+       * Destructor
+       */
+      virtual ~DeviceReader(void) {}
+
+      /**
+       * Receives a stored device
+       * @param device Device read, only valid during this call
+       * @return True to stop reading, false to go on
+       */
+      virtual bool readDevice(const Device& device) = 0;
+  };
+
+  /**
+   * Interface of backends where devices are persisted. A single backend is
+   * used by whole program, chosen at startup, and reached as a singleton.
+   * Backends must be safe to use from several threads at the same time
+   */
+  class Storage {
+    public:
+
+      // Number of persisted device attributes, as bits of DeviceField
+      static const int NUM_FIELDS = 9;
+
+      /**
+       * Returns backend in use
+       * @return Pointer to storage object, or NULL if none was set
+       */
+      static Storage* getInstance(void) {
+        return _instance;
+      }
+
+      /**
+       * Sets backend to use. Storage object is owned from now on
+       * @param instance Initialized storage object
+       */
+      static void setInstance(Storage* instance) {
+        delete _instance;
+        _instance = instance;
+      }
+
+      /**
+       * Destroyer for storage object in use
+       */
+      static void destroy(void) {
+        delete _instance;
+        _instance = 0;
+      }
+
+      /**
+       * Destructor
+       */
+      virtual ~Storage(void) {}
+
+      /**
+       * Returns highest device id stored
+       * @param id Highest id, or zero if there are no devices
+       * @return True if there was an error, false either
+       */
+      virtual bool getLastId(int& id) = 0;
+
+      /**
+       * Reads all stored devices. If some ip address is repeated, newest
+       * device is kept
+       * @param devices Map where devices are inserted, by ip address
+       * @return True if there was an error, false either
+       */
+      virtual bool load(Devices& devices) = 0;
+
+      /**
+       * Reads all stored devices one at a time, by id order, handing each
+       * one to a reader
+       * @param reader Receiver of devices
+       * @return True if there was an error or reader stopped, false either
+       */
+      virtual bool scan(DeviceReader& reader) = 0;
+
+      /**
+       * Reads a device using its id
+       * @param id Identifier of device to read
+       * @param device Device where read attributes are stored
+       * @return True if there was an error, or device was not found
+       */
+      virtual bool read(int id, Device& device) = 0;
+
+      /**
+       * Inserts or updates some devices, which already have an id
+       * @param devices Devices to write
+       * @param fields Mask of DeviceField values to write, same for all
+       * @return True if there was an error, false either
+       */
+      virtual bool write(const vector<Device>& devices, int fields) = 0;
+
+      /**
+       * Appends sightings of devices. Sightings of a bucket already
+       * written are added to it, so either all of them are written or
+       * none is. Backends which do not keep history discard them
+       * @param sightings Sightings to write, sorted by bucket
+       * @return True if there was an error, false either
+       */
+      virtual bool writeSightings(const vector<Sighting>& sightings) {
+        return false;
+      }
+
+      /**
+       * Removes sightings of older buckets
+       * @param before Buckets starting before this time are removed
+       * @return True if there was an error, false either
+       */
+      virtual bool expireSightings(time_t before) {
+        return false;
+      }
+
+      /**
+       * Appends conversations between devices. Counters of a bucket
+       * already written are added to it, so either all of them are written
+       * or none is. Backends which do not keep history discard them
+       * @param traffic Conversations to write
+       * @return True if there was an error, false either
+       */
+      virtual bool writeConversations(
+          const vector<Conversation>& traffic) {
+        return false;
+      }
+
+      /**
+       * Removes conversations of older buckets
+       * @param before Buckets starting before this time are removed
+       * @return True if there was an error, false either
+       */
+      virtual bool expireConversations(time_t before) {
+        return false;
+      }
+
+    protected:
+      // Column name of an attribute, by its bit position on DeviceField
+      static const char* getColumn(int index);
+
+      // Checks if an attribute is stored as integer
+      static bool isInteger(int index);
+
+      // Value of a text attribute of some device. Addresses are formatted
+      // here, as storage is one of the edges where text is needed
+      static string getText(const Device& device, int index);
+
+      // Value of an integer attribute of some device
+      static int getInteger(const Device& device, int index);
+
+    private:
+      static Storage* _instance;
+  };
+
+  #define storage Storage::getInstance()
+
+#endif
@@ -22,26 +22,96 @@
  */
 
 #include "config.h"
+#include <csignal>
 #include <fstream>
 #include <getopt.h>
 #include <iostream>
 #include <libconfig.h++>
 #include <string>
+#include <vector>
 
+#include "affinity.h"
+#include "conversations.h"
 #include "db.h"
+#include "exporter.h"
+#include "flusher.h"
+#include "history.h"
 #include "injector.h"
+#include "journalstorage.h"
+#include "metrics.h"
 #include "monitor.h"
+#include "mysqlstorage.h"
+#include "poller.h"
+#include "resolver.h"
 #include "sniffer.h"
+#include "sqlitestorage.h"
+#include "timeline.h"
+#include "tracer.h"
 
 using namespace std;
 using namespace libconfig;
 
+/**
+ * Settings read from command line
+ */
+struct Options {
+  vector<string> interfaces;
+  string filter;
+  int protocols;
+  Ipv4Addr ip;
+  bool load;
+  bool trace;
+  bool path;
+  bool resolve;
+  bool snmp;
+  int workers;
+  bool exporting;
+  ExportFormat format;
+  string output;
+};
+
+// Set when an export of found devices is requested using SIGUSR1
+static volatile sig_atomic_t exportRequested = 0;
+
+#ifdef ENABLE_TRACING
+  // Set when a dump of timeline is requested using SIGUSR2, or when swarm
+  // is asked to stop
+  static volatile sig_atomic_t traceRequested = 0;
+  static volatile sig_atomic_t stopRequested = 0;
+
+  // Path of timeline file
+  static string traceFile = "swarm.trace.json";
+#endif
+
 // Read all needed options from command line
-void readOptions(string& interface, string& filter, string& ip,
-    int argc, char **argv);
+void readOptions(Options& options, int argc, char **argv);
+
+// Find and parse settings file
+void readConfig(string file, Config& cfg);
+
+// Read storage settings from config file
+void readStorageConfig(const Config& cfg);
 
 // Read database settings from config file
-void readDbConfig(string file);
+void readDbConfig(const Config& cfg);
+
+// Read cpus of each thread role from config file
+void readAffinityConfig(const Config& cfg, const string& iface);
+
+// Export devices found by monitor, or stored ones, to a file
+bool exportDevices(const string& file, ExportFormat format, bool stored);
+
+// Signal handler which requests an export of found devices
+void requestExport(int signum);
+
+#ifdef ENABLE_TRACING
+  // Signal handlers which request a dump of timeline, or to stop
+  void requestTrace(int signum);
+  void requestStop(int signum);
+
+  // Writes timeline to its file. Called at exit
+  void dumpTimeline(void);
+#endif
 
 /**
  * Main program function
@@ -53,108 +123,308 @@ int main(int argc, char **argv) {
     exit(EXIT_FAILURE);
   }
 
-  // Read db configuration from a plaintext swarm.conf file
-  readDbConfig("swarm.conf");
-
-  // Variables needed
-  string interface, filter, ip;
+  // Read configuration from a plaintext swarm.conf file, and init storage
+  Config cfg;
+  readConfig("swarm.conf", cfg);
+  readStorageConfig(cfg);
 
   // Read options from command line, also build filter string
-  readOptions(interface, filter, ip, argc, argv);
+  Options options;
+  readOptions(options, argc, argv);
+
+  // Export stored devices and exit, if requested
+  if (options.exporting) {
+    bool error = exportDevices(options.output, options.format, true);
+    exit(error ? EXIT_FAILURE : EXIT_SUCCESS);
+  }
+
+  // Read cpus where each kind of thread runs, before any of them starts
+  readAffinityConfig(cfg, options.interfaces[0]);
+
+  // Launch flusher thread, which writes found devices to storage. Changes
+  // go to spill file while storage is too slow or down. If stored devices
+  // are not loaded, devices found again take their stored id
+  string spill = "swarm.spill";
+  cfg.lookupValue("spill_file", spill);
+  if (flusher->start(spill, not options.load)) {
+    exit(EXIT_FAILURE);
+  }
+
+  // Launch history thread, which writes sightings of devices as each time
+  // bucket ends
+  int bucket = History::BUCKET;
+  int retention = History::RETENTION;
+  cfg.lookupValue("history_bucket", bucket);
+  cfg.lookupValue("history_retention", retention);
+  history->start(bucket, retention);
+
+  // Launch conversations thread, which writes traffic between devices as
+  // each interval ends
+  int interval = Conversations::INTERVAL;
+  retention = Conversations::RETENTION;
+  cfg.lookupValue("conversation_interval", interval);
+  cfg.lookupValue("conversation_retention", retention);
+  conversations->start(interval, retention);
+
+  // Launch metrics thread, which serves metrics on a local socket and
+  // prints stats lines every few seconds
+  string metrics_socket = "swarm.sock";
+  int metrics_interval = Metrics::INTERVAL;
+  cfg.lookupValue("metrics_socket", metrics_socket);
+  cfg.lookupValue("metrics_interval", metrics_interval);
+  if (metrics->start(metrics_socket, metrics_interval)) {
+    exit(EXIT_FAILURE);
+  }
+
+  // Load devices already stored, so they are not probed and stored again
+  if (options.load and monitor->load()) {
+    exit(EXIT_FAILURE);
+  }
+
+  // Launch sniffer and injector threads of each interface. All of them
+  // share the same monitor, so devices are found and stored only once.
+  // Sniffers sample flows of known hosts once kernel drops this many
+  // packets in a second
+  int overload_drops = Sniffer::OVERLOAD_DROPS;
+  cfg.lookupValue("overload_drops", overload_drops);
+  for (size_t i = 0; i < options.interfaces.size(); ++i) {
+    Sniffer* capturer = new Sniffer(i);
+    capturer->setOverloadDrops(overload_drops);
+    capturer->start(options.interfaces[i], options.filter, options.ip,
+        options.protocols);
+
+    Injector* prober = new Injector(i);
+    prober->start(options.interfaces[i], options.ip, options.workers);
+  }
+
+  // Launch tracer thread, if hop distance must be guessed. Probes go
+  // through first interface, as they are routed anyway
+  if (options.trace) {
+    tracer->start(options.interfaces[0], options.ip, options.path);
+  }
 
-  // Launch sniffer thread
-  sniffer->start(interface, filter, ip);
+  // Launch resolver thread, if hostnames must be guessed. DNS server may be
+  // set on settings file, else system one is used
+  if (options.resolve) {
+    string server;
+    int port = 53;
+    cfg.lookupValue("resolver", server);
+    cfg.lookupValue("resolver_port", port);
+    resolver->start(server, port);
+  }
 
-  // Launch injector thread
-  injector->start(interface, ip);
+  // Launch poller thread, if devices must be asked using SNMP. Community and
+  // port may be set on settings file
+  if (options.snmp) {
+    string community = "public";
+    int port = 161;
+    cfg.lookupValue("snmp_community", community);
+    cfg.lookupValue("snmp_port", port);
+    poller->start(community, port);
+  }
+
+  // Devices found are exported to a file each time SIGUSR1 is received.
+  // File and format may be set on settings file
+  string export_file = "swarm.export";
+  string export_format = "json";
+  ExportFormat format;
+  cfg.lookupValue("export_file", export_file);
+  cfg.lookupValue("export_format", export_format);
+  if (Exporter::parseFormat(export_format, format)) {
+    cerr << "ERROR - Unknown export format " << export_format << endl;
+    exit(EXIT_FAILURE);
+  }
+  signal(SIGUSR1, requestExport);
+
+#ifdef ENABLE_TRACING
+  // Timeline is written each time SIGUSR2 is received, and at exit. File
+  // may be set on settings file
+  cfg.lookupValue("trace_file", traceFile);
+  signal(SIGUSR2, requestTrace);
+  signal(SIGINT, requestStop);
+  signal(SIGTERM, requestStop);
+  atexit(dumpTimeline);
+#endif
 
   // TODO write end condition
   while (1) {
     sleep(1);
+
+    if (exportRequested) {
+      exportRequested = 0;
+      exportDevices(export_file, format, false);
+    }
+
+#ifdef ENABLE_TRACING
+    if (traceRequested) {
+      traceRequested = 0;
+      timeline->dump(traceFile);
+    }
+    if (stopRequested) {
+      exit(EXIT_SUCCESS);
+    }
+#endif
   }
 
   return EXIT_SUCCESS;
 }
 
 // Function which read command line options and reads interface and filters
-void readOptions(string& interface, string& filter, string &ip,
-    int argc, char **argv)
-{
+void readOptions(Options& options, int argc, char **argv) {
   // Define all accepted options
   const struct option long_options[] {
     {"arp", no_argument, 0, 'a'},
+    {"export", required_argument, 0, 'e'},
     {"help", no_argument, 0, 'h'},
     {"icmp", no_argument, 0, 'i'},
+    {"load", no_argument, 0, 'l'},
+    {"output", required_argument, 0, 'o'},
+    {"path", no_argument, 0, 'p'},
+    {"resolve", no_argument, 0, 'r'},
     {"snmp", no_argument, 0, 's'},
     {"spoof", required_argument, 0, 'S'},
+    {"trace", no_argument, 0, 't'},
     {"version", no_argument, 0, 'v'},
+    {"workers", required_argument, 0, 'w'},
     {0, 0, 0, 0}
   };
 
-  // Default filter is "ip", for all ip traffic
-  filter = "ip";
+  // Default filter is "ip", for all ip traffic. ICMP is part of it, and
+  // needed to learn reachability from injected echo requests, so it's
+  // always processed
+  options.filter = "ip";
+  options.protocols = PROTOCOL_ICMP | PROTOCOL_VLAN;
+  options.load = false;
+  options.trace = false;
+  options.path = false;
+  options.resolve = false;
+  options.snmp = false;
+  options.workers = 0;
+  options.exporting = false;
+  options.format = EXPORT_JSON;
+  options.output = "-";
 
   // Parse all command line options
   int c;
-  while ((c = getopt_long(argc, argv, "ahisSv", long_options, NULL)) != -1) {
+  while ((c = getopt_long(argc, argv, "ae:hilo:prsS:tvw:", long_options, NULL))
+      != -1)
+  {
     switch (c) {
       case 'a':
-        filter.append(" or arp");
+        options.filter.append(" or arp");
+        options.protocols |= PROTOCOL_ARP;
+        break;
+
+      case 'e':
+        if (Exporter::parseFormat(optarg, options.format)) {
+          cerr << "Invalid format on export argument" << endl;
+          exit(EXIT_FAILURE);
+        }
+        options.exporting = true;
         break;
 
       case 'h':
-        cout << "Usage: " << argv[0] << " [options] interface" << endl;
+        cout << "Usage: " << argv[0] << " [options] interface...";
+        cout << endl;
+        cout << "       " << argv[0] << " -e <format> [-o <file>]" << endl;
         cout << "Options:" << endl;
         cout << "  -a, --arp         Capture ARP packets" << endl;
         cout << "  -h, --help        Show this help and exit" << endl;
         cout << "  -i, --icmp        Capture ICMP packets" << endl;
-        cout << "  -s, --snmp        Capture SNMP packets" << endl;
+        cout << "  -l, --load        Load devices found on previous runs";
+        cout << endl;
+        cout << "  -p, --path        Record hops path when tracing" << endl;
+        cout << "  -r, --resolve     Guess hostnames using reverse DNS";
+        cout << endl;
+        cout << "  -s, --snmp        Guess name and description using SNMP";
+        cout << endl;
+        cout << "  -t, --trace       Guess hop distance to devices" << endl;
         cout << "  -v, --version     Show version and exit" << endl;
         cout << endl << "Arguments:" << endl;
+        cout << "  -e <format>, --export" << endl;
+        cout << "                    Export stored devices and exit. Format";
+        cout << endl << "                    is json, csv or binary" << endl;
+        cout << "  -o <file>, --output" << endl;
+        cout << "                    Export to <file> instead of stdout";
+        cout << endl;
         cout << "  -S <ip>, --spoof  Use <ip> as own ip address" << endl;
+        cout << "  -w <n>, --workers Inject packets using <n> threads per";
+        cout << endl << "                    interface" << endl;
         exit(EXIT_SUCCESS);
 
       case 'i':
-        filter.append(" or icmp");
+        options.filter.append(" or icmp");
+        options.protocols |= PROTOCOL_ICMP;
+        break;
+
+      case 'l':
+        options.load = true;
+        break;
+
+      case 'o':
+        options.output = optarg;
+        break;
+
+      case 'p':
+        options.path = true;
+        break;
+
+      case 'r':
+        options.resolve = true;
         break;
 
       case 's':
-        filter.append(" or snmp");
+        options.snmp = true;
         break;
 
       case 'S':
         // Validate ip address in dot separated octets
-        struct sockaddr_in sa;
-        if (inet_pton(AF_INET, optarg, &(sa.sin_addr)) <= 0) {
+        if (Ipv4Addr::parse(optarg, options.ip)) {
           cerr << "Invalid ip address on spoof argument" << endl;
           exit(EXIT_FAILURE);
         }
-        ip = optarg;
+        break;
+
+      case 't':
+        options.trace = true;
         break;
 
       case 'v':
         cout << argv[0] << " - version " << VERSION << endl;
         exit(EXIT_SUCCESS);
 
+      case 'w':
+        options.workers = atoi(optarg);
+        if (options.workers <= 0) {
+          cerr << "Invalid number of workers on workers argument" << endl;
+          exit(EXIT_FAILURE);
+        }
+        break;
+
       default:
-        cerr << "Usage: " << argv[0] << " [options] interface" << endl;
+        cerr << "Usage: " << argv[0] << " [options] interface..." << endl;
         exit(EXIT_FAILURE);
     }
   }
 
-  // Check mandatory unique argument (interface)
-  if (argc - optind != 1) {
-    cerr << "Usage: " << argv[0] << " [options] interface" << endl;
+  // Check mandatory arguments (interfaces), not needed to export
+  if (options.exporting and argc == optind) {
+    return;
+  }
+  if (argc == optind) {
+    cerr << "Usage: " << argv[0] << " [options] interface..." << endl;
     exit(EXIT_FAILURE);
   }
-  else {
-    interface = argv[optind++];
+  while (optind < argc) {
+    options.interfaces.push_back(argv[optind++]);
   }
+
+  // Same packets are captured from 802.1Q VLAN tagged frames
+  options.filter.append(" or (vlan and (" + options.filter + "))");
 }
 
-// Reads database configuration from a settings.ini file
-void readDbConfig(string file) {
-  Config cfg;
+// Finds settings file and parses it
+void readConfig(string file, Config& cfg) {
   file = "/etc/" + file;
 
   // Check if settings file exists on /etc. Else, look into /usr/local/etc/
@@ -177,7 +447,46 @@ void readDbConfig(string file) {
     cerr << " - " << pex.getError() << endl;
     exit(EXIT_FAILURE);
   }
+}
+
+// Reads storage configuration from parsed settings file, and init backend
+void readStorageConfig(const Config& cfg) {
+  // MySQL is used, unless other backend is chosen
+  string backend = "mysql";
+  cfg.lookupValue("storage", backend);
+
+  if (backend == "sqlite") {
+    string file = "swarm.db";
+    cfg.lookupValue("sqlite_file", file);
+
+    SqliteStorage* sqlite = new SqliteStorage();
+    if (sqlite->init(file)) {
+      exit(EXIT_FAILURE);
+    }
+    Storage::setInstance(sqlite);
+  }
+  else if (backend == "journal") {
+    string file = "swarm.journal";
+    cfg.lookupValue("journal_file", file);
+
+    JournalStorage* journal = new JournalStorage();
+    if (journal->init(file)) {
+      exit(EXIT_FAILURE);
+    }
+    Storage::setInstance(journal);
+  }
+  else if (backend == "mysql") {
+    readDbConfig(cfg);
+    Storage::setInstance(new MysqlStorage());
+  }
+  else {
+    cerr << "ERROR - Unknown storage backend " << backend << endl;
+    exit(EXIT_FAILURE);
+  }
+}
 
+// Reads database configuration from parsed settings file
+void readDbConfig(const Config& cfg) {
   // Get values from parsed settings file
   try {
     string host = cfg.lookup("host");
@@ -185,13 +494,81 @@ void readDbConfig(string file) {
     string password = cfg.lookup("password");
     string database = cfg.lookup("database");
 
-    // Init MySQL connection
-    if (db->init(host, username, password, database)) {
+    // Size of connection pool is optional
+    int connections = Db::CONNECTIONS;
+    cfg.lookupValue("connections", connections);
+    if (connections <= 0) {
+      cerr << "Invalid number of connections on connections setting" << endl;
+      exit(EXIT_FAILURE);
+    }
+
+    // Init MySQL connections
+    if (db->init(host, username, password, database, connections)) {
       exit(EXIT_FAILURE);
     }
   }
   catch(const SettingNotFoundException &nfex) {
     cerr << "Wrong or missing setting name in configuration file" << endl;
+    exit(EXIT_FAILURE);
+  }
+}
+
+// Reads cpus of each thread role from parsed settings file
+void readAffinityConfig(const Config& cfg, const string& iface) {
+  const char* keys[NUM_ROLES] = {"affinity_capture", "affinity_injector",
+      "affinity_persistence", "affinity_resolver"};
+
+  // Roles without cpus run anywhere
+  for (int role = 0; role < NUM_ROLES; role++) {
+    string cpus;
+    cfg.lookupValue(keys[role], cpus);
+    if (affinity->setCpus((ThreadRole)role, cpus)) {
+      cerr << "ERROR - Invalid cpus for " << keys[role] << ": " << cpus;
+      cerr << endl;
+      exit(EXIT_FAILURE);
+    }
   }
+
+  // Threads not bound to an interface are placed close to first one
+  affinity->setInterface(iface);
 }
 
+// Exports devices found by monitor, or stored ones, to a file
+bool exportDevices(const string& file, ExportFormat format, bool stored) {
+  Exporter exporter;
+
+  if (exporter.open(file, format)) {
+    return true;
+  }
+
+  bool error = stored ? exporter.exportStorage() : exporter.exportMonitor();
+  if (exporter.close() or error) {
+    cerr << "ERROR - Can't export devices" << endl;
+    return true;
+  }
+
+  return false;
+}
+
+// Requests an export of found devices. Export is done by main loop, as
+// almost nothing is safe inside a signal handler
+void requestExport(int signum) {
+  exportRequested = 1;
+}
+
+#ifdef ENABLE_TRACING
+  // Requests a dump of timeline
+  void requestTrace(int signum) {
+    traceRequested = 1;
+  }
+
+  // Requests to stop, so timeline is written at exit
+  void requestStop(int signum) {
+    stopRequested = 1;
+  }
+
+  // Writes timeline to its file
+  void dumpTimeline(void) {
+    timeline->dump(traceFile);
+  }
+#endif
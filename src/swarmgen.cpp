@@ -0,0 +1,258 @@
+/**
+ * Copyright 2013 Ezequiel Vázquez De la calle
+ *
+ * This file is part of Swarm.
+ *
+ * Swarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Swarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file Main function of traffic generator, which writes captures of a
+ * simulated network to load test swarm
+ */
+
+#include "config.h"
+#include <cstdlib>
+#include <getopt.h>
+#include <iostream>
+#include <string>
+
+#include "generator.h"
+
+using namespace std;
+
+/**
+ * Settings read from command line
+ */
+struct Options {
+  TrafficProfile profile;
+  size_t packets;
+  string output;
+};
+
+// Packets written at once
+static const size_t CHUNK_SIZE = 65536;
+
+// Read all needed options from command line
+void readOptions(Options& options, int argc, char **argv);
+
+/**
+ * Main program function
+ */
+int main(int argc, char **argv) {
+  Options options;
+  readOptions(options, argc, argv);
+
+  Generator generator(options.profile);
+  if (generator.open(options.output)) {
+    exit(EXIT_FAILURE);
+  }
+
+  // Write packets a chunk at a time, so progress is kept on disk
+  for (size_t done = 0; done < options.packets; done += CHUNK_SIZE) {
+    if (generator.write(min(CHUNK_SIZE, options.packets - done))) {
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (generator.close()) {
+    exit(EXIT_FAILURE);
+  }
+
+  cerr << "Written " << options.packets << " packets of ";
+  cerr << generator.getHosts() << " hosts" << endl;
+  exit(EXIT_SUCCESS);
+}
+
+// Read all needed options from command line
+void readOptions(Options& options, int argc, char **argv) {
+  // Define all accepted options
+  const struct option long_options[] {
+    {"arp", required_argument, 0, 'a'},
+    {"churn", required_argument, 0, 'C'},
+    {"count", required_argument, 0, 'c'},
+    {"help", no_argument, 0, 'h'},
+    {"hosts", required_argument, 0, 'n'},
+    {"icmp", required_argument, 0, 'i'},
+    {"output", required_argument, 0, 'o'},
+    {"prefix", required_argument, 0, 'p'},
+    {"rate", required_argument, 0, 'r'},
+    {"seed", required_argument, 0, 's'},
+    {"version", no_argument, 0, 'v'},
+    {"vlan", required_argument, 0, 'V'},
+    {0, 0, 0, 0}
+  };
+
+  // By default, a thousand hosts on 10.0.0.0/8 send ten packets each
+  options.profile.hosts = 1000;
+  options.profile.rate = 1000;
+  options.profile.churn = 0;
+  options.profile.arp = 20;
+  options.profile.icmp = 10;
+  options.profile.seed = 1;
+  options.packets = 0;
+  options.output = "swarm.pcap";
+
+  // Parse all command line options
+  int c;
+  Prefix prefix;
+  while ((c = getopt_long(argc, argv, "a:C:c:hi:n:o:p:r:s:vV:", long_options,
+      NULL)) != -1)
+  {
+    switch (c) {
+      case 'a':
+        options.profile.arp = atoi(optarg);
+        if (options.profile.arp < 0 or options.profile.arp > 100) {
+          cerr << "Invalid percentage on arp argument" << endl;
+          exit(EXIT_FAILURE);
+        }
+        break;
+
+      case 'C':
+        options.profile.churn = atof(optarg);
+        if (options.profile.churn < 0) {
+          cerr << "Invalid rate on churn argument" << endl;
+          exit(EXIT_FAILURE);
+        }
+        break;
+
+      case 'c':
+        options.packets = strtoul(optarg, NULL, 10);
+        if (options.packets == 0) {
+          cerr << "Invalid number of packets on count argument" << endl;
+          exit(EXIT_FAILURE);
+        }
+        break;
+
+      case 'h':
+        cout << "Usage: " << argv[0] << " [options]" << endl;
+        cout << "Options:" << endl;
+        cout << "  -h, --help        Show this help and exit" << endl;
+        cout << "  -v, --version     Show version and exit" << endl;
+        cout << endl << "Arguments:" << endl;
+        cout << "  -a <n>, --arp     Make <n> percent of packets ARP (20)";
+        cout << endl;
+        cout << "  -C <n>, --churn   Replace <n> hosts per second (0)";
+        cout << endl;
+        cout << "  -c <n>, --count   Write <n> packets (10 per host)" << endl;
+        cout << "  -i <n>, --icmp    Make <n> percent of packets ICMP (10)";
+        cout << endl;
+        cout << "  -n <n>, --hosts   Simulate <n> active hosts (1000)";
+        cout << endl;
+        cout << "  -o <file>, --output" << endl;
+        cout << "                    Write to <file> (swarm.pcap), or - for";
+        cout << " stdout" << endl;
+        cout << "  -p <prefix>, --prefix" << endl;
+        cout << "                    Spread hosts on <prefix>, may be repeated";
+        cout << endl << "                    (10.0.0.0/8)" << endl;
+        cout << "  -r <n>, --rate    Send <n> packets per second (1000)";
+        cout << endl;
+        cout << "  -s <n>, --seed    Seed random numbers with <n> (1)";
+        cout << endl;
+        cout << "  -V <id>, --vlan   Spread hosts on VLAN <id>, may be";
+        cout << " repeated" << endl;
+        exit(EXIT_SUCCESS);
+
+      case 'i':
+        options.profile.icmp = atoi(optarg);
+        if (options.profile.icmp < 0 or options.profile.icmp > 100) {
+          cerr << "Invalid percentage on icmp argument" << endl;
+          exit(EXIT_FAILURE);
+        }
+        break;
+
+      case 'n':
+        options.profile.hosts = strtoul(optarg, NULL, 10);
+        if (options.profile.hosts == 0) {
+          cerr << "Invalid number of hosts on hosts argument" << endl;
+          exit(EXIT_FAILURE);
+        }
+        break;
+
+      case 'o':
+        options.output = optarg;
+        break;
+
+      case 'p':
+        if (Generator::parsePrefix(optarg, prefix)) {
+          cerr << "Invalid prefix on prefix argument" << endl;
+          exit(EXIT_FAILURE);
+        }
+        options.profile.prefixes.push_back(prefix);
+        break;
+
+      case 'r':
+        options.profile.rate = atof(optarg);
+        if (options.profile.rate <= 0) {
+          cerr << "Invalid rate on rate argument" << endl;
+          exit(EXIT_FAILURE);
+        }
+        break;
+
+      case 's':
+        options.profile.seed = strtoul(optarg, NULL, 10);
+        break;
+
+      case 'v':
+        cout << argv[0] << " - version " << VERSION << endl;
+        exit(EXIT_SUCCESS);
+
+      case 'V':
+        options.profile.vlans.push_back(atoi(optarg));
+        if (options.profile.vlans.back() < 1 or
+            options.profile.vlans.back() > 4094)
+        {
+          cerr << "Invalid id on vlan argument" << endl;
+          exit(EXIT_FAILURE);
+        }
+        break;
+
+      default:
+        cerr << "Usage: " << argv[0] << " [options]" << endl;
+        exit(EXIT_FAILURE);
+    }
+  }
+
+  if (optind != argc) {
+    cerr << "Usage: " << argv[0] << " [options]" << endl;
+    exit(EXIT_FAILURE);
+  }
+
+  if (options.profile.prefixes.empty()) {
+    Generator::parsePrefix("10.0.0.0/8", prefix);
+    options.profile.prefixes.push_back(prefix);
+  }
+
+  if (options.packets == 0) {
+    options.packets = options.profile.hosts * 10;
+  }
+
+  if (options.profile.arp + options.profile.icmp > 100) {
+    cerr << "ARP and ICMP percentages add more than 100" << endl;
+    exit(EXIT_FAILURE);
+  }
+
+  // Hosts active at the same time need an address each. They are spread
+  // evenly among prefixes, so each prefix must have room for its share
+  size_t count = options.profile.prefixes.size();
+  size_t share = (options.profile.hosts + count - 1) / count;
+  for (size_t i = 0; i < count; i++) {
+    if (share > options.profile.prefixes[i].size - 3) {
+      cerr << "Prefix " << options.profile.prefixes[i].network;
+      cerr << " has no room for " << share << " hosts" << endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+}
@@ -0,0 +1,60 @@
+/**
+ * Copyright 2013 Ezequiel Vázquez De la calle
+ *
+ * This file is part of Swarm.
+ *
+ * Swarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Swarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file Class Symbol method definition
+ */
+
+#include "symbol.h"
+using namespace std;
+
+mutex Symbol::_mutex;
+
+// Constructor: finds text on table, adding it if needed. Elements of an
+// unordered set never move, so pointers to them stay valid
+Symbol::Symbol(const string& text) {
+  if (text.empty()) {
+    _text = NULL;
+    return;
+  }
+
+  lock_guard<mutex> lock(_mutex);
+  _text = &*getTable().insert(text).first;
+}
+
+// Returns number of texts on table
+size_t Symbol::count(void) {
+  lock_guard<mutex> lock(_mutex);
+  return getTable().size();
+}
+
+
+// Returns text of empty symbols
+const string& Symbol::getEmpty(void) {
+  static const string empty;
+  return empty;
+}
+
+// Returns table of texts. Built on first use, and never destroyed, so
+// symbols of static objects stay valid
+unordered_set<string>& Symbol::getTable(void) {
+  static unordered_set<string>* table = new unordered_set<string>();
+  return *table;
+}
@@ -0,0 +1,97 @@
+/**
+ * Copyright 2013 Ezequiel Vázquez De la calle
+ *
+ * This file is part of Swarm.
+ *
+ * Swarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Swarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file Class Symbol definition
+ */
+
+#ifndef _SYMBOL_H_
+#define _SYMBOL_H_
+
+  #include <cstddef>
+  #include <mutex>
+  #include <string>
+  #include <unordered_set>
+
+  using namespace std;
+
+  /**
+   * Interned text. Each distinct text is stored once, on a table shared by
+   * whole program, and symbols only point to it, so they are copied and
+   * compared without allocations. Used for device attributes which repeat
+   * across devices and rarely change, i.e. hostnames and descriptions.
+   * Texts are never removed from table
+   */
+  class Symbol {
+    public:
+      /**
+       * Constructor of an empty symbol
+       */
+      Symbol(void) : _text(NULL) {}
+
+      /**
+       * Constructor from text, which is added to table if it's not there
+       * @param text Text of symbol
+       */
+      explicit Symbol(const string& text);
+
+      /**
+       * Returns text of symbol
+       * @return Interned text, valid during whole program
+       */
+      const string& str(void) const {
+        return (_text == NULL) ? getEmpty() : *_text;
+      }
+
+      /**
+       * Checks if symbol is empty
+       * @return True if symbol has no text, false either
+       */
+      bool empty(void) const {
+        return _text == NULL;
+      }
+
+      /**
+       * Returns number of texts on table
+       * @return Number of distinct texts interned
+       */
+      static size_t count(void);
+
+      // Comparison operators. Same text is always on same place
+      bool operator==(const Symbol& other) const {
+        return _text == other._text;
+      }
+      bool operator!=(const Symbol& other) const {
+        return _text != other._text;
+      }
+
+    private:
+      // Private function which returns text of empty symbols
+      static const string& getEmpty(void);
+
+      // Private function which returns table of texts
+      static unordered_set<string>& getTable(void);
+
+      // Attributes
+      const string* _text;
+      static mutex _mutex;
+  };
+
+#endif
@@ -0,0 +1,128 @@
+/**
+ * Copyright 2013 Ezequiel Vázquez De la calle
+ *
+ * This file is part of Swarm.
+ *
+ * Swarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Swarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file Class Timeline method definition
+ */
+
+#include "timeline.h"
+using namespace std;
+
+Timeline* Timeline::_instance = 0;
+const size_t Timeline::RING_SIZE;
+
+// Constructor: note when timeline started, to convert ticks into time
+Timeline::Timeline(void) {
+  _start = now();
+  _start_time = chrono::steady_clock::now();
+}
+
+// Destructor
+Timeline::~Timeline(void) {
+  for (size_t i = 0; i < _rings.size(); ++i) {
+    delete _rings[i];
+  }
+}
+
+// Names calling thread on timeline
+void Timeline::setThreadName(const char* name) {
+  getRing().name = name;
+}
+
+// Writes spans of all threads to a file, in Chrome trace event format
+bool Timeline::dump(const string& file) {
+  string tmp = file + ".tmp";
+  ofstream out(tmp.c_str());
+  if (not out.good()) {
+    cerr << "ERROR - Can't open trace file " << file << endl;
+    return true;
+  }
+
+  // Ticks per microsecond, measured over whole run
+  uint64_t ticks = now() - _start;
+  double elapsed = chrono::duration<double, micro>(
+      chrono::steady_clock::now() - _start_time).count();
+  double rate = (elapsed > 0 and ticks > 0) ? ticks / elapsed : 1000;
+
+  _mutex.lock();
+  vector<Ring*> rings = _rings;
+  _mutex.unlock();
+
+  out << fixed << setprecision(3);
+  out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+  bool first = true;
+  vector<Event> events;
+  for (size_t i = 0; i < rings.size(); ++i) {
+    const Ring& ring = *rings[i];
+
+    if (ring.name != NULL) {
+      out << (first ? "\n" : ",\n");
+      out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":";
+      out << ring.tid << ",\"args\":{\"name\":\"" << ring.name << "\"}}";
+      first = false;
+    }
+
+    // Owner thread may overwrite spans while they are copied, so ring is
+    // copied at once and, as in a seqlock, only spans it did not wrap onto
+    // meanwhile are kept
+    uint64_t next = ring.next.load(memory_order_acquire);
+    events = ring.events;
+    atomic_thread_fence(memory_order_acquire);
+    uint64_t last = ring.next.load(memory_order_relaxed);
+    uint64_t oldest = (last >= RING_SIZE) ? last - RING_SIZE + 1 : 0;
+    for (uint64_t j = oldest; j < next; ++j) {
+      const Event& event = events[j & (RING_SIZE - 1)];
+      if (event.begin < _start or event.end < event.begin) {
+        continue;
+      }
+
+      out << (first ? "\n" : ",\n");
+      out << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,";
+      out << "\"tid\":" << ring.tid << ",\"ts\":";
+      out << (event.begin - _start) / rate << ",\"dur\":";
+      out << (event.end - event.begin) / rate << "}";
+      first = false;
+    }
+  }
+  out << "\n]}\n";
+  out.close();
+
+  if (out.fail() or rename(tmp.c_str(), file.c_str())) {
+    cerr << "ERROR - Can't write trace file " << file << endl;
+    remove(tmp.c_str());
+    return true;
+  }
+  return false;
+}
+
+// Adds a ring for a new thread
+Timeline::Ring* Timeline::addRing(void) {
+  Ring* ring = new Ring();
+  ring->events.resize(RING_SIZE);
+  ring->next.store(0);
+  ring->name = NULL;
+
+  _mutex.lock();
+  ring->tid = _rings.size() + 1;
+  _rings.push_back(ring);
+  _mutex.unlock();
+
+  return ring;
+}
@@ -0,0 +1,214 @@
+/**
+ * Copyright 2013 Ezequiel Vázquez De la calle
+ *
+ * This file is part of Swarm.
+ *
+ * Swarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Swarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file Classes Timeline and Span definition. Timeline implements Singleton
+ * pattern
+ */
+
+#ifndef _TIMELINE_H_
+#define _TIMELINE_H_
+
+  #include "config.h"
+
+  #include <atomic>
+  #include <chrono>
+  #include <cstdint>
+  #include <cstdio>
+  #include <fstream>
+  #include <iomanip>
+  #include <iostream>
+  #include <mutex>
+  #include <string>
+  #include <vector>
+
+  #if defined(__x86_64__) || defined(__i386__)
+    #include <x86intrin.h>
+  #endif
+
+  using namespace std;
+
+  // Spans are only recorded if tracing was enabled at configure time, so
+  // they cost nothing otherwise
+  #ifdef ENABLE_TRACING
+    #define TRACE_CONCAT(a, b) a##b
+    #define TRACE_VARIABLE(line) TRACE_CONCAT(_span_, line)
+    #define TRACE_SPAN(name) Span TRACE_VARIABLE(__LINE__)(name)
+    #define TRACE_THREAD(name) timeline->setThreadName(name)
+  #else
+    #define TRACE_SPAN(name)
+    #define TRACE_THREAD(name)
+  #endif
+
+  /**
+   * Singleton object which keeps a timeline of spans, stages of work done
+   * by each thread. Every thread records into its own ring buffer, so
+   * recording takes no lock, and only newest spans of each thread are
+   * kept. Timestamps are read from CPU time stamp counter where available.
+   * Timeline is written in Chrome trace event format, so it can be opened
+   * with any trace viewer.
+   */
+  class Timeline {
+    public:
+
+      // Spans kept for each thread. Must be a power of two
+      static const size_t RING_SIZE = 65536;
+
+      /**
+       * Implementation of Singleton pattern
+       * @return Pointer to singleton timeline object
+       */
+      static Timeline* getInstance(void) {
+        if (_instance == 0) {
+          _instance = new Timeline();
+        }
+        return _instance;
+      }
+
+      /**
+       * Destroyer for singleton timeline object
+       */
+      static void destroy(void) {
+        delete _instance;
+      }
+
+      /**
+       * Returns current timestamp, in ticks of time stamp counter, or in
+       * nanoseconds if there is none
+       * @return Timestamp
+       */
+      static uint64_t now(void) {
+        #if defined(__x86_64__) || defined(__i386__)
+          return __rdtsc();
+        #else
+          return chrono::duration_cast<chrono::nanoseconds>(
+              chrono::steady_clock::now().time_since_epoch()).count();
+        #endif
+      }
+
+      /**
+       * Records a span of calling thread, overwriting its oldest one if
+       * ring is full
+       * @param name Name of span. Must be a string literal
+       * @param begin Timestamp when span started
+       * @param end Timestamp when span ended
+       */
+      void record(const char* name, uint64_t begin, uint64_t end) {
+        Ring& ring = getRing();
+        uint64_t next = ring.next.load(memory_order_relaxed);
+        Event& event = ring.events[next & (RING_SIZE - 1)];
+        event.name = name;
+        event.begin = begin;
+        event.end = end;
+        ring.next.store(next + 1, memory_order_release);
+      }
+
+      /**
+       * Names calling thread on timeline
+       * @param name Name of thread. Must be a string literal
+       */
+      void setThreadName(const char* name);
+
+      /**
+       * Writes spans of all threads to a file, in Chrome trace event format.
+       * Spans being recorded meanwhile may be missing
+       * @param file Path of file
+       * @return True if there was an error, false either
+       */
+      bool dump(const string& file);
+
+    protected:
+      // Constructor, destructor, copy constructor and assing operator
+      // are protected due to singleton pattern implementation
+      Timeline(void);
+      ~Timeline(void);
+      Timeline(const Timeline& timeline);
+      Timeline& operator=(const Timeline& timeline);
+
+    private:
+      // Span recorded by some thread
+      struct Event {
+        const char* name;
+        uint64_t begin;
+        uint64_t end;
+      };
+
+      // Spans of a thread. Only owner thread writes into it
+      struct Ring {
+        vector<Event> events;
+        atomic<uint64_t> next;
+        const char* name;
+        int tid;
+      };
+
+      // Private function which returns ring of calling thread, adding a
+      // new one on first use
+      Ring& getRing(void) {
+        static thread_local Ring* ring = 0;
+        if (ring == 0) {
+          ring = addRing();
+        }
+        return *ring;
+      }
+
+      // Private function which adds a ring for a new thread
+      Ring* addRing(void);
+
+      // Attributes
+      vector<Ring*> _rings;
+      uint64_t _start;
+      chrono::steady_clock::time_point _start_time;
+      mutex _mutex;
+      static Timeline* _instance;
+  };
+
+  #define timeline Timeline::getInstance()
+
+  /**
+   * Scoped span: records time elapsed from its construction to its
+   * destruction. Use through TRACE_SPAN macro
+   */
+  class Span {
+    public:
+      /**
+       * Constructor, starts span
+       * @param name Name of span. Must be a string literal
+       */
+      Span(const char* name) : _name(name), _begin(Timeline::now()) {}
+
+      /**
+       * Destructor, records span
+       */
+      ~Span(void) {
+        timeline->record(_name, _begin, Timeline::now());
+      }
+
+    private:
+      // Copy constructor and assign operator are private, as span must be
+      // recorded once
+      Span(const Span& span);
+      Span& operator=(const Span& span);
+
+      // Attributes
+      const char* _name;
+      uint64_t _begin;
+  };
+
+#endif
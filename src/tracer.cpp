@@ -0,0 +1,299 @@
+/**
+ * Copyright 2013 Ezequiel Vázquez De la calle
+ *
+ * This file is part of Swarm.
+ *
+ * Swarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Swarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file Class Tracer method definition
+ */
+
+#include "tracer.h"
+using namespace std;
+
+Tracer* Tracer::_instance = 0;
+const int Tracer::MAX_TTL;
+const size_t Tracer::WINDOW;
+const int Tracer::RATE;
+const int Tracer::TIMEOUT;
+const int Tracer::RETRY;
+
+// Constructor
+Tracer::Tracer(void) {
+  _handler = NULL;
+  _initialized = false;
+  _path = false;
+  _id = 0;
+  _tokens = 0;
+  _icmp_tag = LIBNET_PTAG_INITIALIZER;
+  _ip_tag = LIBNET_PTAG_INITIALIZER;
+}
+
+// Destructor
+Tracer::~Tracer(void) {
+  libnet_destroy(_handler);
+}
+
+// Initialize tracer object, and launch as thread
+void Tracer::start(string& iface, Ipv4Addr spoof, bool path) {
+  char errbuf[LIBNET_ERRBUF_SIZE];
+
+  // Do not initialize twice
+  if (_initialized) {
+    return;
+  }
+
+  // Initialize libnet handler. Raw sockets let kernel route probes, as most
+  // targets beyond first hop can't be reached using their mac address
+  _handler = libnet_init(LIBNET_RAW4, (char*)iface.c_str(), errbuf);
+  if (_handler == NULL) {
+    cerr << "ERROR - Libnet couldn't be initialized for tracer" << endl;
+    cerr << errbuf << endl;
+    exit(EXIT_FAILURE);
+  }
+
+  // Use spoofed ip address as source, if defined. Else, use own ip address
+  if (not spoof.empty()) {
+    _ip = spoof;
+  }
+  else {
+    _ip = Ipv4Addr::fromNetwork(libnet_get_ipaddr4(_handler));
+  }
+
+  // Generate a random id, shared by all probes, to recognize replies
+  libnet_seed_prand(_handler);
+  _id = (u_int16_t)libnet_get_prand(LIBNET_PR16);
+
+  // Launch thread
+  _path = path;
+  _refill = chrono::steady_clock::now();
+  _initialized = true;
+  thread t1(trace);
+  t1.detach();
+}
+
+// Queue some device to guess its hop distance
+bool Tracer::enqueue(const Ipv4Addr& ip) {
+  // Nothing to do if tracer is not running
+  if (not _initialized) {
+    return false;
+  }
+
+  _mutex.lock();
+
+  // Target which never answered waits before it's traced again
+  map<Ipv4Addr,chrono::steady_clock::time_point>::iterator it;
+  it = _failed.find(ip);
+  if (it != _failed.end()) {
+    if (chrono::steady_clock::now() < it->second) {
+      _mutex.unlock();
+      return false;
+    }
+    _failed.erase(it);
+  }
+
+  bool queued = _queued.insert(ip).second;
+  if (queued) {
+    _pending.push_back(ip);
+  }
+  _mutex.unlock();
+
+  return queued;
+}
+
+// Admit queued targets into window and send next round of probes
+void Tracer::sweep(void) {
+  vector<pair<Ipv4Addr,int> > probes;
+  chrono::steady_clock::time_point now = chrono::steady_clock::now();
+
+  _mutex.lock();
+
+  // Refill probe budget, allowing bursts of at most one second
+  chrono::duration<double> elapsed = now - _refill;
+  _tokens = min((double)RATE, _tokens + elapsed.count() * RATE);
+  _refill = now;
+
+  // Admit queued targets while there is room on window
+  while (_active.size() < WINDOW and not _pending.empty()) {
+    Trace& trace = _active[_pending.front()];
+    trace.ttl = 1;
+    trace.hops = -1;
+    trace.last = now;
+    trace.path.assign(MAX_TTL, Ipv4Addr());
+    _pending.pop_front();
+  }
+
+  // Send next TTL to every target, starting where previous round stopped.
+  // Targets already reached, or out of TTLs, are not probed anymore
+  map<Ipv4Addr,Trace>::iterator it = _active.upper_bound(_cursor);
+  for (size_t i = 0; i < _active.size() and _tokens >= 1; ++i, ++it) {
+    if (it == _active.end()) {
+      it = _active.begin();
+    }
+    Trace& trace = it->second;
+    if (trace.hops == -1 and trace.ttl <= MAX_TTL) {
+      probes.push_back(make_pair(it->first, trace.ttl));
+      trace.ttl++;
+      trace.last = now;
+      _tokens -= 1;
+    }
+    _cursor = it->first;
+  }
+
+  _mutex.unlock();
+
+  // Actually inject probes, without holding lock
+  for (size_t i = 0; i < probes.size(); ++i) {
+    probe(probes[i].first, probes[i].second);
+  }
+}
+
+// Finish traces whose replies are not expected anymore
+void Tracer::expire(void) {
+  vector<pair<Ipv4Addr,Trace> > done;
+  chrono::steady_clock::time_point now = chrono::steady_clock::now();
+
+  // Extract finished traces from window
+  _mutex.lock();
+  map<Ipv4Addr,Trace>::iterator it = _active.begin();
+  while (it != _active.end()) {
+    Trace& trace = it->second;
+    if ((trace.hops != -1 or trace.ttl > MAX_TTL) and
+        now - trace.last > chrono::seconds(TIMEOUT))
+    {
+      done.push_back(*it);
+      _active.erase(it++);
+    }
+    else {
+      ++it;
+    }
+  }
+  _mutex.unlock();
+
+  // Store hop distance, and path if needed, on corresponding devices
+  for (size_t i = 0; i < done.size(); ++i) {
+    const Ipv4Addr& ip = done[i].first;
+    const Trace& trace = done[i].second;
+    Device dev;
+
+    try {
+      dev = monitor->getDevice(ip);
+    }
+    catch (exception) {
+      continue;
+    }
+
+    dev.setHops(trace.hops);
+
+    // Path is made of hops found before target, using "*" for silent ones
+    if (_path) {
+      int last = (trace.hops != -1) ? trace.hops - 1 : MAX_TTL;
+      while (last > 0 and trace.path[last - 1].empty()) {
+        --last;
+      }
+      string path;
+      for (int ttl = 1; ttl <= last; ++ttl) {
+        path.append(ttl > 1 ? "," : "");
+        const Ipv4Addr& hop = trace.path[ttl - 1];
+        path.append(hop.empty() ? "*" : hop.toString());
+      }
+      dev.setPath(path);
+    }
+
+    if (monitor->updateDevice(ip, dev)) {
+      cerr << "ERROR - Can't update device with ip " << ip << endl;
+    }
+  }
+
+  // Results are stored, so targets may be queued again. Those which never
+  // answered wait some time before
+  _mutex.lock();
+  for (size_t i = 0; i < done.size(); ++i) {
+    _queued.erase(done[i].first);
+    if (done[i].second.hops == -1) {
+      _failed[done[i].first] = now + chrono::seconds(RETRY);
+    }
+  }
+  _mutex.unlock();
+}
+
+// Process a reply to some probe sent by tracer
+void Tracer::processReply(const Ipv4Addr& target, int ttl,
+    const Ipv4Addr& from)
+{
+  // Discard replies with a corrupted or foreign sequence
+  if (ttl < 1 or ttl > MAX_TTL) {
+    return;
+  }
+
+  _mutex.lock();
+  map<Ipv4Addr,Trace>::iterator it = _active.find(target);
+  if (it != _active.end()) {
+    Trace& trace = it->second;
+    // Target replied: distance is lowest TTL which reached it
+    if (from == target) {
+      if (trace.hops == -1 or ttl < trace.hops) {
+        trace.hops = ttl;
+      }
+    }
+    // Some hop between us and target replied
+    else if (_path) {
+      trace.path[ttl - 1] = from;
+    }
+  }
+  _mutex.unlock();
+}
+
+// Inject a single TTL limited probe
+void Tracer::probe(const Ipv4Addr& target, int ttl) {
+  u_int32_t src_ip_addr = _ip.toNetwork();
+  u_int32_t dst_ip_addr = target.toNetwork();
+
+  // Build ICMP header. Sequence carries TTL, so replies can be matched
+  _icmp_tag = libnet_build_icmpv4_echo(ICMP_ECHO, 0, 0, _id, ttl, NULL, 0,
+      _handler, _icmp_tag);
+  if (_icmp_tag == -1) {
+    cerr << "ERROR - Can't build icmp probe for ip " << target << endl;
+    cerr << libnet_geterror(_handler) << endl;
+    return;
+  }
+
+  // Build IPv4 header, with TTL limited to the hop being probed
+  _ip_tag = libnet_build_ipv4(LIBNET_IPV4_H + LIBNET_ICMPV4_ECHO_H, 0, 0, 0,
+      ttl, IPPROTO_ICMP, 0, src_ip_addr, dst_ip_addr, NULL, 0, _handler,
+      _ip_tag);
+  if (_ip_tag == -1) {
+    cerr << "ERROR - Can't build ipv4 header for ip " << target << endl;
+    cerr << libnet_geterror(_handler) << endl;
+    return;
+  }
+
+  // Writing packet to interface
+  if (libnet_write(_handler) == -1) {
+    cerr << "ERROR - Can't write probe to interface" << endl;
+    cerr << libnet_geterror(_handler) << endl;
+  }
+}
+
+// ICMP identifier getter
+u_int16_t Tracer::getId(void) const {
+  return _id;
+}
+
+// Checks if tracer has been initialized
+bool Tracer::isRunning(void) const {
+  return _initialized;
+}
@@ -0,0 +1,188 @@
+/**
+ * Copyright 2013 Ezequiel Vázquez De la calle
+ *
+ * This file is part of Swarm.
+ *
+ * Swarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Swarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file Class Tracer definition. Singleton pattern implementation
+ */
+
+#ifndef _TRACER_H_
+#define _TRACER_H_
+
+  #include <chrono>
+  #include <deque>
+  #include <iostream>
+  #include <libnet.h>
+  #include <map>
+  #include <mutex>
+  #include <set>
+  #include <string>
+  #include <thread>
+  #include <vector>
+
+  #include "actions.h"
+  #include "monitor.h"
+  using namespace std;
+
+  /**
+   * Singleton object which guesses the distance, in network hops, to devices
+   * found by sniffer. Instead of running one traceroute after another, it
+   * keeps a window of thousands of targets and sends TTL limited ICMP echo
+   * requests to all of them in rounds (every target gets TTL 1, then TTL 2,
+   * and so on). Replies are matched back to their target by the ICMP id and
+   * sequence embedded on time exceeded messages, which carry the original
+   * header: id identifies swarm probes, and sequence holds probe TTL.
+   */
+  class Tracer {
+    public:
+
+      // Highest TTL probed before giving up with some target
+      static const int MAX_TTL = 30;
+
+      // Maximum number of targets being traced at the same time
+      static const size_t WINDOW = 4096;
+
+      // Maximum number of probes sent per second
+      static const int RATE = 10000;
+
+      // Seconds to wait for late replies after last probe sent to a target
+      static const int TIMEOUT = 3;
+
+      // Seconds before a target which never answered is traced again
+      static const int RETRY = 3600;
+
+      /**
+       * Implementation of Singleton pattern
+       * @return Pointer to singleton tracer object
+       */
+      static Tracer* getInstance(void) {
+        if (_instance == 0) {
+          _instance = new Tracer();
+        }
+        return _instance;
+      }
+
+      /**
+       * Destroyer for singleton tracer object
+       */
+      static void destroy(void) {
+        delete _instance;
+      }
+
+      /**
+       * Initialize tracer object, and launch as thread
+       * @param iface Name of network interface on which inject probes
+       * @param spoof Optional ip address to perform ip spoofing
+       * @param path Also record ip addresses of hops between us and devices
+       */
+      void start(string& iface, Ipv4Addr spoof = Ipv4Addr(),
+          bool path = false);
+
+      /**
+       * Queue some device to guess its hop distance. Devices already queued
+       * or being traced, or which never answered a recent trace, are
+       * discarded, so it's safe to call it repeatedly.
+       * @param ip Ip address of device to trace
+       * @return True if device was queued, false if it was discarded
+       */
+      bool enqueue(const Ipv4Addr& ip);
+
+      /**
+       * Admit queued targets into window and send next round of probes,
+       * without exceeding probes per second rate
+       */
+      void sweep(void);
+
+      /**
+       * Finish traces whose replies are not expected anymore, and store
+       * results on monitor
+       */
+      void expire(void);
+
+      /**
+       * Process a reply to some probe sent by tracer
+       * @param target Ip address of device which probe was sent to
+       * @param ttl TTL of probe, as stored on its ICMP sequence
+       * @param from Ip address of replying device (target, or some hop)
+       */
+      void processReply(const Ipv4Addr& target, int ttl,
+          const Ipv4Addr& from);
+
+      /**
+       * ICMP identifier getter
+       * @return Identifier used on all ICMP probes sent by tracer
+       */
+      u_int16_t getId(void) const;
+
+      /**
+       * Checks if tracer has been initialized
+       * @return True if tracer is running, false either
+       */
+      bool isRunning(void) const;
+
+    protected:
+      // Constructor, destructor, copy constructor and assing operator
+      // are protected due to singleton pattern implementation
+      Tracer(void);
+      ~Tracer(void);
+      Tracer(const Tracer& tracer);
+      Tracer& operator=(const Tracer& tracer);
+
+    private:
+      // State of a target being traced
+      struct Trace {
+        int ttl;
+        int hops;
+        chrono::steady_clock::time_point last;
+        vector<Ipv4Addr> path;
+      };
+
+      // Private function which injects a single TTL limited probe
+      void probe(const Ipv4Addr& target, int ttl);
+
+      // Attributes
+      Ipv4Addr _ip;
+      bool _path;
+      u_int16_t _id;
+      double _tokens;
+      chrono::steady_clock::time_point _refill;
+      libnet_ptag_t _icmp_tag;
+      libnet_ptag_t _ip_tag;
+      libnet_t* _handler;
+      bool _initialized;
+      mutex _mutex;
+      static Tracer* _instance;
+
+      // Targets waiting for a place on window, targets being traced, and
+      // position of next round inside window
+      deque<Ipv4Addr> _pending;
+      map<Ipv4Addr,Trace> _active;
+      Ipv4Addr _cursor;
+
+      // Internal list of targets queued or being traced, until their result
+      // is stored. Avoid repeating tasks, while letting finished targets be
+      // traced again
+      set<Ipv4Addr> _queued;
+
+      // Targets which never answered, and when they may be traced again
+      map<Ipv4Addr,chrono::steady_clock::time_point> _failed;
+  };
+
+  #define tracer Tracer::getInstance()
+
+#endif
@@ -0,0 +1,267 @@
+/**
+ * Copyright 2013 Ezequiel Vázquez De la calle
+ *
+ * This file is part of Swarm.
+ *
+ * Swarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Swarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file Class Worker method definition
+ */
+
+#include "worker.h"
+#include "affinity.h"
+#include "metrics.h"
+#include "timeline.h"
+#include "tracer.h"
+using namespace std;
+
+const size_t Worker::QUEUE_SIZE;
+
+// Constructor
+Worker::Worker(void) {
+  _handler = NULL;
+  _src_ip_addr = 0;
+  _eth_arp_tag = LIBNET_PTAG_INITIALIZER;
+  _arp_tag = LIBNET_PTAG_INITIALIZER;
+  _eth_ip_tag = LIBNET_PTAG_INITIALIZER;
+  _ip_tag = LIBNET_PTAG_INITIALIZER;
+  _icmp_tag = LIBNET_PTAG_INITIALIZER;
+}
+
+// Destructor
+Worker::~Worker(void) {
+  libnet_destroy(_handler);
+}
+
+// Initialize libnet context, and launch as thread
+bool Worker::start(const string& iface, const Ipv4Addr& spoof) {
+  if (open(iface, spoof)) {
+    return true;
+  }
+
+  // Launch thread
+  thread t1(&Worker::run, this);
+  t1.detach();
+  return false;
+}
+
+// Initialize libnet context, without launching thread
+bool Worker::open(const string& iface, const Ipv4Addr& spoof) {
+  char errbuf[LIBNET_ERRBUF_SIZE];
+
+  // Save interface, so thread is placed close to it
+  _iface = iface;
+
+  // Initialize libnet handler
+  _handler = libnet_init(LIBNET_LINK, (char*)iface.c_str(), errbuf);
+  if (_handler == NULL) {
+    cerr << "ERROR - Libnet couldn't be initialized" << endl;
+    cerr << errbuf << endl;
+    return true;
+  }
+
+  // Source addresses never change, so resolve them only once. Use spoofed
+  // ip address, if defined
+  if (not spoof.empty()) {
+    _src_ip_addr = spoof.toNetwork();
+  }
+  else {
+    _src_ip_addr = libnet_get_ipaddr4(_handler);
+  }
+
+  // Get source MAC address
+  struct libnet_ether_addr* mac_addr = libnet_get_hwaddr(_handler);
+  if (mac_addr == NULL) {
+    cerr << "ERROR - libnet can not determine mac address for interface ";
+    cerr << iface << endl << libnet_geterror(_handler) << endl;
+    return true;
+  }
+  _src_mac_addr = *mac_addr;
+
+  // Seed generator of ICMP identifiers
+  libnet_seed_prand(_handler);
+  return false;
+}
+
+// Queue a probe to be injected
+void Worker::push(const Probe& probe) {
+  unique_lock<mutex> lock(_mutex);
+  while (_queue.size() >= QUEUE_SIZE) {
+    _not_full.wait(lock);
+  }
+  _queue.push_back(probe);
+  _not_empty.notify_one();
+}
+
+// Consume queued probes forever
+void Worker::run(void) {
+  Probe probe;
+
+  TRACE_THREAD("injector");
+  affinity->pin(ROLE_INJECTOR, _iface);
+
+  while (1) {
+    // Wait for some probe, and take it out of queue
+    unique_lock<mutex> lock(_mutex);
+    while (_queue.empty()) {
+      _not_empty.wait(lock);
+    }
+    probe = _queue.front();
+    _queue.pop_front();
+    _not_full.notify_one();
+    lock.unlock();
+
+    // Forge and inject probe, without holding lock
+    TRACE_SPAN("probe");
+    bool error = forge(probe) or write();
+    metrics->add(error ? COUNTER_PROBE_ERRORS : COUNTER_PROBES);
+  }
+}
+
+// Forge frame of some probe, without injecting it
+bool Worker::forge(const Probe& probe) {
+  switch (probe.type) {
+    case PROBE_ARP_REQUEST:
+      return forgeArpRequest(probe.ip);
+
+    case PROBE_ARP_SPOOF:
+      return forgeArpSpoofResponse(probe.ip, probe.mac);
+
+    case PROBE_ICMP_ECHO:
+      return forgeIcmp(probe.ip, probe.mac);
+  }
+  return true;
+}
+
+// Write last forged frame to interface
+bool Worker::write(void) {
+  TRACE_SPAN("libnet write");
+  if (libnet_write(_handler) == -1) {
+    cerr << "ERROR - Can't write packet to interface" << endl;
+    cerr << libnet_geterror(_handler) << endl;
+    return true;
+  }
+
+  return false;
+}
+
+// Libnet context handler getter
+libnet_t* Worker::getHandler(void) const {
+  return _handler;
+}
+
+// Forge ARP request to find MAC address
+bool Worker::forgeArpRequest(const Ipv4Addr& target) {
+  u_int32_t dst_ip_addr = target.toNetwork();
+  u_int8_t mac_zero_addr[6] = {0x0, 0x0, 0x0, 0x0, 0x0, 0x0};
+
+  // Build ARP request header
+  _arp_tag = libnet_build_arp(ARPHRD_ETHER, ETHERTYPE_IP, 6, 4, ARPOP_REQUEST,
+      _src_mac_addr.ether_addr_octet, (u_int8_t*)(&_src_ip_addr),
+      mac_zero_addr, (u_int8_t*)(&dst_ip_addr), NULL, 0, _handler, _arp_tag);
+  if (_arp_tag == -1) {
+    cerr << "ERROR - Can't build ARP header for target ip " << target << endl;
+    cerr << libnet_geterror(_handler) << endl;
+    return true;
+  }
+
+  // Build ethernet header
+  _eth_arp_tag = libnet_build_ethernet(
+      (u_int8_t*)MacAddr::BROADCAST.getOctets(),
+      _src_mac_addr.ether_addr_octet, ETHERTYPE_ARP, NULL, 0, _handler,
+      _eth_arp_tag);
+  if (_eth_arp_tag == -1) {
+    cerr << "ERROR - Can't build eth header for target ip " << target << endl;
+    cerr << libnet_geterror(_handler) << endl;
+    return true;
+  }
+
+  return false;
+}
+
+// Forge ARP response to perform IP spoofing
+bool Worker::forgeArpSpoofResponse(const Ipv4Addr& ip, const MacAddr& mac)
+{
+  u_int32_t dst_ip_addr = ip.toNetwork();
+
+  // Build ARP response header
+  _arp_tag = libnet_build_arp(ARPHRD_ETHER, ETHERTYPE_IP, 6, 4, ARPOP_REPLY,
+      _src_mac_addr.ether_addr_octet, (u_int8_t*)(&_src_ip_addr),
+      (u_int8_t*)mac.getOctets(), (u_int8_t*)(&dst_ip_addr), NULL, 0,
+      _handler, _arp_tag);
+  if (_arp_tag == -1) {
+    cerr << "ERROR - Can't build ARP header for target ip " << ip << endl;
+    cerr << libnet_geterror(_handler) << endl;
+    return true;
+  }
+
+  // Build ethernet header
+  _eth_arp_tag = libnet_build_ethernet((u_int8_t*)mac.getOctets(),
+      _src_mac_addr.ether_addr_octet, ETHERTYPE_ARP, NULL, 0, _handler,
+      _eth_arp_tag);
+  if (_eth_arp_tag == -1) {
+    cerr << "ERROR - Can't build eth header for target ip " << ip << endl;
+    cerr << libnet_geterror(_handler) << endl;
+    return true;
+  }
+
+  return false;
+}
+
+// Forge ICMP echo request to find reachability
+bool Worker::forgeIcmp(const Ipv4Addr& ip, const MacAddr& mac) {
+  u_int32_t dst_ip_addr = ip.toNetwork();
+  u_int16_t id;
+  u_int16_t seq;
+
+  // Generating a random id, different from the one used by tracer probes
+  id = (u_int16_t)libnet_get_prand(LIBNET_PR16);
+  if (id == tracer->getId()) {
+    ++id;
+  }
+
+  // Build ICMP header
+  seq = 1;
+  _icmp_tag = libnet_build_icmpv4_echo(ICMP_ECHO, 0, 0, id, seq, NULL, 0,
+      _handler, _icmp_tag);
+  if (_icmp_tag == -1) {
+    cerr << "ERROR - Can't build icmp echo request for ip " << ip << endl;
+    cerr << libnet_geterror(_handler) << endl;
+    return true;
+  }
+
+  // Build IPv4 header
+  _ip_tag = libnet_build_ipv4(LIBNET_IPV4_H + LIBNET_ICMPV4_ECHO_H, 0, 0, 0,
+      127, IPPROTO_ICMP, 0, _src_ip_addr, dst_ip_addr, NULL, 0, _handler,
+      _ip_tag);
+  if (_ip_tag == -1) {
+    cerr << "ERROR - Can't build ipv4 header for ip " << ip << endl;
+    cerr << libnet_geterror(_handler) << endl;
+    return true;
+  }
+
+  // Build ethernet header
+  _eth_ip_tag = libnet_build_ethernet((u_int8_t*)mac.getOctets(),
+      _src_mac_addr.ether_addr_octet, ETHERTYPE_IP, NULL, 0, _handler,
+      _eth_ip_tag);
+  if (_eth_ip_tag == -1) {
+    cerr << "ERROR - Can't build eth header for target ip " << ip << endl;
+    cerr << libnet_geterror(_handler) << endl;
+    return true;
+  }
+
+  return false;
+}
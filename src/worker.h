@@ -0,0 +1,154 @@
+/**
+ * Copyright 2013 Ezequiel Vázquez De la calle
+ *
+ * This file is part of Swarm.
+ *
+ * Swarm is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Swarm is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file Class Worker definition
+ */
+
+#ifndef _WORKER_H_
+#define _WORKER_H_
+
+  #include <condition_variable>
+  #include <deque>
+  #include <iostream>
+  #include <libnet.h>
+  #include <mutex>
+  #include <netinet/ether.h>
+  #include <string>
+  #include <thread>
+
+  #include "ipv4addr.h"
+  #include "macaddr.h"
+  using namespace std;
+
+  /**
+   * Kinds of packet which injector workers are able to forge
+   */
+  enum ProbeType {
+    PROBE_ARP_REQUEST,
+    PROBE_ARP_SPOOF,
+    PROBE_ICMP_ECHO
+  };
+
+  /**
+   * Packet waiting to be forged and injected by some worker
+   */
+  struct Probe {
+    ProbeType type;
+    Ipv4Addr ip;
+    MacAddr mac;
+  };
+
+  /**
+   * Injection thread. Each worker owns its libnet context and packet tags,
+   * so workers never share state while building packets, and consumes
+   * probes from its own bounded queue.
+   */
+  class Worker {
+    public:
+
+      // Maximum number of probes waiting on queue
+      static const size_t QUEUE_SIZE = 65536;
+
+      /**
+       * Constructor
+       */
+      Worker(void);
+
+      /**
+       * Destructor
+       */
+      ~Worker(void);
+
+      /**
+       * Initialize libnet context, and launch as thread
+       * @param iface Name of network interface on which inject packets
+       * @param spoof Optional ip address to use as source of packets
+       * @return True if there was an error, false either
+       */
+      bool start(const string& iface, const Ipv4Addr& spoof);
+
+      /**
+       * Initialize libnet context, without launching thread, so frames
+       * may be forged from caller's thread
+       * @param iface Name of network interface on which inject packets
+       * @param spoof Optional ip address to use as source of packets
+       * @return True if there was an error, false either
+       */
+      bool open(const string& iface, const Ipv4Addr& spoof);
+
+      /**
+       * Queue a probe to be injected. Blocks while queue is full
+       * @param probe Probe to inject
+       */
+      void push(const Probe& probe);
+
+      /**
+       * Consumes queued probes forever. Launched as thread by start
+       */
+      void run(void);
+
+      /**
+       * Forges frame of some probe on libnet context, without injecting it
+       * @param probe Probe to forge
+       * @return True if frame could not be built, false either
+       */
+      bool forge(const Probe& probe);
+
+      /**
+       * Getter for libnet context handler
+       * @return Handler of libnet context owned by this worker
+       */
+      libnet_t* getHandler(void) const;
+
+    private:
+      // Copy constructor and assign operator are private, as each worker
+      // owns a libnet context which can not be shared
+      Worker(const Worker& worker);
+      Worker& operator=(const Worker& worker);
+
+      // Private functions which actually forge packets. Return true if
+      // packet could not be built
+      bool forgeArpRequest(const Ipv4Addr& target);
+      bool forgeArpSpoofResponse(const Ipv4Addr& ip, const MacAddr& mac);
+      bool forgeIcmp(const Ipv4Addr& ip, const MacAddr& mac);
+
+      // Private function which injects last forged packet. Returns true if
+      // packet could not be written
+      bool write(void);
+
+      // Attributes
+      string _iface;
+      u_int32_t _src_ip_addr;
+      struct libnet_ether_addr _src_mac_addr;
+      libnet_ptag_t _eth_arp_tag;
+      libnet_ptag_t _arp_tag;
+      libnet_ptag_t _eth_ip_tag;
+      libnet_ptag_t _ip_tag;
+      libnet_ptag_t _icmp_tag;
+      libnet_t* _handler;
+
+      // Probes waiting to be injected
+      deque<Probe> _queue;
+      mutex _mutex;
+      condition_variable _not_empty;
+      condition_variable _not_full;
+  };
+
+#endif